@@ -0,0 +1,42 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef IPSET_BDD_INTERNAL_H
+#define IPSET_BDD_INTERNAL_H
+
+#include <glib.h>
+
+
+/**
+ * On disk, we use a different node ID scheme than we do in memory.
+ * Terminal node IDs are non-negative, and are equal to the terminal
+ * value.  Nonterminal node IDs are negative, starting with -1.
+ * Nonterminal -1 appears first on disk, then nonterminal -2, and so
+ * on.
+ */
+
+typedef gint  serialized_id_t;
+
+
+/**
+ * A nonterminal in an archive's node table.  The writer collects
+ * these before outputting the table, and the reader holds on to them
+ * until they're added to a node cache.
+ */
+
+typedef struct archive_node
+{
+    guint8  variable;
+    serialized_id_t  low;
+    serialized_id_t  high;
+} archive_node_t;
+
+
+#endif  /* IPSET_BDD_INTERNAL_H */
@@ -154,6 +154,15 @@ ipset_node_memory_size(ipset_node_id_t node);
  * Terminal nodes
  */
 
+/**
+ * Terminal values are stored in the upper 31 bits of a terminal's
+ * node ID, so only values between 0 and IPSET_TERMINAL_VALUE_MASK can
+ * be represented.  Arithmetic on terminal values should be done
+ * modulo 2^31, by masking the result with this.
+ */
+
+#define IPSET_TERMINAL_VALUE_MASK  0x7fffffff
+
 /**
  * Return the value of a terminal node.  The result is undefined if
  * the node ID represents a nonterminal.
@@ -267,6 +276,30 @@ typedef struct ipset_node_cache
 
     GHashTable  *ite_cache;
 
+    /**
+     * A cache of the fingerprint of each nonterminal that we've
+     * fingerprinted so far.
+     */
+
+    GHashTable  *fingerprint_cache;
+
+    /**
+     * A cache of the number of nonzero assignments below each
+     * nonterminal that we've counted so far.  Keyed by an
+     * ipset_binary_key_t whose lhs is the node and whose rhs is the
+     * end variable of the count.
+     */
+
+    GHashTable  *count_cache;
+
+    /**
+     * The computed table for each user-defined operator that we've
+     * applied, keyed by the operator.  Unlike the other caches, each
+     * table has a fixed size, and older results are overwritten.
+     */
+
+    GHashTable  *apply_tables;
+
 } ipset_node_cache_t;
 
 /**
@@ -302,7 +335,8 @@ ipset_node_cache_free(ipset_node_cache_t *cache);
 /**
  * Create a new terminal node with the given value, returning its ID.
  * This function ensures that there is only one node with the given
- * value in this cache.
+ * value in this cache.  Only the bits of value in
+ * IPSET_TERMINAL_VALUE_MASK are stored.
  */
 
 ipset_node_id_t
@@ -321,10 +355,129 @@ ipset_node_cache_nonterminal(ipset_node_cache_t *cache,
                              ipset_node_id_t low,
                              ipset_node_id_t high);
 
+/**
+ * Copy a BDD that was created in another node cache into this one,
+ * returning the ID of its root in this cache.
+ */
+
+ipset_node_id_t
+ipset_node_cache_import(ipset_node_cache_t *cache,
+                        ipset_node_id_t node);
+
+
+/**
+ * Return a fingerprint of the function represented by a BDD.  The
+ * fingerprint only depends on the structure of the BDD, and not on
+ * the node IDs in any particular node cache, so it can be compared
+ * across node caches and processes.  The fingerprint of each
+ * nonterminal is cached, so fingerprinting a BDD that shares nodes
+ * with one that's already been fingerprinted is cheap.
+ */
+
+guint64
+ipset_node_cache_fingerprint(ipset_node_cache_t *cache,
+                             ipset_node_id_t node);
+
+
+/**
+ * A 128-bit unsigned integer, used to count the assignments of a BDD.
+ */
+
+typedef struct ipset_count
+{
+    guint64  high;
+    guint64  low;
+} ipset_count_t;
+
+
+/**
+ * Count the assignments to variables var through end-1 that the BDD
+ * maps to a nonzero value.  var must be no larger than the variable
+ * of the BDD's root, and every variable in the BDD must be less than
+ * end.  The count of each nonterminal is cached for each end, so
+ * each node is only counted once per address width.  The count
+ * saturates at 2^128-1, which can only happen if end-var is 128 and
+ * every assignment is nonzero.
+ */
+
+void
+ipset_node_cache_count(ipset_node_cache_t *cache,
+                       ipset_node_id_t node,
+                       ipset_variable_t var,
+                       ipset_variable_t end,
+                       ipset_count_t *count);
+
+
+/**
+ * Add two counts, saturating at 2^128-1.
+ */
+
+void
+ipset_count_add(ipset_count_t *result,
+                const ipset_count_t *a,
+                const ipset_count_t *b);
+
+
+/**
+ * Subtract b from a, which must be at least as large as b.
+ */
+
+void
+ipset_count_sub(ipset_count_t *result,
+                const ipset_count_t *a,
+                const ipset_count_t *b);
+
+
+/**
+ * Shift a count to the left (if shift > 0) or right (if shift < 0).
+ * Shifting left saturates at 2^128-1.
+ */
+
+void
+ipset_count_shift(ipset_count_t *result,
+                  const ipset_count_t *a,
+                  gint shift);
+
+
+/**
+ * Compare two counts, returning a negative, zero, or positive value
+ * if a is less than, equal to, or greater than b.
+ */
+
+gint
+ipset_count_compare(const ipset_count_t *a, const ipset_count_t *b);
+
+
+/**
+ * Return a uniformly random count that's less than bound, which must
+ * be nonzero.
+ */
+
+void
+ipset_count_random(ipset_count_t *result,
+                   GRand *rng,
+                   const ipset_count_t *bound);
+
+
+/**
+ * The compression codecs that can be applied to a saved BDD.  Both
+ * zlib variants produce the same on-disk codec; they only differ in
+ * how hard the compressor works.
+ */
+
+typedef enum ipset_compression
+{
+    IPSET_COMPRESSION_NONE = 0,
+    IPSET_COMPRESSION_ZLIB,
+    IPSET_COMPRESSION_ZLIB_FAST
+} ipset_compression_t;
+
 
 /**
  * Load a BDD from an input stream.  The error field is filled in with
- * a GError object is the BDD can't be read for any reason.
+ * a GError object is the BDD can't be read for any reason.  If the
+ * BDD was saved with compression, it is decompressed incrementally
+ * as the nodes are read in.
  */
 
 ipset_node_id_t
@@ -333,6 +486,50 @@ ipset_node_cache_load(GInputStream *stream,
                       GError **err);
 
 
+/**
+ * Load a BDD from an input stream, checking the cancellable object
+ * (which can be NULL) whenever we need to read more data from the
+ * stream.
+ */
+
+ipset_node_id_t
+ipset_node_cache_load_cancellable(GInputStream *stream,
+                                  ipset_node_cache_t *cache,
+                                  GCancellable *cancellable,
+                                  GError **err);
+
+
+/**
+ * Start loading a BDD from an input stream on a worker thread.  The
+ * worker loads the BDD into a private node cache, so the caller can
+ * keep using its own node cache while the load is in progress.  When
+ * the load is finished, the callback is called on the thread-default
+ * main context of the thread that started the load.
+ */
+
+void
+ipset_node_cache_load_async(GInputStream *stream,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data);
+
+
+/**
+ * Finish an asynchronous BDD load, copying the BDD into the given
+ * node cache.  Must be called from the thread that owns the node
+ * cache.  The copy is done by ipset_node_cache_import, so it takes
+ * time proportional to the number of nodes in the BDD, and it runs
+ * on the calling thread: only the parsing of the stream happens on
+ * the worker.  (The caller's node cache isn't thread-safe, so the
+ * worker can't look up nodes in it.)
+ */
+
+ipset_node_id_t
+ipset_node_cache_load_finish(ipset_node_cache_t *cache,
+                             GAsyncResult *result,
+                             GError **err);
+
+
 /**
  * Save a BDD to an output stream.  This encodes the set using only
  * those nodes that are reachable from the BDD's root node.
@@ -345,6 +542,151 @@ ipset_node_cache_save(GOutputStream *stream,
                       GError **err);
 
 
+/**
+ * Save a BDD to an output stream, compressing the encoded nodes with
+ * the given codec.  The compressed stream has its own header, so
+ * ipset_node_cache_load() can tell the two formats apart.  If
+ * compression is IPSET_COMPRESSION_NONE, this is the same as
+ * ipset_node_cache_save().
+ */
+
+gboolean
+ipset_node_cache_save_compressed(GOutputStream *stream,
+                                 ipset_node_cache_t *cache,
+                                 ipset_node_id_t node,
+                                 ipset_compression_t compression,
+                                 GError **err);
+
+
+/**
+ * Start saving a BDD to an output stream on a worker thread, with the
+ * given compression codec.  Nodes are never removed from a node
+ * cache, so the caller can keep adding nodes to the cache while the
+ * save is in progress.
+ */
+
+void
+ipset_node_cache_save_async(GOutputStream *stream,
+                            ipset_node_cache_t *cache,
+                            ipset_node_id_t node,
+                            ipset_compression_t compression,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data);
+
+
+/**
+ * Finish an asynchronous BDD save.
+ */
+
+gboolean
+ipset_node_cache_save_finish(GAsyncResult *result,
+                             GError **err);
+
+
+/**
+ * Save a BDD to an output stream, with the BDD's fingerprint stored in
+ * the file header.  The BDD itself is saved with the given
+ * compression codec.  The fingerprint is checked when the BDD is
+ * loaded with ipset_node_cache_load(), and can be read without
+ * loading the BDD using ipset_node_cache_read_fingerprint().
+ */
+
+gboolean
+ipset_node_cache_save_fingerprinted(GOutputStream *stream,
+                                    ipset_node_cache_t *cache,
+                                    ipset_node_id_t node,
+                                    ipset_compression_t compression,
+                                    GError **err);
+
+
+/**
+ * Read the fingerprint from the header of a BDD that was saved with
+ * ipset_node_cache_save_fingerprinted(), without loading the BDD
+ * itself.
+ */
+
+gboolean
+ipset_node_cache_read_fingerprint(GInputStream *stream,
+                                  guint64 *fingerprint,
+                                  GError **err);
+
+
+/**
+ * Save several named BDDs to an output stream as a single archive.
+ * The archive contains one copy of each node that's reachable from
+ * any of the roots, so subgraphs that are shared between the BDDs are
+ * only stored once.
+ */
+
+gboolean
+ipset_node_cache_save_archive(GOutputStream *stream,
+                              ipset_node_cache_t *cache,
+                              guint root_count,
+                              const gchar * const *names,
+                              const ipset_node_id_t *roots,
+                              GError **err);
+
+
+/**
+ * Load every BDD in an archive from an input stream.  The name of
+ * each BDD is appended to names (as a newly allocated string that the
+ * caller must free), and its root node is appended to roots.
+ */
+
+gboolean
+ipset_node_cache_load_archive(GInputStream *stream,
+                              ipset_node_cache_t *cache,
+                              GPtrArray *names,
+                              GArray *roots,
+                              GError **err);
+
+
+/**
+ * Load a single named BDD from an archive in an input stream.  Only
+ * the nodes that are reachable from that BDD's root are added to the
+ * node cache, and we stop reading the stream once we've found all of
+ * them.
+ */
+
+ipset_node_id_t
+ipset_node_cache_load_archive_entry(GInputStream *stream,
+                                    ipset_node_cache_t *cache,
+                                    const gchar *name,
+                                    GError **err);
+
+
+/**
+ * Save a patch that turns one BDD into another.  The patch only
+ * contains the nodes of the new BDD that don't appear in the base
+ * BDD; it refers to the base's nodes using the serialized IDs that
+ * they have in a saved copy of the base.  The base's fingerprint is
+ * stored in the patch's header, too.
+ */
+
+gboolean
+ipset_node_cache_save_patch(GOutputStream *stream,
+                            ipset_node_cache_t *cache,
+                            ipset_node_id_t base,
+                            ipset_node_id_t node,
+                            GError **err);
+
+
+/**
+ * Load a patch from an input stream, applying it to a base BDD that's
+ * already in memory.  Returns the root of the patched BDD.  The base
+ * must be the same BDD that the patch was created from; if its
+ * fingerprint doesn't match the one in the patch, we raise an
+ * IPSET_ERROR_PARSE_ERROR.
+ */
+
+ipset_node_id_t
+ipset_node_cache_load_patch(GInputStream *stream,
+                            ipset_node_cache_t *cache,
+                            ipset_node_id_t base,
+                            GError **err);
+
+
 /**
  * Save a GraphViz dot graph for a BDD.  The graph script is written
  * to the given output stream.  This graph only includes those nodes
@@ -464,6 +806,104 @@ ipset_node_cache_ite(ipset_node_cache_t *cache,
                      ipset_node_id_t g,
                      ipset_node_id_t h);
 
+/**
+ * A function that combines the values of two terminal nodes.
+ */
+
+typedef ipset_range_t
+(*ipset_operator_func_t)(ipset_range_t lhs_value,
+                         ipset_range_t rhs_value);
+
+/**
+ * A binary operator that can be applied to any two BDDs with
+ * ipset_node_cache_apply.  If the operator is commutative, reversed
+ * operands can share entries in the operator's computed table.
+ */
+
+typedef struct ipset_operator
+{
+    const gchar  *name;
+    ipset_operator_func_t  func;
+    gboolean  commutative;
+} ipset_operator_t;
+
+/**
+ * Apply a binary operator to two BDDs.  The result of the operator
+ * for each assignment is op->func applied to the values of lhs and rhs
+ * for that assignment.  Intermediate results are stored in a
+ * fixed-size computed table for the operator, which is allocated the
+ * first time the operator is used; the operator must stay valid for
+ * as long as the node cache does.
+ */
+
+ipset_node_id_t
+ipset_node_cache_apply(ipset_node_cache_t *cache,
+                       const ipset_operator_t *op,
+                       ipset_node_id_t lhs,
+                       ipset_node_id_t rhs);
+
+/**
+ * A function that computes a new value for a terminal node.
+ */
+
+typedef ipset_range_t
+(*ipset_transform_func_t)(ipset_range_t value,
+                          gpointer user_data);
+
+/**
+ * Replace every terminal in a BDD with func applied to its value,
+ * and reduce the result.  Each node of the BDD is visited once, and
+ * func is called once for each distinct terminal value; the results
+ * are memoized in a scratch table that's freed before this function
+ * returns.
+ */
+
+ipset_node_id_t
+ipset_node_cache_transform(ipset_node_cache_t *cache,
+                           ipset_node_id_t node,
+                           ipset_transform_func_t func,
+                           gpointer user_data);
+
+
+/*-----------------------------------------------------------------------
+ * Comparing BDDs
+ */
+
+/**
+ * The following functions compare two BDDs without constructing any
+ * new nodes.  They walk through both BDDs at the same time, using a
+ * scratch memo that's thrown away when they return, so they don't
+ * leave anything behind in the node cache.  An assignment is
+ * “nonzero” in a BDD if the BDD maps it to a nonzero value.
+ */
+
+/**
+ * Return whether every assignment that's nonzero in lhs is also
+ * nonzero in rhs.  Stops at the first assignment that isn't.
+ */
+
+gboolean
+ipset_node_implies(ipset_node_id_t lhs, ipset_node_id_t rhs);
+
+/**
+ * Return whether there are no assignments that are nonzero in both
+ * lhs and rhs.  Stops at the first assignment that is.
+ */
+
+gboolean
+ipset_node_disjoint(ipset_node_id_t lhs, ipset_node_id_t rhs);
+
+/**
+ * Count the assignments of variables var through end-1 that are
+ * nonzero in both lhs and rhs.  Counts use the same range as
+ * ipset_node_cache_count.
+ */
+
+void
+ipset_node_and_count(ipset_node_id_t lhs, ipset_node_id_t rhs,
+                     ipset_variable_t var, ipset_variable_t end,
+                     ipset_count_t *count);
+
 
 /*-----------------------------------------------------------------------
  * Evaluating BDDs
@@ -524,6 +964,23 @@ typedef enum ipset_tribool
 } ipset_tribool_t;
 
 
+/**
+ * The largest number of variables that an assignment can hold.  This
+ * is enough for the IP set and map BDDs, which use one variable for
+ * the kind of address and up to 128 for the address bits.
+ */
+
+#define IPSET_ASSIGNMENT_MAX_VARIABLES  (1 + 128)
+
+/**
+ * The number of 32-bit words that we need to hold a bit for each
+ * variable in an assignment.
+ */
+
+#define IPSET_ASSIGNMENT_WORDS \
+    ((IPSET_ASSIGNMENT_MAX_VARIABLES + 31) / 32)
+
+
 /**
  * An assignment is a mapping of variable numbers to Boolean values.
  * It represents an input to a Boolean function that maps to a
@@ -536,14 +993,17 @@ typedef enum ipset_tribool
 typedef struct ipset_assignment
 {
     /**
-     * The underlying variable assignments are stored in a vector of
-     * tribools.  Every variable that has a true or false value must
-     * appear in the vector.  Variables that are EITHER only have to
-     * appear to prevent gaps in the vector.  Any variables outside
-     * the range of the vector are assumed to be EITHER.
+     * The variable assignments are stored as a pair of bit vectors,
+     * with variable 0 in the most significant bit of the first word.
+     * A variable's bit in the cares vector is set if the variable is
+     * TRUE or FALSE, and clear if it's EITHER.  Its bit in the values
+     * vector is set if the variable is TRUE; it's always clear for an
+     * EITHER variable, so that equal assignments have identical bit
+     * vectors.
      */
 
-    GArray  *values;
+    guint32  values[IPSET_ASSIGNMENT_WORDS];
+    guint32  cares[IPSET_ASSIGNMENT_WORDS];
 } ipset_assignment_t;
 
 
@@ -600,7 +1060,8 @@ ipset_assignment_get(ipset_assignment_t *assignment,
 
 
 /**
- * Set the value assigned to a particular variable.
+ * Set the value assigned to a particular variable.  The variable must
+ * be less than IPSET_ASSIGNMENT_MAX_VARIABLES.
  */
 
 void
@@ -636,11 +1097,11 @@ typedef struct ipset_expanded_assignment
     GByteArray  *values;
 
     /**
-     * An array containing all of the variables that are EITHER in the
-     * original assignment.
+     * A bit vector, in the same layout as values, with a bit set for
+     * each variable that's EITHER in the original assignment.
      */
 
-    GArray  *eithers;
+    GByteArray  *eithers;
 
 } ipset_expanded_assignment_t;
 
@@ -40,4 +40,48 @@ ipset_node_id_t
 ipset_ipv6_make_ip_bdd(gpointer addr, guint netmask);
 
 
+/**
+ * Create a BDD for a range of IP addresses, from first to last
+ * inclusive.  Like the BDDs from ipset_ipvX_make_ip_bdd, its values
+ * are all 0 or 1.  The BDD has at most two nodes for each bit of the
+ * address.  If first is larger than last, the range is empty.
+ */
+
+ipset_node_id_t
+ipset_ipv4_make_range_bdd(gpointer first, gpointer last);
+
+ipset_node_id_t
+ipset_ipv6_make_range_bdd(gpointer first, gpointer last);
+
+
+/**
+ * Return the ipmap_combine operator with the given ID, or NULL if
+ * there isn't one.
+ */
+
+const ipset_operator_t *
+ipmap_operator(guint operator_id);
+
+
+/**
+ * Return the node of a set's BDD that the IPv4 (if is_ipv4 is TRUE)
+ * or IPv6 addresses start from.
+ */
+
+ipset_node_id_t
+ipset_family_root(ipset_node_id_t set_bdd, gboolean is_ipv4);
+
+
+/**
+ * Count the addresses below a node that's reached after depth bits
+ * of an IPv4 or IPv6 address.  The count only covers the bits that
+ * the address actually has, so it's exact for IPv4, and only
+ * saturates for the entire IPv6 address space.
+ */
+
+void
+ipset_family_count(ipset_node_id_t node_id, guint depth,
+                   gboolean is_ipv4, ipset_count_t *count);
+
+
 #endif  /* IPSET_INTERNAL_H */
@@ -89,6 +89,18 @@ ipset_ip_equal(const ipset_ip_t *addr1,
                const ipset_ip_t *addr2);
 
 
+/**
+ * The size of a buffer that can hold any IP address, or any IP
+ * network, formatted as a string, including the terminating NUL.
+ */
+
+#define IPSET_IP_STRING_LENGTH \
+    (sizeof "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255")
+
+#define IPSET_NETWORK_STRING_LENGTH \
+    (IPSET_IP_STRING_LENGTH + sizeof "/128" - 1)
+
+
 /**
  * Create an ipset_ip_t from a string.  We first attempt to parse the
  * string as an IPv4 address; if that fails, we try parsing it as
@@ -99,6 +111,30 @@ gboolean
 ipset_ip_from_string(ipset_ip_t *addr, const gchar *str);
 
 
+/**
+ * Create an ipset_ip_t from the first length characters of a string,
+ * which doesn't need to be NUL-terminated.  This accepts the same
+ * addresses as inet_pton, but doesn't call it.  Returns FALSE if the
+ * string isn't a valid IPv4 or IPv6 address.
+ */
+
+gboolean
+ipset_ip_parse(ipset_ip_t *addr, const gchar *str, gsize length);
+
+
+/**
+ * Like ipset_ip_parse, but also accepts an optional "/netmask" suffix.
+ * The netmask is stored in netmask; if there's no suffix, it will be
+ * 32 or 128, depending on the kind of address.  The netmask must be a
+ * decimal number without leading zeros.  If the string isn't valid,
+ * neither addr nor netmask is changed.
+ */
+
+gboolean
+ipset_ip_parse_network(ipset_ip_t *addr, guint *netmask,
+                       const gchar *str, gsize length);
+
+
 /**
  * Return a string containing a human-readable version of an
  * ipset_ip_t.  The string is not owned by the caller; it should not
@@ -111,4 +147,28 @@ const gchar *
 ipset_ip_to_string(const ipset_ip_t *addr);
 
 
+/**
+ * Write a human-readable version of an ipset_ip_t into a
+ * caller-provided buffer, which must be at least
+ * IPSET_IP_STRING_LENGTH bytes long.  Unlike ipset_ip_to_string, this
+ * is safe to call from multiple threads.  Returns the length of the
+ * string, not including the terminating NUL.
+ */
+
+gsize
+ipset_ip_format(const ipset_ip_t *addr, gchar *buf);
+
+
+/**
+ * Write a human-readable version of an IP network, in "addr/netmask"
+ * form, into a caller-provided buffer, which must be at least
+ * IPSET_NETWORK_STRING_LENGTH bytes long.  Returns the length of the
+ * string, not including the terminating NUL.
+ */
+
+gsize
+ipset_ip_format_network(const ipset_ip_t *addr, guint netmask,
+                        gchar *buf);
+
+
 #endif  /* IPSET_IP_H */
@@ -33,6 +33,21 @@ typedef struct ip_map
 } ip_map_t;
 
 
+/**
+ * A collection of named IP sets and maps that are saved and loaded
+ * together, sharing a single node table.  names holds the (owned)
+ * name of each entry, and roots holds the root BDD node of the entry
+ * with the same index.  Use the ipset_archive_* functions rather than
+ * touching the fields directly.
+ */
+
+typedef struct ipset_archive
+{
+    GPtrArray  *names;
+    GArray  *roots;
+} ipset_archive_t;
+
+
 /*---------------------------------------------------------------------
  * General functions
  */
@@ -103,6 +118,83 @@ ipset_is_equal(ip_set_t *set1, ip_set_t *set2);
 gboolean
 ipset_is_not_equal(ip_set_t *set1, ip_set_t *set2);
 
+/**
+ * Returns whether every address in set1 is also in set2.  Unlike
+ * comparing the sets' intersection with set1, this doesn't create any
+ * new BDD nodes, and stops as soon as it finds an address that's only
+ * in set1.
+ */
+
+gboolean
+ipset_is_subset(ip_set_t *set1, ip_set_t *set2);
+
+/**
+ * Returns whether two IP sets have no addresses in common.  Stops as
+ * soon as it finds an address that's in both sets, and doesn't create
+ * any new BDD nodes.
+ */
+
+gboolean
+ipset_is_disjoint(ip_set_t *set1, ip_set_t *set2);
+
+/**
+ * Stores in count the number of addresses that are in both IP sets,
+ * without creating any new BDD nodes.  The count saturates at
+ * 2^128-1, which can only happen if both sets contain nearly all of
+ * the IPv6 address space.
+ */
+
+void
+ipset_intersection_count(ip_set_t *set1, ip_set_t *set2,
+                         ipset_count_t *count);
+
+/**
+ * How much of a network is contained in an IP set.
+ */
+
+typedef enum ipset_network_relation
+{
+    IPSET_NETWORK_NONE = 0,
+    IPSET_NETWORK_SOME = 1,
+    IPSET_NETWORK_ALL = 2
+} ipset_network_relation_t;
+
+/**
+ * Returns whether none, some, or all of the addresses that start with
+ * the first netmask bits of addr are in an IP set.  A netmask of 0
+ * covers every address of the same kind as addr; a netmask longer
+ * than the address is treated as a single address.  This follows the
+ * netmask bits down the set's BDD and then looks at what's left, so
+ * it doesn't depend on the size of the network.
+ */
+
+ipset_network_relation_t
+ipset_network_relation(ip_set_t *set, ipset_ip_t *addr, guint netmask);
+
+/**
+ * Initializes dest with every network of a fixed size that contains
+ * at least one address of set.  IPv4 networks have ipv4_netmask bits,
+ * and IPv6 networks have ipv6_netmask bits.  For instance, with an
+ * ipv4_netmask of 24, dest contains every /24 that overlaps set.
+ * This quantifies away the address bits after the netmask in a single
+ * pass over the set's BDD, rather than looking at each address.  dest
+ * can be the same as set.
+ */
+
+void
+ipset_coarsen_any(ip_set_t *dest, ip_set_t *set,
+                  guint ipv4_netmask, guint ipv6_netmask);
+
+/**
+ * Initializes dest with every network of a fixed size that's entirely
+ * contained in set.  The netmasks work the same as in
+ * ipset_coarsen_any.
+ */
+
+void
+ipset_coarsen_all(ip_set_t *dest, ip_set_t *set,
+                  guint ipv4_netmask, guint ipv6_netmask);
+
 /**
  * Returns the number of bytes needed to store the IP set.  Note that
  * adding together the storage needed for each set you use doesn't
@@ -113,6 +205,57 @@ ipset_is_not_equal(ip_set_t *set1, ip_set_t *set2);
 gsize
 ipset_memory_size(ip_set_t *set);
 
+/**
+ * Returns a fingerprint of the contents of the IP set.  Unlike
+ * ipset_is_equal(), fingerprints can be compared between sets that
+ * were created in different processes.  Two sets with the same
+ * contents always have the same fingerprint; two sets with different
+ * contents have the same fingerprint only with negligible
+ * probability.
+ */
+
+guint64
+ipset_fingerprint(ip_set_t *set);
+
+
+/**
+ * Fill in out with count addresses chosen uniformly at random, with
+ * replacement, from an IP set, using rng as the source of randomness.
+ * Each sample walks down the set's BDD once, choosing each branch in
+ * proportion to the number of addresses below it.  The number of
+ * addresses below each node is cached, so the cost of each sample
+ * only depends on the length of the addresses, and not on the size of
+ * the set.  Returns FALSE, without filling in out, if the set is
+ * empty.
+ */
+
+gboolean
+ipset_sample(ip_set_t *set, GRand *rng, gsize count, ipset_ip_t *out);
+
+/**
+ * Find the k-th smallest address in an IP set, counting from 0, and
+ * store it in addr.  Addresses are ordered the same way that the set
+ * iterators visit them: every IPv4 address comes before every IPv6
+ * address.  Like ipset_sample, this walks down the BDD once using the
+ * cached node counts, so it doesn't depend on the size of the set.
+ * Returns FALSE if the set has k or fewer addresses.
+ */
+
+gboolean
+ipset_select(ip_set_t *set, const ipset_count_t *k, ipset_ip_t *addr);
+
+/**
+ * Store in rank the number of addresses in an IP set that are smaller
+ * than addr.  The address doesn't have to be in the set.  If it is,
+ * then ipset_select will return it for this rank.  A count that
+ * doesn't fit into 128 bits saturates; this can only happen for an
+ * IPv6 address, in a set that contains nearly all of the IPv6 address
+ * space.
+ */
+
+void
+ipset_rank(ip_set_t *set, ipset_ip_t *addr, ipset_count_t *rank);
+
 /**
  * Saves an IP set to disk.  Returns a boolean indicating whether the
  * operation was successful.
@@ -123,6 +266,44 @@ ipset_save(GOutputStream *stream,
            ip_set_t *set,
            GError **err);
 
+/**
+ * Saves an IP set to disk, compressing it with the given codec.
+ * Returns a boolean indicating whether the operation was successful.
+ * Compressed sets can be read back in with ipset_load().
+ */
+
+gboolean
+ipset_save_compressed(GOutputStream *stream,
+                      ip_set_t *set,
+                      ipset_compression_t compression,
+                      GError **err);
+
+/**
+ * Saves an IP set to disk, with the set's fingerprint stored in the
+ * file header.  The set itself is compressed with the given codec.
+ * Returns a boolean indicating whether the operation was successful.
+ * Fingerprinted sets can be read back in with ipset_load(), which
+ * verifies the fingerprint.
+ */
+
+gboolean
+ipset_save_fingerprinted(GOutputStream *stream,
+                         ip_set_t *set,
+                         ipset_compression_t compression,
+                         GError **err);
+
+/**
+ * Reads the fingerprint of a set or map that was saved with
+ * ipset_save_fingerprinted() or ipmap_save_fingerprinted(), without
+ * loading the rest of the stream.  Returns a boolean indicating
+ * whether the operation was successful.
+ */
+
+gboolean
+ipset_read_fingerprint(GInputStream *stream,
+                       guint64 *fingerprint,
+                       GError **err);
+
 /**
  * Saves a GraphViz dot graph for an IP set to disk.  Returns a
  * boolean indicating whether the operation was successful.
@@ -142,6 +323,91 @@ ip_set_t *
 ipset_load(GInputStream *stream,
            GError **err);
 
+/**
+ * Starts loading an IP set from a stream on a worker thread.  The
+ * callback is called on the thread-default main context of the
+ * calling thread once the set has been read in; it should call
+ * ipset_load_finish() to get the set.  The load can be cancelled
+ * with the (optional) cancellable object.
+ */
+
+void
+ipset_load_async(GInputStream *stream,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data);
+
+/**
+ * Finishes an asynchronous IP set load.  Returns NULL if the set
+ * cannot be loaded.  This copies the set's nodes into the global node
+ * cache on the calling thread, which takes time proportional to the
+ * size of the set's BDD.
+ */
+
+ip_set_t *
+ipset_load_finish(GAsyncResult *result,
+                  GError **err);
+
+/**
+ * Starts saving an IP set to a stream on a worker thread, compressing
+ * it with the given codec (as in ipset_save_compressed).  The
+ * callback should call ipset_save_finish() to find out whether the
+ * save was successful.  Later changes to the set don't affect the
+ * saved copy.
+ */
+
+void
+ipset_save_async(GOutputStream *stream,
+                 ip_set_t *set,
+                 ipset_compression_t compression,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data);
+
+/**
+ * Finishes an asynchronous IP set save.  Returns a boolean indicating
+ * whether the operation was successful.
+ */
+
+gboolean
+ipset_save_finish(GAsyncResult *result,
+                  GError **err);
+
+/**
+ * Saves a patch that turns one IP set into another.  The patch only
+ * contains the parts of new_set that don't appear in old_set.
+ * Returns a boolean indicating whether the operation was successful.
+ */
+
+gboolean
+ipset_diff_save(GOutputStream *stream,
+                ip_set_t *old_set,
+                ip_set_t *new_set,
+                GError **err);
+
+/**
+ * Loads a patch from a stream, and applies it to an IP set that's
+ * already in memory.  old_set must be the same set that the patch was
+ * created from; it isn't modified.  Returns a new IP set, or NULL if
+ * the patch cannot be loaded.
+ */
+
+ip_set_t *
+ipset_patch_load(GInputStream *stream,
+                 ip_set_t *old_set,
+                 GError **err);
+
+/**
+ * Loads a single named IP set from an archive.  Only the nodes that
+ * belong to that set are added to the node cache.  Returns NULL if
+ * the set cannot be loaded.
+ */
+
+ip_set_t *
+ipset_load_from_archive(GInputStream *stream,
+                        const gchar *name,
+                        GError **err);
+
 /**
  * Adds a single IPv4 address to an IP set.  We don't care what
  * specific type is used to represent the address; elem should be a
@@ -166,6 +432,20 @@ ipset_ipv4_add(ip_set_t *set, gpointer elem);
 gboolean
 ipset_ipv4_add_network(ip_set_t *set, gpointer elem, guint netmask);
 
+/**
+ * Adds a range of IPv4 addresses to an IP set, from first to last
+ * inclusive.  The addresses are stored the same way as for
+ * ipset_ipv4_add.  The range doesn't have to line up with any CIDR
+ * network; its BDD is built directly from the two endpoints, and
+ * added to the set with a single OR.  If first is larger than last,
+ * the range is empty.
+ *
+ * Returns whether the whole range was already in the set or not.
+ */
+
+gboolean
+ipset_ipv4_add_range(ip_set_t *set, gpointer first, gpointer last);
+
 /**
  * Adds a single IPv6 address to an IP set.  We don't care what
  * specific type is used to represent the address; elem should be a
@@ -190,6 +470,20 @@ ipset_ipv6_add(ip_set_t *set, gpointer elem);
 gboolean
 ipset_ipv6_add_network(ip_set_t *set, gpointer elem, guint netmask);
 
+/**
+ * Adds a range of IPv6 addresses to an IP set, from first to last
+ * inclusive.  The addresses are stored the same way as for
+ * ipset_ipv6_add.  The range doesn't have to line up with any CIDR
+ * network; its BDD is built directly from the two endpoints, and
+ * added to the set with a single OR.  If first is larger than last,
+ * the range is empty.
+ *
+ * Returns whether the whole range was already in the set or not.
+ */
+
+gboolean
+ipset_ipv6_add_range(ip_set_t *set, gpointer first, gpointer last);
+
 /**
  * Adds a single generic IP address to an IP set.
  *
@@ -210,23 +504,43 @@ ipset_ip_add(ip_set_t *set, ipset_ip_t *addr);
 gboolean
 ipset_ip_add_network(ip_set_t *set, ipset_ip_t *addr, guint netmask);
 
+/**
+ * Adds a range of generic IP addresses to an IP set, from first to
+ * last inclusive.  If first and last aren't the same kind of address,
+ * the range is empty.
+ *
+ * Returns whether the whole range was already in the set or not.
+ */
+
+gboolean
+ipset_ip_add_range(ip_set_t *set, ipset_ip_t *first, ipset_ip_t *last);
+
 
 /**
- * An internal state type used by the
- * ipset_iterator_t.multiple_expansion_state field.
+ * Which terminal values an iterator should return.
  */
 
-typedef enum ipset_iterator_state
+typedef enum ipset_iterator_match
 {
-    IPSET_ITERATOR_NORMAL = 0,
-    IPSET_ITERATOR_MULTIPLE_IPV4,
-    IPSET_ITERATOR_MULTIPLE_IPV6
-} ipset_iterator_state_t;
+    /** Only addresses whose value equals desired_value. */
+    IPSET_MATCH_EQUAL,
+    /** Only addresses whose value doesn't equal desired_value. */
+    IPSET_MATCH_NOT_EQUAL,
+    /** Every address, regardless of its value. */
+    IPSET_MATCH_ANY
+} ipset_iterator_match_t;
 
 
 /**
  * An iterator that returns all of the IP addresses that are (or are
- * not) in an IP set.
+ * not) in an IP set, or the IP addresses in an IP map along with
+ * their values.
+ *
+ * The iterator walks the paths of the BDD directly, one address bit
+ * at a time.  If a path skips over a variable, the iterator tries
+ * both values for that bit, so every result is a concrete network.
+ * Results are returned in ascending address order, with all of the
+ * IPv4 results before any of the IPv6 results.
  */
 
 typedef struct ipset_iterator
@@ -238,10 +552,16 @@ typedef struct ipset_iterator
     gboolean finished;
 
     /**
-     * The desired value for each IP address.
+     * The value that we compare each IP address's value against.
      */
 
-    gboolean  desired_value;
+    gint  desired_value;
+
+    /**
+     * How we compare each IP address's value against desired_value.
+     */
+
+    ipset_iterator_match_t  match;
 
     /**
      * Whether to summarize the contents of the IP set as networks,
@@ -251,34 +571,38 @@ typedef struct ipset_iterator
     gboolean  summarize;
 
     /**
-     * Whether the current assignment needs to be expanded a second
-     * time.
-     *
-     * We have to expand IPv4 and IPv6 assignments separately, since
-     * the set of variables to turn into address bits is different.
-     * Unfortunately, a BDD assignment can contain both IPv4 and IPv6
-     * addresses, if variable 0 is EITHER.  (This is trivially true
-     * for the empty set, for instance.)  In this case, we have to
-     * explicitly set variable 0 to TRUE, expand it as IPv4, and then
-     * set it to FALSE, and expand it as IPv6.  This variable tells us
-     * whether we're in an assignment that needs to be expanded twice,
-     * and if so, which expansion we're currently in.
+     * The root of the set's BDD.
+     */
+
+    ipset_node_id_t  root;
+
+    /**
+     * Whether the iterator is restricted to a single network (and
+     * therefore to a single kind of address).
+     */
+
+    gboolean  restricted;
+
+    /**
+     * The netmask of the network that the iterator is restricted to.
+     * We never backtrack above this depth.
      */
 
-    ipset_iterator_state_t  multiple_expansion_state;
+    guint  base_depth;
 
     /**
-     * An iterator for retrieving each assignment in the set's BDD.
+     * The BDD node that we branched from at each bit of the current
+     * address.  Only the first netmask entries are valid.
      */
 
-    ipset_bdd_iterator_t  *bdd_iterator;
+    ipset_node_id_t  path[IPV6_BIT_SIZE];
 
     /**
-     * An iterator for expanding each assignment into individual IP
-     * addresses.
+     * The bits of the current address, in host byte order.  Only the
+     * first netmask bits are valid.
      */
 
-    ipset_expanded_assignment_t  *assignment_iterator;
+    guint32  bits[4];
 
     /**
      * The address of the current IP network in the iterator.
@@ -293,6 +617,13 @@ typedef struct ipset_iterator
 
     guint  netmask;
 
+    /**
+     * The value of the current IP network in the iterator.  For an IP
+     * set, this is the same as desired_value.
+     */
+
+    gint  value;
+
 } ipset_iterator_t;
 
 
@@ -310,12 +641,59 @@ ipset_iterate(ip_set_t *set, gboolean desired_value);
  * Return an iterator that yields all of the IP networks that are (if
  * desired_value is TRUE) or are not (if desired_value is FALSE) in an
  * IP set.
+ *
+ * Each network is the largest aligned CIDR block that contains its
+ * addresses and lies entirely within (or outside of) the set.  Since
+ * the set's BDD is reduced, a block is only split when some address
+ * in it has a different value, so the result is the minimal list of
+ * non-overlapping networks that covers the set exactly.
  */
 
 ipset_iterator_t *
 ipset_iterate_networks(ip_set_t *set, gboolean desired_value);
 
 
+/**
+ * Return an iterator that starts at the given address, and yields
+ * everything after it.  If addr is an IPv4 address, the iterator
+ * continues on to the IPv6 addresses once it's finished with the
+ * IPv4 ones.  If summarize is TRUE, the iterator yields networks, and
+ * a network that starts before addr is trimmed so that the results
+ * start at addr.  The iterator seeks to addr directly, without
+ * visiting any of the results before it.
+ */
+
+ipset_iterator_t *
+ipset_iterate_from(ip_set_t *set, ipset_ip_t *addr,
+                   gboolean desired_value, gboolean summarize);
+
+
+/**
+ * Return an iterator that only yields the part of the IP set that
+ * falls within the network formed by the first netmask bits of addr.
+ * If summarize is TRUE, the iterator yields networks; a network that
+ * contains the entire range is trimmed to the range itself.
+ */
+
+ipset_iterator_t *
+ipset_iterate_within(ip_set_t *set, ipset_ip_t *addr, guint netmask,
+                     gboolean desired_value, gboolean summarize);
+
+
+/**
+ * Return an iterator that walks the paths of an arbitrary BDD, and
+ * yields each address (or network, if summarize is TRUE) whose value
+ * is accepted by match.  The IP set and IP map iterators are built on
+ * top of this.
+ */
+
+ipset_iterator_t *
+ipset_iterate_bdd(ipset_node_id_t root,
+                  ipset_iterator_match_t match,
+                  gint desired_value,
+                  gboolean summarize);
+
+
 /**
  * Free an IP set iterator.
  */
@@ -332,6 +710,56 @@ void
 ipset_iterator_advance(ipset_iterator_t *iterator);
 
 
+/**
+ * Copy up to count results from an IP set iterator into a
+ * caller-provided buffer, starting with the iterator's current
+ * result, and advance the iterator past them.  If netmasks isn't
+ * NULL, the netmask of each result is stored in the corresponding
+ * element.  Returns the number of results copied, which is only less
+ * than count if the iterator has finished.
+ */
+
+gsize
+ipset_iterator_next_batch(ipset_iterator_t *iterator,
+                          ipset_ip_t *addrs,
+                          guint *netmasks,
+                          gsize count);
+
+
+/**
+ * Pull the next contiguous range of addresses out of an iterator,
+ * merging together any consecutive results that don't leave a gap
+ * between them.  The first and last addresses of the range (both
+ * inclusive) are stored in first and last.  A range never spans both
+ * IPv4 and IPv6 addresses.  Returns FALSE, without touching first or
+ * last, if the iterator has already finished.
+ */
+
+gboolean
+ipset_iterator_next_range(ipset_iterator_t *iterator,
+                          ipset_ip_t *first,
+                          ipset_ip_t *last);
+
+
+/**
+ * Write out the contents of an IP set as text, one address per line,
+ * or one CIDR network per line if summarize is TRUE.  The output is
+ * the same as what the set iterator would produce.  The set's BDD is
+ * split into independent subtrees at a fixed prefix depth, and the
+ * subtrees are formatted by a pool of thread_count worker threads
+ * (or on the calling thread, if thread_count is 0 or 1).  The set
+ * must not be modified while the export is running.  Returns a
+ * boolean indicating whether the operation was successful.
+ */
+
+gboolean
+ipset_export(GOutputStream *stream,
+             ip_set_t *set,
+             gboolean summarize,
+             guint thread_count,
+             GError **err);
+
+
 /*---------------------------------------------------------------------
  * IP map functions
  */
@@ -372,6 +800,163 @@ ipmap_new(gint default_value);
 void
 ipmap_free(ip_map_t *map);
 
+/**
+ * One entry in the list of networks that ipmap_build_from_sorted turns
+ * into an IP map.
+ */
+
+typedef struct ipmap_entry
+{
+    ipset_ip_t  addr;
+    guint  netmask;
+    gint  value;
+} ipmap_entry_t;
+
+/**
+ * Creates a new IP map on the heap from a list of networks and their
+ * values.  The result is the same as creating a map with ipmap_new
+ * and calling ipmap_ip_set_network for each entry in turn: a network
+ * nested inside another one overrides the outer network's value.  But
+ * instead of an ITE for each entry, the map's BDD is built in a
+ * single bottom-up pass, and doesn't add anything to the ITE cache.
+ *
+ * The entries must be sorted the same way that the map iterators
+ * visit networks: IPv4 networks before IPv6 networks, ordered by
+ * network address, with a network coming before any networks nested
+ * inside of it.  Returns NULL if the entries aren't sorted, or if any
+ * entry's netmask is 0 or longer than its address.
+ */
+
+ip_map_t *
+ipmap_build_from_sorted(const ipmap_entry_t *entries, gsize count,
+                        gint default_value);
+
+/**
+ * The operators that ipmap_combine knows about by default.
+ * Additional operators can be added with ipmap_register_operator.
+ *
+ * IPMAP_OPERATOR_SUM: the sum of the two values, modulo 2^31 (the
+ * range of values that a map can hold).
+ *
+ * IPMAP_OPERATOR_MAX: the larger of the two values.
+ *
+ * IPMAP_OPERATOR_MIN: the smaller of the two values.
+ *
+ * IPMAP_OPERATOR_OVERLAY: the value from the first map, unless it's
+ * 0, in which case the value from the second map.
+ *
+ * IPMAP_OPERATOR_BIT_OR: the bitwise OR of the two values, for maps
+ * whose values are sets of flags.
+ *
+ * IPMAP_OPERATOR_BIT_AND: the bitwise AND of the two values.
+ */
+
+enum
+{
+    IPMAP_OPERATOR_SUM = 0,
+    IPMAP_OPERATOR_MAX,
+    IPMAP_OPERATOR_MIN,
+    IPMAP_OPERATOR_OVERLAY,
+    IPMAP_OPERATOR_BIT_OR,
+    IPMAP_OPERATOR_BIT_AND
+};
+
+/**
+ * Adds a new operator that can be used with ipmap_combine, and returns
+ * its ID.  func is applied to the values that the two maps assign to
+ * each address.  If commutative is TRUE, func must give the same
+ * result when its arguments are swapped.  The name is only used for
+ * debugging, and must stay valid for as long as the library is in
+ * use.
+ */
+
+guint
+ipmap_register_operator(const gchar *name,
+                        ipset_operator_func_t func,
+                        gboolean commutative);
+
+/**
+ * Combines two IP maps into dest, using the operator with the given
+ * ID.  The value of each address in dest will be the operator applied
+ * to its values in map1 and map2, and dest's default value is the
+ * operator applied to the two maps' defaults.  This is a single BDD
+ * operation, rather than inserting each network of one map into the
+ * other.  dest is initialized by this function, and can be the same
+ * as map1 or map2.
+ *
+ * Returns FALSE, without touching dest, if there's no operator with
+ * that ID.
+ */
+
+gboolean
+ipmap_combine(ip_map_t *dest, ip_map_t *map1, ip_map_t *map2,
+              guint operator_id);
+
+/**
+ * The largest number of sets that a classifier map can hold.  Each
+ * set needs its own bit in the map's values, and values can use 31
+ * bits.
+ */
+
+#define IPMAP_CLASSIFIER_MAX_SETS  31
+
+/**
+ * Initializes a classifier map from a list of IP sets.  The value of
+ * each address in the map is a bitmask, whose bit i is set if the
+ * address is in sets[i].  A single ipmap_ipv4_get (or the other
+ * lookup functions) then tells you every set that contains an
+ * address.  Each set's BDD is turned into a map whose only nonzero
+ * value is its bit, and these are combined with
+ * IPMAP_OPERATOR_BIT_OR.
+ *
+ * Returns FALSE, without touching map, if there are more than
+ * IPMAP_CLASSIFIER_MAX_SETS sets.
+ */
+
+gboolean
+ipmap_init_classifier(ip_map_t *map, ip_set_t **sets, guint count);
+
+/**
+ * Updates one set in a classifier map that was created by
+ * ipmap_init_classifier.  Bit index of each value is cleared, and
+ * then set again for the addresses in set.  The other sets' bits
+ * aren't affected, and don't have to be recomputed.
+ *
+ * Returns FALSE, without touching map, if index is out of range.
+ */
+
+gboolean
+ipmap_classifier_update(ip_map_t *map, guint index, ip_set_t *set);
+
+/**
+ * A function that decides whether the addresses with a particular
+ * value in an IP map should be included in a set.
+ */
+
+typedef gboolean
+(*ipmap_predicate_t)(gint value, gpointer user_data);
+
+/**
+ * Initializes an IP set with the addresses in a map whose values
+ * satisfy a predicate.  The predicate is called once for each
+ * distinct value in the map, and not once for each address, so this
+ * takes a single pass over the map's BDD.  The set's BDD shares nodes
+ * with the map's wherever it can.
+ */
+
+void
+ipmap_to_set(ip_set_t *set, ip_map_t *map,
+             ipmap_predicate_t predicate, gpointer user_data);
+
+/**
+ * Initializes an IP set with the addresses in a map whose values are
+ * between low and high, inclusive.
+ */
+
+void
+ipmap_value_in_range(ip_set_t *set, ip_map_t *map,
+                     gint low, gint high);
+
 /**
  * Returns whether the IP map is empty.  A map is considered empty if
  * every input is mapped to the default value.
@@ -404,6 +989,15 @@ ipmap_is_not_equal(ip_map_t *map1, ip_map_t *map2);
 gsize
 ipmap_memory_size(ip_map_t *map);
 
+/**
+ * Returns a fingerprint of the contents of the IP map.  Unlike
+ * ipmap_is_equal(), fingerprints can be compared between maps that
+ * were created in different processes.
+ */
+
+guint64
+ipmap_fingerprint(ip_map_t *map);
+
 /**
  * Saves an IP map to disk.  Returns a boolean indicating whether the
  * operation was successful.
@@ -414,6 +1008,31 @@ ipmap_save(GOutputStream *stream,
            ip_map_t *map,
            GError **err);
 
+/**
+ * Saves an IP map to disk, compressing it with the given codec.
+ * Returns a boolean indicating whether the operation was successful.
+ * Compressed maps can be read back in with ipmap_load().
+ */
+
+gboolean
+ipmap_save_compressed(GOutputStream *stream,
+                      ip_map_t *map,
+                      ipset_compression_t compression,
+                      GError **err);
+
+/**
+ * Saves an IP map to disk, with the map's fingerprint stored in the
+ * file header.  The map itself is compressed with the given codec.
+ * Returns a boolean indicating whether the operation was successful.
+ * The fingerprint can be read back in with ipset_read_fingerprint().
+ */
+
+gboolean
+ipmap_save_fingerprinted(GOutputStream *stream,
+                         ip_map_t *map,
+                         ipset_compression_t compression,
+                         GError **err);
+
 /**
  * Loads an IP map from disk.  Returns NULL if the map cannot be
  * loaded.
@@ -423,6 +1042,86 @@ ip_map_t *
 ipmap_load(GInputStream *stream,
            GError **err);
 
+/**
+ * Starts loading an IP map from a stream on a worker thread.  The
+ * callback should call ipmap_load_finish() to get the map.
+ */
+
+void
+ipmap_load_async(GInputStream *stream,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data);
+
+/**
+ * Finishes an asynchronous IP map load.  Returns NULL if the map
+ * cannot be loaded.  Like ipset_load_finish, this copies the map's
+ * nodes into the global node cache on the calling thread.
+ */
+
+ip_map_t *
+ipmap_load_finish(GAsyncResult *result,
+                  GError **err);
+
+/**
+ * Starts saving an IP map to a stream on a worker thread, compressing
+ * it with the given codec (as in ipmap_save_compressed).  The
+ * callback should call ipmap_save_finish() to find out whether the
+ * save was successful.
+ */
+
+void
+ipmap_save_async(GOutputStream *stream,
+                 ip_map_t *map,
+                 ipset_compression_t compression,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data);
+
+/**
+ * Finishes an asynchronous IP map save.  Returns a boolean indicating
+ * whether the operation was successful.
+ */
+
+gboolean
+ipmap_save_finish(GAsyncResult *result,
+                  GError **err);
+
+/**
+ * Saves a patch that turns one IP map into another.  The patch only
+ * contains the parts of new_map that don't appear in old_map.
+ * Returns a boolean indicating whether the operation was successful.
+ */
+
+gboolean
+ipmap_diff_save(GOutputStream *stream,
+                ip_map_t *old_map,
+                ip_map_t *new_map,
+                GError **err);
+
+/**
+ * Loads a patch from a stream, and applies it to an IP map that's
+ * already in memory.  old_map must be the same map that the patch was
+ * created from; it isn't modified.  Returns a new IP map, or NULL if
+ * the patch cannot be loaded.
+ */
+
+ip_map_t *
+ipmap_patch_load(GInputStream *stream,
+                 ip_map_t *old_map,
+                 GError **err);
+
+/**
+ * Loads a single named IP map from an archive.  Only the nodes that
+ * belong to that map are added to the node cache.  Returns NULL if
+ * the map cannot be loaded.
+ */
+
+ip_map_t *
+ipmap_load_from_archive(GInputStream *stream,
+                        const gchar *name,
+                        GError **err);
+
 /**
  * Adds a single IPv4 address to an IP map, with the given value.  We
  * don't care what specific type is used to represent the address;
@@ -448,6 +1147,38 @@ ipmap_ipv4_set_network(ip_map_t *map,
                        guint netmask,
                        gint value);
 
+/**
+ * Adds a range of IPv4 addresses to an IP map, from first to last
+ * inclusive, with each address in the range mapping to the given
+ * value.  Like ipset_ipv4_add_range, this uses a single ITE with a BDD
+ * built directly from the two endpoints.
+ */
+
+void
+ipmap_ipv4_set_range(ip_map_t *map,
+                     gpointer first,
+                     gpointer last,
+                     gint value);
+
+/**
+ * Adds delta to the value of every IPv4 address in a network.  All
+ * of the addresses that start with the first netmask bits of elem are
+ * updated, whatever values they had before.  This is a single pass
+ * down the map's BDD, instead of an ipmap_ipv4_get followed by an
+ * ipmap_ipv4_set.  If netmask is out of range, the map isn't changed.
+ *
+ * Map values are between 0 and 2^31-1, and the addition is done
+ * modulo 2^31.  A negative delta decrements the values, but a value
+ * that would drop below 0 wraps around to the top of the range (so
+ * subtracting 1 from 0 gives 2^31-1).
+ */
+
+void
+ipmap_ipv4_add_value(ip_map_t *map,
+                    gpointer elem,
+                    guint netmask,
+                    gint delta);
+
 /**
  * Returns the value that an IPv4 address is mapped to in the map.  We
  * don't care what specific type is used to represent the address;
@@ -458,6 +1189,19 @@ ipmap_ipv4_set_network(ip_map_t *map,
 gint
 ipmap_ipv4_get(ip_map_t *map, gpointer elem);
 
+/**
+ * Returns the value that an IPv4 address is mapped to in the map,
+ * and stores into netmask the length of the largest aligned network
+ * around the address whose addresses all map to that same value.
+ * The map doesn't remember the networks that were originally added to
+ * it, so this might be shorter than the network that the address was
+ * added with, if its neighbors have the same value.  This takes a
+ * single pass down the map's BDD, just like ipmap_ipv4_get.
+ */
+
+gint
+ipmap_ipv4_lookup_prefix(ip_map_t *map, gpointer elem, guint *netmask);
+
 /**
  * Adds a single IPv6 address to an IP map, with the given value.  We
  * don't care what specific type is used to represent the address;
@@ -483,6 +1227,38 @@ ipmap_ipv6_set_network(ip_map_t *map,
                        guint netmask,
                        gint value);
 
+/**
+ * Adds a range of IPv6 addresses to an IP map, from first to last
+ * inclusive, with each address in the range mapping to the given
+ * value.  Like ipset_ipv6_add_range, this uses a single ITE with a BDD
+ * built directly from the two endpoints.
+ */
+
+void
+ipmap_ipv6_set_range(ip_map_t *map,
+                     gpointer first,
+                     gpointer last,
+                     gint value);
+
+/**
+ * Adds delta to the value of every IPv6 address in a network.  All
+ * of the addresses that start with the first netmask bits of elem are
+ * updated, whatever values they had before.  This is a single pass
+ * down the map's BDD, instead of an ipmap_ipv6_get followed by an
+ * ipmap_ipv6_set.  If netmask is out of range, the map isn't changed.
+ *
+ * Map values are between 0 and 2^31-1, and the addition is done
+ * modulo 2^31.  A negative delta decrements the values, but a value
+ * that would drop below 0 wraps around to the top of the range (so
+ * subtracting 1 from 0 gives 2^31-1).
+ */
+
+void
+ipmap_ipv6_add_value(ip_map_t *map,
+                    gpointer elem,
+                    guint netmask,
+                    gint delta);
+
 /**
  * Returns the value that an IPv6 address is mapped to in the map.  We
  * don't care what specific type is used to represent the address;
@@ -493,6 +1269,19 @@ ipmap_ipv6_set_network(ip_map_t *map,
 gint
 ipmap_ipv6_get(ip_map_t *map, gpointer elem);
 
+/**
+ * Returns the value that an IPv6 address is mapped to in the map,
+ * and stores into netmask the length of the largest aligned network
+ * around the address whose addresses all map to that same value.
+ * The map doesn't remember the networks that were originally added to
+ * it, so this might be shorter than the network that the address was
+ * added with, if its neighbors have the same value.  This takes a
+ * single pass down the map's BDD, just like ipmap_ipv6_get.
+ */
+
+gint
+ipmap_ipv6_lookup_prefix(ip_map_t *map, gpointer elem, guint *netmask);
+
 /**
  * Adds a single generic IP address to an IP map, with the given
  * value.
@@ -514,6 +1303,46 @@ ipmap_ip_set_network(ip_map_t *map,
                      guint netmask,
                      gint value);
 
+/**
+ * Adds a range of generic IP addresses to an IP map, from first to
+ * last inclusive, with each address in the range mapping to the given
+ * value.  If first and last aren't the same kind of address, the map
+ * isn't changed.
+ */
+
+void
+ipmap_ip_set_range(ip_map_t *map,
+                   ipset_ip_t *first,
+                   ipset_ip_t *last,
+                   gint value);
+
+/**
+ * Adds delta to the value of every generic IP address in a network.
+ * Like ipmap_ipv4_add_value, the addition is done modulo 2^31.
+ */
+
+void
+ipmap_ip_add_value(ip_map_t *map,
+                   ipset_ip_t *addr,
+                   guint netmask,
+                   gint delta);
+
+/**
+ * Adds deltas[i] to the value of addrs[i], for each of the count
+ * addresses.  An address can appear more than once, in which case
+ * all of its deltas are added.  The addresses are sorted and turned
+ * into a map of deltas, which is then added to the map with a single
+ * ipmap_combine, so this is much faster than calling
+ * ipmap_ip_add_value for each address.  As with ipmap_ip_add_value,
+ * the additions are done modulo 2^31.
+ */
+
+void
+ipmap_ip_add_values(ip_map_t *map,
+                    const ipset_ip_t *addrs,
+                    const gint *deltas,
+                    gsize count);
+
 /**
  * Returns the value that a generic IP address is mapped to in the
  * map.
@@ -522,5 +1351,112 @@ ipmap_ip_set_network(ip_map_t *map,
 gint
 ipmap_ip_get(ip_map_t *map, ipset_ip_t *addr);
 
+/**
+ * Returns the value that a generic IP address is mapped to in the
+ * map, and the length of the largest aligned network around it that
+ * maps to the same value.
+ */
+
+gint
+ipmap_ip_lookup_prefix(ip_map_t *map, ipset_ip_t *addr, guint *netmask);
+
+
+/**
+ * Return an iterator that yields all of the IP networks in an IP map,
+ * along with the value that each one is mapped to.  Each network is
+ * as large as possible.  Addresses that map to the default value are
+ * included.
+ */
+
+ipset_iterator_t *
+ipmap_iterate_networks(ip_map_t *map);
+
+/**
+ * Return an iterator that yields the IP networks in an IP map, along
+ * with their values, but skips any addresses that map to the map's
+ * default value.
+ */
+
+ipset_iterator_t *
+ipmap_iterate_non_default_networks(ip_map_t *map);
+
+
+/*---------------------------------------------------------------------
+ * Archive functions
+ */
+
+/**
+ * Creates a new empty archive on the heap.  An archive holds any
+ * number of named IP sets and maps, which are saved together with a
+ * single node table, so that any structure they share is only stored
+ * once.
+ */
+
+ipset_archive_t *
+ipset_archive_new();
+
+/**
+ * Frees an archive.  This doesn't free any of the sets or maps that
+ * were added to it.
+ */
+
+void
+ipset_archive_free(ipset_archive_t *archive);
+
+/**
+ * Adds an IP set to an archive, with the given name.
+ */
+
+void
+ipset_archive_add_set(ipset_archive_t *archive,
+                      const gchar *name,
+                      ip_set_t *set);
+
+/**
+ * Adds an IP map to an archive, with the given name.
+ */
+
+void
+ipset_archive_add_map(ipset_archive_t *archive,
+                      const gchar *name,
+                      ip_map_t *map);
+
+/**
+ * Returns a new heap-allocated copy of the named IP set in an
+ * archive.  Returns NULL if there's no entry with that name.
+ */
+
+ip_set_t *
+ipset_archive_get_set(ipset_archive_t *archive,
+                      const gchar *name);
+
+/**
+ * Returns a new heap-allocated copy of the named IP map in an
+ * archive.  Returns NULL if there's no entry with that name.
+ */
+
+ip_map_t *
+ipset_archive_get_map(ipset_archive_t *archive,
+                      const gchar *name);
+
+/**
+ * Saves an archive to disk.  Returns a boolean indicating whether the
+ * operation was successful.
+ */
+
+gboolean
+ipset_archive_save(GOutputStream *stream,
+                   ipset_archive_t *archive,
+                   GError **err);
+
+/**
+ * Loads every set and map in an archive from a stream, in a single
+ * pass.  Returns NULL if the archive cannot be loaded.
+ */
+
+ipset_archive_t *
+ipset_archive_load(GInputStream *stream,
+                   GError **err);
+
 
 #endif  /* IPSET_IPSET_H */
@@ -9,7 +9,6 @@
  */
 
 
-#include <arpa/inet.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,12 +23,15 @@
 
 
 static gchar  *output_filename = NULL;
+static gboolean  want_compression = FALSE;
 
 
 static GOptionEntry entries[] =
 {
     { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_filename,
       "output file (\"-\" for stdout)", "FILE" },
+    { "compress", 'z', 0, G_OPTION_ARG_NONE, &want_compression,
+      "compress the output file", NULL },
     { NULL }
 };
 
@@ -148,34 +150,16 @@ main(int argc, char **argv)
                 (distream, &line_length, NULL, &error))
                != NULL)
         {
-            /*
-             * Reserve enough space for an IPv6 address.
-             */
-
-            guint32  addr[4];
-            int  rc;
-
-            /*
-             * Try to parse the line as an IPv4 address.  If that
-             * works, add it to the set.
-             */
-
-            rc = inet_pton(AF_INET, line, addr);
-            if (rc == 1)
-            {
-                ipset_ipv4_add(&set, addr);
-                g_free(line);
-                continue;
-            }
+            ipset_ip_t  addr;
 
             /*
-             * If that didn't work, try IPv6.
+             * Try to parse the line as an IPv4 or IPv6 address.  If
+             * that works, add it to the set.
              */
 
-            rc = inet_pton(AF_INET6, line, addr);
-            if (rc == 1)
+            if (ipset_ip_parse(&addr, line, line_length))
             {
-                ipset_ipv6_add(&set, addr);
+                ipset_ip_add(&set, &addr);
                 g_free(line);
                 continue;
             }
@@ -243,7 +227,10 @@ main(int argc, char **argv)
         }
     }
 
-    if (!ipset_save(ostream, &set, &error))
+    ipset_compression_t  compression =
+        want_compression? IPSET_COMPRESSION_ZLIB: IPSET_COMPRESSION_NONE;
+
+    if (!ipset_save_compressed(ostream, &set, compression, &error))
     {
         fprintf(stderr, "Error saving IP set:\n  %s\n",
                 error->message);
@@ -23,9 +23,18 @@
 #include <ipset/ipset.h>
 
 
+/**
+ * The number of addresses that we pull out of the iterator at a time.
+ */
+
+#define BATCH_SIZE  256
+
+
 static gchar  *input_filename = "-";
 static gchar  *output_filename = "-";
 static gboolean  want_networks = FALSE;
+static gboolean  want_ranges = FALSE;
+static gint  thread_count = 1;
 
 
 static GOptionEntry entries[] =
@@ -39,6 +48,12 @@ static GOptionEntry entries[] =
     { "networks", 'n', 0,
       G_OPTION_ARG_NONE, &want_networks,
       "print out CIDR network blocks", NULL },
+    { "ranges", 'r', 0,
+      G_OPTION_ARG_NONE, &want_ranges,
+      "print out ranges of consecutive addresses", NULL },
+    { "threads", 't', 0,
+      G_OPTION_ARG_INT, &thread_count,
+      "format the output using N threads", "N" },
     { NULL }
 };
 
@@ -54,6 +69,28 @@ ignore_log_message(const gchar *log_domain, GLogLevelFlags log_level,
 }
 
 
+/**
+ * Write out the contents of a buffer, and then clear it.  Exits if we
+ * can't write to the file.
+ */
+
+static void
+flush_output(GDataOutputStream *dstream, GString *str)
+{
+    GError  *error = NULL;
+
+    if (!g_data_output_stream_put_string
+        (dstream, str->str, NULL, &error))
+    {
+        fprintf(stderr, "Cannot write to file %s:\n  %s\n",
+                output_filename, error->message);
+        exit(1);
+    }
+
+    g_string_truncate(str, 0);
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -164,60 +201,102 @@ main(int argc, char **argv)
         }
     }
 
+    /*
+     * If the user asked for more than one thread, let the library
+     * split up the work.  Ranges have to be merged together in order,
+     * so they're always printed on this thread.
+     */
+
+    if ((thread_count > 1) && !want_ranges)
+    {
+        if (!ipset_export(ostream, set, want_networks,
+                          thread_count, &error))
+        {
+            fprintf(stderr, "Cannot write to file %s:\n  %s\n",
+                    output_filename, error->message);
+            exit(1);
+        }
+
+        ipset_free(set);
+        g_object_unref(ostream);
+        return 0;
+    }
+
     GDataOutputStream  *dstream =
         g_data_output_stream_new(ostream);
 
     GString *str = g_string_new(NULL);
 
-    if (want_networks)
+    /*
+     * Pull addresses out of the iterator in batches, and write out
+     * each batch with a single call.  If requested, iterate through
+     * network blocks instead of individual IP addresses.  (If not,
+     * the user wants individual IP addresses.  Hope they know what
+     * they're doing!)
+     */
+
+    ipset_ip_t  addrs[BATCH_SIZE];
+    guint  netmasks[BATCH_SIZE];
+    gsize  count;
+
+    ipset_iterator_t  *it = (want_networks || want_ranges)?
+        ipset_iterate_networks(set, TRUE):
+        ipset_iterate(set, TRUE);
+
+    if (want_ranges)
     {
         /*
-         * If requested, iterate through network blocks instead of
-         * individual IP addresses.
+         * Ranges are built by merging together consecutive networks.
          */
 
-        ipset_iterator_t  *it;
-        for (it = ipset_iterate_networks(set, TRUE);
-             !it->finished;
-             ipset_iterator_advance(it))
+        ipset_ip_t  first;
+        ipset_ip_t  last;
+        gchar  buf[IPSET_IP_STRING_LENGTH];
+
+        count = 0;
+
+        while (ipset_iterator_next_range(it, &first, &last))
         {
-            g_string_printf(str, "%s/%u\n",
-                            ipset_ip_to_string(&it->addr),
-                            it->netmask);
+            g_string_append_len(str, buf, ipset_ip_format(&first, buf));
+            g_string_append_c(str, '-');
+            g_string_append_len(str, buf, ipset_ip_format(&last, buf));
+            g_string_append_c(str, '\n');
 
-            if (!g_data_output_stream_put_string
-                (dstream, str->str, NULL, &error))
+            if (++count == BATCH_SIZE)
             {
-                fprintf(stderr, "Cannot write to file %s:\n  %s\n",
-                        output_filename, error->message);
-                exit(1);
+                flush_output(dstream, str);
+                count = 0;
             }
         }
 
-    } else {
-        /*
-         * The user wants individual IP addresses.  Hope they know
-         * what they're doing!
-         */
+        flush_output(dstream, str);
+    }
+
+    /*
+     * If we printed out ranges, the iterator is already finished, and
+     * this loop won't do anything.
+     */
 
-        ipset_iterator_t  *it;
-        for (it = ipset_iterate(set, TRUE);
-             !it->finished;
-             ipset_iterator_advance(it))
+    while ((count = ipset_iterator_next_batch
+            (it, addrs, netmasks, BATCH_SIZE)) > 0)
+    {
+        gchar  buf[IPSET_NETWORK_STRING_LENGTH];
+        gsize  i;
+
+        for (i = 0; i < count; i++)
         {
-            g_string_printf(str, "%s\n",
-                            ipset_ip_to_string(&it->addr));
+            gsize  length = want_networks?
+                ipset_ip_format_network(&addrs[i], netmasks[i], buf):
+                ipset_ip_format(&addrs[i], buf);
 
-            if (!g_data_output_stream_put_string
-                (dstream, str->str, NULL, &error))
-            {
-                fprintf(stderr, "Cannot write to file %s:\n  %s\n",
-                        output_filename, error->message);
-                exit(1);
-            }
+            g_string_append_len(str, buf, length);
+            g_string_append_c(str, '\n');
         }
+
+        flush_output(dstream, str);
     }
 
+    ipset_iterator_free(it);
     g_string_free(str, TRUE);
     ipset_free(set);
 
@@ -0,0 +1,176 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+
+
+ipset_archive_t *
+ipset_archive_new()
+{
+    ipset_archive_t  *result = g_slice_new(ipset_archive_t);
+    if (result == NULL)
+        return NULL;
+
+    result->names = g_ptr_array_new();
+    result->roots = g_array_new(FALSE, FALSE, sizeof(ipset_node_id_t));
+    return result;
+}
+
+
+void
+ipset_archive_free(ipset_archive_t *archive)
+{
+    guint  i;
+
+    for (i = 0; i < archive->names->len; i++)
+    {
+        g_free(g_ptr_array_index(archive->names, i));
+    }
+
+    g_ptr_array_free(archive->names, TRUE);
+    g_array_free(archive->roots, TRUE);
+    g_slice_free(ipset_archive_t, archive);
+}
+
+
+static void
+archive_add(ipset_archive_t *archive,
+            const gchar *name,
+            ipset_node_id_t root)
+{
+    g_ptr_array_add(archive->names, g_strdup(name));
+    g_array_append_val(archive->roots, root);
+}
+
+
+void
+ipset_archive_add_set(ipset_archive_t *archive,
+                      const gchar *name,
+                      ip_set_t *set)
+{
+    archive_add(archive, name, set->set_bdd);
+}
+
+
+void
+ipset_archive_add_map(ipset_archive_t *archive,
+                      const gchar *name,
+                      ip_map_t *map)
+{
+    archive_add(archive, name, map->map_bdd);
+}
+
+
+/**
+ * Finds the root of the named entry in an archive.  Returns FALSE if
+ * there's no entry with that name.
+ */
+
+static gboolean
+archive_find(ipset_archive_t *archive,
+             const gchar *name,
+             ipset_node_id_t *root)
+{
+    guint  i;
+
+    for (i = 0; i < archive->names->len; i++)
+    {
+        if (strcmp(g_ptr_array_index(archive->names, i), name) == 0)
+        {
+            *root = g_array_index(archive->roots, ipset_node_id_t, i);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+ip_set_t *
+ipset_archive_get_set(ipset_archive_t *archive,
+                      const gchar *name)
+{
+    ipset_node_id_t  root;
+
+    if (!archive_find(archive, name, &root))
+        return NULL;
+
+    ip_set_t  *set = ipset_new();
+    if (set == NULL) return NULL;
+
+    set->set_bdd = root;
+    return set;
+}
+
+
+ip_map_t *
+ipset_archive_get_map(ipset_archive_t *archive,
+                      const gchar *name)
+{
+    ipset_node_id_t  root;
+
+    if (!archive_find(archive, name, &root))
+        return NULL;
+
+    /*
+     * Like in ipmap_load(), it doesn't matter what default value we
+     * use here.
+     */
+
+    ip_map_t  *map = ipmap_new(0);
+    if (map == NULL) return NULL;
+
+    map->map_bdd = root;
+    return map;
+}
+
+
+gboolean
+ipset_archive_save(GOutputStream *stream,
+                   ipset_archive_t *archive,
+                   GError **err)
+{
+    return ipset_node_cache_save_archive
+        (stream, ipset_cache,
+         archive->roots->len,
+         (const gchar * const *) archive->names->pdata,
+         (const ipset_node_id_t *) archive->roots->data,
+         err);
+}
+
+
+ipset_archive_t *
+ipset_archive_load(GInputStream *stream,
+                   GError **err)
+{
+    ipset_archive_t  *archive = ipset_archive_new();
+    if (archive == NULL) return NULL;
+
+    GError  *suberror = NULL;
+
+    ipset_node_cache_load_archive
+        (stream, ipset_cache,
+         archive->names, archive->roots, &suberror);
+    if (suberror != NULL)
+    {
+        g_propagate_error(err, suberror);
+        ipset_archive_free(archive);
+        return NULL;
+    }
+
+    return archive;
+}
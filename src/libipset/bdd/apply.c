@@ -0,0 +1,153 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/logging.h>
+
+
+/**
+ * The number of entries in each operator's computed table.  Must be a
+ * power of 2.
+ */
+
+#define APPLY_TABLE_SIZE  (1 << 16)
+
+
+/**
+ * One entry in a computed table.  An empty entry has a NULL lhs, which
+ * can't be a valid node ID.
+ */
+
+typedef struct apply_entry
+{
+    ipset_node_id_t  lhs;
+    ipset_node_id_t  rhs;
+    ipset_node_id_t  result;
+} apply_entry_t;
+
+
+static apply_entry_t *
+get_table(ipset_node_cache_t *cache, const ipset_operator_t *op)
+{
+    apply_entry_t  *table =
+        g_hash_table_lookup(cache->apply_tables, op);
+
+    if (table == NULL)
+    {
+        g_d_debug("Creating computed table for %s", op->name);
+        table = g_new0(apply_entry_t, APPLY_TABLE_SIZE);
+        g_hash_table_insert(cache->apply_tables, (gpointer) op, table);
+    }
+
+    return table;
+}
+
+
+static ipset_node_id_t
+apply(ipset_node_cache_t *cache,
+      const ipset_operator_t *op,
+      apply_entry_t *table,
+      ipset_node_id_t lhs,
+      ipset_node_id_t rhs)
+{
+    if ((ipset_node_get_type(lhs) == IPSET_TERMINAL_NODE) &&
+        (ipset_node_get_type(rhs) == IPSET_TERMINAL_NODE))
+    {
+        ipset_range_t  new_value =
+            op->func(ipset_terminal_value(lhs), ipset_terminal_value(rhs));
+        return ipset_node_cache_terminal(cache, new_value);
+    }
+
+    /*
+     * Check the computed table.  Each pair of operands can only live
+     * in one slot, so a miss might just mean that the result has been
+     * overwritten.
+     */
+
+    ipset_binary_key_t  key;
+
+    if (op->commutative)
+    {
+        ipset_binary_key_commutative(&key, lhs, rhs);
+    } else {
+        key.lhs = lhs;
+        key.rhs = rhs;
+    }
+
+    apply_entry_t  *entry =
+        &table[ipset_binary_key_hash(&key) & (APPLY_TABLE_SIZE - 1)];
+
+    if ((entry->lhs == key.lhs) && (entry->rhs == key.rhs))
+        return entry->result;
+
+    /*
+     * Recurse down the nonterminal with the smaller variable, or both
+     * if they have the same variable.
+     */
+
+    ipset_variable_t  var;
+    ipset_node_id_t  lhs_low = lhs, lhs_high = lhs;
+    ipset_node_id_t  rhs_low = rhs, rhs_high = rhs;
+
+    if (ipset_node_get_type(lhs) == IPSET_TERMINAL_NODE)
+    {
+        var = ipset_nonterminal_node(rhs)->variable;
+    } else if (ipset_node_get_type(rhs) == IPSET_TERMINAL_NODE) {
+        var = ipset_nonterminal_node(lhs)->variable;
+    } else {
+        var = MIN(ipset_nonterminal_node(lhs)->variable,
+                  ipset_nonterminal_node(rhs)->variable);
+    }
+
+    if ((ipset_node_get_type(lhs) == IPSET_NONTERMINAL_NODE) &&
+        (ipset_nonterminal_node(lhs)->variable == var))
+    {
+        lhs_low = ipset_nonterminal_node(lhs)->low;
+        lhs_high = ipset_nonterminal_node(lhs)->high;
+    }
+
+    if ((ipset_node_get_type(rhs) == IPSET_NONTERMINAL_NODE) &&
+        (ipset_nonterminal_node(rhs)->variable == var))
+    {
+        rhs_low = ipset_nonterminal_node(rhs)->low;
+        rhs_high = ipset_nonterminal_node(rhs)->high;
+    }
+
+    ipset_node_id_t  result_low =
+        apply(cache, op, table, lhs_low, rhs_low);
+    ipset_node_id_t  result_high =
+        apply(cache, op, table, lhs_high, rhs_high);
+    ipset_node_id_t  result =
+        ipset_node_cache_nonterminal(cache, var, result_low, result_high);
+
+    /*
+     * The recursive calls might have overwritten this entry, but
+     * that's fine; the most recent result wins.
+     */
+
+    entry->lhs = key.lhs;
+    entry->rhs = key.rhs;
+    entry->result = result;
+
+    return result;
+}
+
+
+ipset_node_id_t
+ipset_node_cache_apply(ipset_node_cache_t *cache,
+                       const ipset_operator_t *op,
+                       ipset_node_id_t lhs,
+                       ipset_node_id_t rhs)
+{
+    g_d_debug("Applying %s(%p, %p)", op->name, lhs, rhs);
+    return apply(cache, op, get_table(cache, op), lhs, rhs);
+}
@@ -8,20 +8,29 @@
  * ----------------------------------------------------------------------
  */
 
+#include <string.h>
+
 #include <glib.h>
 
 #include <ipset/bdd/nodes.h>
 #include <ipset/logging.h>
 
 
+/**
+ * Find the word and bit mask for a particular variable.
+ */
+
+#define VAR_WORD(var)  ((var) / 32)
+#define VAR_MASK(var)  (((guint32) 0x80000000) >> ((var) % 32))
+
+
 ipset_assignment_t *
 ipset_assignment_new()
 {
     ipset_assignment_t  *assignment;
 
     assignment = g_slice_new(ipset_assignment_t);
-    assignment->values =
-        g_array_new(FALSE, FALSE, sizeof(ipset_tribool_t));
+    ipset_assignment_clear(assignment);
 
     return assignment;
 }
@@ -30,7 +39,6 @@ ipset_assignment_new()
 void
 ipset_assignment_free(ipset_assignment_t *assignment)
 {
-    g_array_free(assignment->values, TRUE);
     g_slice_free(ipset_assignment_t, assignment);
 }
 
@@ -49,69 +57,42 @@ ipset_assignment_equal(const ipset_assignment_t *assignment1,
     }
 
     /*
-     * Otherwise we compare the assignments piecewise up through the
-     * end of the smaller vector.
+     * Otherwise, since EITHER variables always have a clear value
+     * bit, we can compare the bit vectors directly.
      */
 
-    guint  size1 = assignment1->values->len;
-    guint  size2 = assignment2->values->len;
-    guint  smaller_size = (size1 < size2)? size1: size2;
+    return
+        (memcmp(assignment1->cares, assignment2->cares,
+                sizeof(assignment1->cares)) == 0) &&
+        (memcmp(assignment1->values, assignment2->values,
+                sizeof(assignment1->values)) == 0);
+}
 
-    guint  i;
-    for (i = 0; i < smaller_size; i++)
-    {
-        if (g_array_index(assignment1->values, ipset_tribool_t, i) !=
-            g_array_index(assignment2->values, ipset_tribool_t, i))
-        {
-            return FALSE;
-        }
-    }
 
-    /*
-     * If one of the assignment vectors is longer, any remaining
-     * elements must be indeterminate.
-     */
-
-    if (size1 > smaller_size)
-    {
-        for (i = smaller_size; i < size1; i++)
-        {
-            if (g_array_index(assignment1->values,
-                              ipset_tribool_t, i) != IPSET_EITHER)
-            {
-                return FALSE;
-            }
-        }
-    }
+void
+ipset_assignment_cut(ipset_assignment_t *assignment,
+                     ipset_variable_t var)
+{
+    guint  word;
 
-    if (size2 > smaller_size)
+    if (var >= IPSET_ASSIGNMENT_MAX_VARIABLES)
     {
-        for (i = smaller_size; i < size2; i++)
-        {
-            if (g_array_index(assignment2->values,
-                              ipset_tribool_t, i) != IPSET_EITHER)
-            {
-                return FALSE;
-            }
-        }
+        return;
     }
 
     /*
-     * If we make it through all of that, the two assignments are
-     * equal.
+     * Clear out the bits for var and everything after it in var's
+     * word, and then clear out all of the later words.
      */
 
-    return TRUE;
-}
-
+    word = VAR_WORD(var);
+    assignment->cares[word] &= ~(VAR_MASK(var) | (VAR_MASK(var) - 1));
+    assignment->values[word] &= assignment->cares[word];
 
-void
-ipset_assignment_cut(ipset_assignment_t *assignment,
-                     ipset_variable_t var)
-{
-    if (var < assignment->values->len)
+    for (word++; word < IPSET_ASSIGNMENT_WORDS; word++)
     {
-        g_array_set_size(assignment->values, var);
+        assignment->cares[word] = 0;
+        assignment->values[word] = 0;
     }
 }
 
@@ -119,7 +100,8 @@ ipset_assignment_cut(ipset_assignment_t *assignment,
 void
 ipset_assignment_clear(ipset_assignment_t *assignment)
 {
-    ipset_assignment_cut(assignment, 0);
+    memset(assignment->values, 0, sizeof(assignment->values));
+    memset(assignment->cares, 0, sizeof(assignment->cares));
 }
 
 
@@ -127,24 +109,19 @@ ipset_tribool_t
 ipset_assignment_get(ipset_assignment_t *assignment,
                      ipset_variable_t var)
 {
-    if (var < assignment->values->len)
-    {
-        /*
-         * If the requested variable is in the range of the values
-         * array, return whatever is stored there.
-         */
-
-        return g_array_index
-            (assignment->values, ipset_tribool_t, var);
-
-    } else {
-        /*
-         * Variables htat aren't in the values array are always
-         * EITHER.
-         */
+    /*
+     * Variables that don't fit into the bit vectors are always
+     * EITHER.
+     */
 
+    if ((var >= IPSET_ASSIGNMENT_MAX_VARIABLES) ||
+        !(assignment->cares[VAR_WORD(var)] & VAR_MASK(var)))
+    {
         return IPSET_EITHER;
     }
+
+    return (assignment->values[VAR_WORD(var)] & VAR_MASK(var))?
+        IPSET_TRUE: IPSET_FALSE;
 }
 
 
@@ -153,39 +130,27 @@ ipset_assignment_set(ipset_assignment_t *assignment,
                      ipset_variable_t var,
                      ipset_tribool_t value)
 {
-    /*
-     * Ensure that the vector is big enough to hold this variable
-     * assignment, inserting new EITHERs if needed.
-     */
+    g_return_if_fail(var < IPSET_ASSIGNMENT_MAX_VARIABLES);
+
+    guint32  *cares = &assignment->cares[VAR_WORD(var)];
+    guint32  *values = &assignment->values[VAR_WORD(var)];
+    guint32  mask = VAR_MASK(var);
 
-    if (var >= assignment->values->len)
+    switch (value)
     {
-        guint  old_len = assignment->values->len;
-
-        /*
-         * Expand the array.
-         */
-
-        g_array_set_size(assignment->values, var + 1);
-
-        /*
-         * Fill in EITHERs in the newly allocated elements.
-         */
-
-        if (var != old_len)
-        {
-            guint  i;
-            for (i = old_len; i < var; i++)
-            {
-                g_array_index(assignment->values, ipset_tribool_t, i) =
-                    IPSET_EITHER;
-            }
-        }
+      case IPSET_FALSE:
+        *cares |= mask;
+        *values &= ~mask;
+        break;
+
+      case IPSET_TRUE:
+        *cares |= mask;
+        *values |= mask;
+        break;
+
+      default:
+        *cares &= ~mask;
+        *values &= ~mask;
+        break;
     }
-
-    /*
-     * Assign the desired value.
-     */
-
-    g_array_index(assignment->values, ipset_tribool_t, var) = value;
 }
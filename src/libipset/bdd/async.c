@@ -0,0 +1,197 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/logging.h>
+
+
+/*-----------------------------------------------------------------------
+ * Loading
+ */
+
+/**
+ * The result of a load that's been performed on a worker thread.  The
+ * BDD lives in a private node cache until the load is finished.
+ */
+
+typedef struct load_result
+{
+    ipset_node_cache_t  *cache;
+    ipset_node_id_t  root;
+} load_result_t;
+
+
+static void
+load_result_free(load_result_t *loaded)
+{
+    ipset_node_cache_free(loaded->cache);
+    g_slice_free(load_result_t, loaded);
+}
+
+
+static void
+load_thread(GTask *task,
+            gpointer source_object,
+            gpointer task_data,
+            GCancellable *cancellable)
+{
+    GInputStream  *stream = G_INPUT_STREAM(source_object);
+    GError  *error = NULL;
+
+    load_result_t  *loaded = g_slice_new(load_result_t);
+    loaded->cache = ipset_node_cache_new();
+
+    g_debug("Loading BDD on worker thread");
+
+    loaded->root = ipset_node_cache_load_cancellable
+        (stream, loaded->cache, cancellable, &error);
+
+    if (error != NULL)
+    {
+        load_result_free(loaded);
+        g_task_return_error(task, error);
+        return;
+    }
+
+    g_task_return_pointer(task, loaded,
+                          (GDestroyNotify) load_result_free);
+}
+
+
+void
+ipset_node_cache_load_async(GInputStream *stream,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+    GTask  *task = g_task_new(stream, cancellable, callback, user_data);
+    g_task_run_in_thread(task, load_thread);
+    g_object_unref(task);
+}
+
+
+ipset_node_id_t
+ipset_node_cache_load_finish(ipset_node_cache_t *cache,
+                             GAsyncResult *result,
+                             GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+    load_result_t  *loaded =
+        g_task_propagate_pointer(G_TASK(result), err);
+
+    if (loaded == NULL)
+        return NULL;
+
+    /*
+     * Publish the BDD by copying it from the worker's private node
+     * cache into the caller's.
+     */
+
+    g_debug("Importing BDD from worker thread");
+
+    ipset_node_id_t  root =
+        ipset_node_cache_import(cache, loaded->root);
+
+    load_result_free(loaded);
+    return root;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Saving
+ */
+
+/**
+ * The parameters of a save that's being performed on a worker thread.
+ */
+
+typedef struct save_request
+{
+    ipset_node_cache_t  *cache;
+    ipset_node_id_t  root;
+    ipset_compression_t  compression;
+} save_request_t;
+
+
+static void
+save_request_free(save_request_t *request)
+{
+    g_slice_free(save_request_t, request);
+}
+
+
+static void
+save_thread(GTask *task,
+            gpointer source_object,
+            gpointer task_data,
+            GCancellable *cancellable)
+{
+    GOutputStream  *stream = G_OUTPUT_STREAM(source_object);
+    save_request_t  *request = task_data;
+    GError  *error = NULL;
+
+    if (g_task_return_error_if_cancelled(task))
+        return;
+
+    /*
+     * Saving only reads the nodes of the BDD, which never change once
+     * they've been created, so it's safe to do this while the owner
+     * of the node cache keeps working.
+     */
+
+    g_debug("Saving BDD on worker thread");
+
+    ipset_node_cache_save_compressed
+        (stream, request->cache, request->root,
+         request->compression, &error);
+
+    if (error != NULL)
+    {
+        g_task_return_error(task, error);
+        return;
+    }
+
+    g_task_return_boolean(task, TRUE);
+}
+
+
+void
+ipset_node_cache_save_async(GOutputStream *stream,
+                            ipset_node_cache_t *cache,
+                            ipset_node_id_t node,
+                            ipset_compression_t compression,
+                            GCancellable *cancellable,
+                            GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+    save_request_t  *request = g_slice_new(save_request_t);
+    request->cache = cache;
+    request->root = node;
+    request->compression = compression;
+
+    GTask  *task = g_task_new(stream, cancellable, callback, user_data);
+    g_task_set_task_data(task, request,
+                         (GDestroyNotify) save_request_free);
+    g_task_run_in_thread(task, save_thread);
+    g_object_unref(task);
+}
+
+
+gboolean
+ipset_node_cache_save_finish(GAsyncResult *result,
+                             GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+    return g_task_propagate_boolean(G_TASK(result), err);
+}
@@ -102,6 +102,28 @@ ipset_node_equal(const ipset_node_t *node1,
 }
 
 
+/**
+ * Free a nonterminal node that was allocated by a node cache.
+ */
+
+static void
+free_node(ipset_node_t *node)
+{
+    g_slice_free(ipset_node_t, node);
+}
+
+
+/**
+ * Free a key of the count cache.
+ */
+
+static void
+free_binary_key(gpointer key)
+{
+    g_slice_free(ipset_binary_key_t, key);
+}
+
+
 ipset_node_cache_t *
 ipset_node_cache_new()
 {
@@ -109,8 +131,10 @@ ipset_node_cache_new()
 
     cache = g_slice_new(ipset_node_cache_t);
     cache->node_cache =
-        g_hash_table_new((GHashFunc) ipset_node_hash,
-                         (GEqualFunc) ipset_node_equal);
+        g_hash_table_new_full((GHashFunc) ipset_node_hash,
+                              (GEqualFunc) ipset_node_equal,
+                              (GDestroyNotify) free_node,
+                              NULL);
 
     cache->and_cache =
         g_hash_table_new((GHashFunc) ipset_binary_key_hash,
@@ -124,6 +148,17 @@ ipset_node_cache_new()
         g_hash_table_new((GHashFunc) ipset_trinary_key_hash,
                          (GEqualFunc) ipset_trinary_key_equal);
 
+    cache->fingerprint_cache =
+        g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+    cache->count_cache =
+        g_hash_table_new_full((GHashFunc) ipset_binary_key_hash,
+                              (GEqualFunc) ipset_binary_key_equal,
+                              free_binary_key, g_free);
+
+    cache->apply_tables =
+        g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
     return cache;
 }
 
@@ -135,6 +170,9 @@ ipset_node_cache_free(ipset_node_cache_t *cache)
     g_hash_table_destroy(cache->and_cache);
     g_hash_table_destroy(cache->or_cache);
     g_hash_table_destroy(cache->ite_cache);
+    g_hash_table_destroy(cache->fingerprint_cache);
+    g_hash_table_destroy(cache->count_cache);
+    g_hash_table_destroy(cache->apply_tables);
     g_slice_free(ipset_node_cache_t, cache);
 }
 
@@ -294,3 +332,51 @@ ipset_node_evaluate(ipset_node_id_t node_id,
 
     return ipset_terminal_value(curr_node_id);
 }
+
+
+/**
+ * A helper function for ipset_node_cache_import().  The copies hash
+ * table maps each nonterminal in the source BDD to its copy.
+ */
+
+static ipset_node_id_t
+import_node(ipset_node_cache_t *cache,
+            GHashTable *copies,
+            ipset_node_id_t node_id)
+{
+    if (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE)
+    {
+        /*
+         * Terminal IDs don't depend on the node cache.
+         */
+
+        return node_id;
+    }
+
+    ipset_node_id_t  result = g_hash_table_lookup(copies, node_id);
+
+    if (result == NULL)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(node_id);
+
+        ipset_node_id_t  low = import_node(cache, copies, node->low);
+        ipset_node_id_t  high = import_node(cache, copies, node->high);
+
+        result = ipset_node_cache_nonterminal
+            (cache, node->variable, low, high);
+        g_hash_table_insert(copies, node_id, result);
+    }
+
+    return result;
+}
+
+
+ipset_node_id_t
+ipset_node_cache_import(ipset_node_cache_t *cache,
+                        ipset_node_id_t node)
+{
+    GHashTable  *copies = g_hash_table_new(NULL, NULL);
+    ipset_node_id_t  result = import_node(cache, copies, node);
+    g_hash_table_destroy(copies);
+    return result;
+}
@@ -0,0 +1,253 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/logging.h>
+
+
+#define MAX_UINT64  G_GUINT64_CONSTANT(0xffffffffffffffff)
+
+
+/*-----------------------------------------------------------------------
+ * 128-bit arithmetic
+ */
+
+static void
+saturate(ipset_count_t *result)
+{
+    result->high = MAX_UINT64;
+    result->low = MAX_UINT64;
+}
+
+
+void
+ipset_count_add(ipset_count_t *result,
+                const ipset_count_t *a,
+                const ipset_count_t *b)
+{
+    guint64  low = a->low + b->low;
+    guint64  carry = (low < a->low);
+    guint64  high = a->high + b->high;
+
+    if ((high < a->high) || (high + carry < high))
+    {
+        saturate(result);
+        return;
+    }
+
+    result->high = high + carry;
+    result->low = low;
+}
+
+
+void
+ipset_count_sub(ipset_count_t *result,
+                const ipset_count_t *a,
+                const ipset_count_t *b)
+{
+    guint64  borrow = (a->low < b->low);
+
+    result->low = a->low - b->low;
+    result->high = a->high - b->high - borrow;
+}
+
+
+void
+ipset_count_shift(ipset_count_t *result,
+                  const ipset_count_t *a,
+                  gint shift)
+{
+    guint64  high = a->high;
+    guint64  low = a->low;
+
+    if (shift > 0)
+    {
+        /*
+         * Make sure that we aren't going to shift any 1 bits off of
+         * the top.
+         */
+
+        if (shift >= 128)
+        {
+            if ((high | low) != 0)
+                saturate(result);
+            else
+                result->high = result->low = 0;
+            return;
+        }
+
+        gboolean  overflow;
+
+        if (shift < 64)
+            overflow = ((high >> (64 - shift)) != 0);
+        else if (shift == 64)
+            overflow = (high != 0);
+        else
+            overflow = (high != 0) || ((low >> (128 - shift)) != 0);
+
+        if (overflow)
+        {
+            saturate(result);
+            return;
+        }
+
+        if (shift >= 64)
+        {
+            result->high = low << (shift - 64);
+            result->low = 0;
+        } else {
+            result->high = (high << shift) | (low >> (64 - shift));
+            result->low = low << shift;
+        }
+    } else if (shift < 0) {
+        shift = -shift;
+
+        if (shift >= 128)
+        {
+            result->high = result->low = 0;
+        } else if (shift >= 64) {
+            result->low = high >> (shift - 64);
+            result->high = 0;
+        } else {
+            result->low = (low >> shift) | (high << (64 - shift));
+            result->high = high >> shift;
+        }
+    } else {
+        *result = *a;
+    }
+}
+
+
+gint
+ipset_count_compare(const ipset_count_t *a, const ipset_count_t *b)
+{
+    if (a->high != b->high)
+        return (a->high < b->high)? -1: 1;
+
+    if (a->low != b->low)
+        return (a->low < b->low)? -1: 1;
+
+    return 0;
+}
+
+
+static guint64
+random_uint64(GRand *rng)
+{
+    guint64  high = g_rand_int(rng);
+    return (high << 32) | g_rand_int(rng);
+}
+
+
+void
+ipset_count_random(ipset_count_t *result,
+                   GRand *rng,
+                   const ipset_count_t *bound)
+{
+    /*
+     * Draw values with the same number of bits as the bound until we
+     * get one that's less than it.  Each draw succeeds at least half
+     * the time.
+     */
+
+    guint64  high_mask = MAX_UINT64;
+    guint64  low_mask = MAX_UINT64;
+
+    if (bound->high != 0)
+    {
+        while ((high_mask >> 1) >= bound->high)
+            high_mask >>= 1;
+    } else {
+        high_mask = 0;
+
+        while ((low_mask >> 1) >= bound->low)
+            low_mask >>= 1;
+    }
+
+    do
+    {
+        result->high = random_uint64(rng) & high_mask;
+        result->low = random_uint64(rng) & low_mask;
+    } while (ipset_count_compare(result, bound) >= 0);
+}
+
+
+/*-----------------------------------------------------------------------
+ * Counting assignments
+ */
+
+void
+ipset_node_cache_count(ipset_node_cache_t *cache,
+                       ipset_node_id_t node_id,
+                       ipset_variable_t var,
+                       ipset_variable_t end,
+                       ipset_count_t *count)
+{
+    if (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE)
+    {
+        /*
+         * Every assignment of the remaining variables leads to this
+         * terminal.
+         */
+
+        ipset_count_t  one = { 0, 1 };
+
+        if (ipset_terminal_value(node_id) == 0)
+        {
+            count->high = count->low = 0;
+        } else {
+            ipset_count_shift(count, &one, end - var);
+        }
+
+        return;
+    }
+
+    /*
+     * Check whether we've already counted this nonterminal for this
+     * range of variables.  The cached count is relative to the node's
+     * own variable.
+     */
+
+    ipset_node_t  *node = ipset_nonterminal_node(node_id);
+    ipset_binary_key_t  key = { node_id, GUINT_TO_POINTER(end) };
+    ipset_count_t  *cached =
+        g_hash_table_lookup(cache->count_cache, &key);
+
+    if (cached == NULL)
+    {
+        ipset_count_t  low_count;
+        ipset_count_t  high_count;
+
+        ipset_node_cache_count(cache, node->low,
+                               node->variable + 1, end, &low_count);
+        ipset_node_cache_count(cache, node->high,
+                               node->variable + 1, end, &high_count);
+
+        cached = g_new(ipset_count_t, 1);
+        ipset_count_add(cached, &low_count, &high_count);
+
+        g_d_debug("Count of node %p is %016" G_GINT64_MODIFIER "x"
+                  "%016" G_GINT64_MODIFIER "x",
+                  node_id, cached->high, cached->low);
+
+        ipset_binary_key_t  *real_key = g_slice_new(ipset_binary_key_t);
+        *real_key = key;
+        g_hash_table_insert(cache->count_cache, real_key, cached);
+    }
+
+    /*
+     * Any variables between var and the node's variable are skipped
+     * by the BDD, and can take either value.
+     */
+
+    ipset_count_shift(count, cached, node->variable - var);
+}
@@ -21,55 +21,42 @@ initialize(ipset_expanded_assignment_t *exp,
            const ipset_assignment_t *assignment,
            ipset_variable_t var_count)
 {
+    guint  i;
+
     /*
-     * First loop through all of the variables in the assignment
-     * vector, making sure not to go further than the caller
-     * requested.
+     * Copy the assignment's bit vectors into the byte arrays one byte
+     * at a time.  Any variable that isn't TRUE or FALSE in the
+     * assignment (including any that are past the end of its bit
+     * vectors) is EITHER.  We make sure not to go further than the
+     * caller requested, so that any padding bits in the last byte are
+     * always clear.
      */
 
-    ipset_variable_t  last_assignment = assignment->values->len;
-    if (var_count < last_assignment)
-        last_assignment = var_count;
-
-    ipset_variable_t  var;
-    for (var = 0; var < last_assignment; var++)
+    for (i = 0; i < exp->values->len; i++)
     {
-        ipset_tribool_t  curr_value =
-            g_array_index(assignment->values, ipset_tribool_t, var);
+        guint  word = i / 4;
+        guint  shift = 24 - 8 * (i % 4);
+        guint8  value_byte = 0;
+        guint8  care_byte = 0;
+        guint8  valid_mask = 0xff;
 
-        if (curr_value == IPSET_EITHER)
+        if (word < IPSET_ASSIGNMENT_WORDS)
         {
-            /*
-             * If this variable is EITHER, start it off as FALSE, and
-             * add it to the eithers list.
-             */
-
-            g_d_debug("Variable %u is EITHER", var);
-
-            IPSET_BIT_SET(exp->values->data, var, FALSE);
-            g_array_append_val(exp->eithers, var);
-        } else {
-            /*
-             * Otherwise set the variable to the same value in the
-             * expanded assignment as it is in the non-expanded one.
-             */
-
-            g_d_debug("Variable %u is %s", var,
-                      curr_value? "TRUE": "FALSE");
+            value_byte = assignment->values[word] >> shift;
+            care_byte = assignment->cares[word] >> shift;
+        }
 
-            IPSET_BIT_SET(exp->values->data, var, curr_value);
+        if (8 * (i + 1) > var_count)
+        {
+            valid_mask = 0xff << (8 * (i + 1) - var_count);
         }
-    }
 
-    /*
-     * If the caller requested more variables than there are in the
-     * assignment vector, add them to the eithers list.
-     */
+        exp->values->data[i] = value_byte & valid_mask;
+        exp->eithers->data[i] = ~care_byte & valid_mask;
 
-    for (var = last_assignment; var < var_count; var++)
-    {
-        g_d_debug("Variable %u is implicitly EITHER", var);
-        g_array_append_val(exp->eithers, var);
+        g_d_debug("Variables %u-%u have values 0x%02x, EITHERs 0x%02x",
+                  8 * i, 8 * i + 7,
+                  exp->values->data[i], exp->eithers->data[i]);
     }
 }
 
@@ -91,9 +78,9 @@ ipset_assignment_expand(const ipset_assignment_t *assignment,
     exp = g_slice_new(ipset_expanded_assignment_t);
     exp->finished = FALSE;
     exp->values = g_byte_array_sized_new(values_size);
-    memset(exp->values->data, 0, values_size);
-    exp->eithers =
-        g_array_new(FALSE, FALSE, sizeof(ipset_variable_t));
+    g_byte_array_set_size(exp->values, values_size);
+    exp->eithers = g_byte_array_sized_new(values_size);
+    g_byte_array_set_size(exp->eithers, values_size);
 
     /*
      * Then initialize the values and eithers fields.
@@ -112,7 +99,7 @@ ipset_expanded_assignment_free(ipset_expanded_assignment_t *exp)
         return;
 
     g_byte_array_free(exp->values, TRUE);
-    g_array_free(exp->eithers, TRUE);
+    g_byte_array_free(exp->eithers, TRUE);
     g_slice_free(ipset_expanded_assignment_t, exp);
 }
 
@@ -130,48 +117,39 @@ ipset_expanded_assignment_advance(ipset_expanded_assignment_t *exp)
     g_d_debug("Advancing iterator");
 
     /*
-     * Look at the last EITHER bit in the assignment.  If it's 0, then
-     * set it to 1 and return.  Otherwise we set it to 0 and carry up
-     * to the previous indeterminate bit.
+     * Treat the EITHER bits as a single binary number, with the last
+     * EITHER variable as its least significant bit, and add 1 to it.
+     * Within each byte, we set all of the non-EITHER bits before
+     * adding, so that any carry skips right over them.  We then put
+     * the non-EITHER bits back the way they were.
      */
 
+    guint  carry = 1;
     guint  i;
-    for (i = exp->eithers->len; i > 0; i--)
+
+    for (i = exp->values->len; (i > 0) && (carry != 0); i--)
     {
-        guint  idx = i - 1;
-        ipset_variable_t  either_var =
-            g_array_index(exp->eithers, ipset_variable_t, idx);
+        guint8  eithers = exp->eithers->data[i-1];
+        guint8  value = exp->values->data[i-1];
+        guint  sum;
 
-        g_d_debug("Checking EITHER variable %u", either_var);
+        if (eithers == 0)
+            continue;
 
-        if (IPSET_BIT_GET(exp->values->data, either_var))
-        {
-            /*
-             * This variable is currently TRUE, so set it back to
-             * FALSE and carry.
-             */
-
-            g_d_debug("  Variable %u is TRUE, changing to FALSE"
-                      " and carrying",
-                      either_var);
-            IPSET_BIT_SET(exp->values->data, either_var, FALSE);
-        } else {
-            /*
-             * This variable is currently FALSE, so set it to TRUE and
-             * return.
-             */
-
-            g_d_debug("  Variable %u is FALSE, changing to TRUE",
-                      either_var);
-            IPSET_BIT_SET(exp->values->data, either_var, TRUE);
-            return;
-        }
+        sum = (guint) (value | (guint8) ~eithers) + carry;
+        carry = sum >> 8;
+
+        exp->values->data[i-1] =
+            (value & ~eithers) | ((guint8) sum & eithers);
     }
 
     /*
-     * If we fall through then we've made it through all of the
-     * expanded assignments.
+     * If there's still a carry, then we wrapped around, and we've
+     * made it through all of the expanded assignments.
      */
 
-    exp->finished = TRUE;
+    if (carry != 0)
+    {
+        exp->finished = TRUE;
+    }
 }
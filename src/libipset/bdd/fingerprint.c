@@ -0,0 +1,92 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/logging.h>
+
+
+/**
+ * Seeds that distinguish terminal and nonterminal fingerprints, so
+ * that a terminal can't collide with a nonterminal that happens to
+ * contain the same numbers.
+ */
+
+#define TERMINAL_SEED     G_GUINT64_CONSTANT(0x5bd1e9955bd1e995)
+#define NONTERMINAL_SEED  G_GUINT64_CONSTANT(0x27d4eb2f165667c5)
+
+
+/**
+ * Scramble the bits of a 64-bit value.  This is the finalizer from
+ * MurmurHash3, which only uses fixed-width integer arithmetic, so the
+ * result is the same on every platform.
+ */
+
+static guint64
+mix64(guint64 value)
+{
+    value ^= value >> 33;
+    value *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+    value ^= value >> 33;
+    value *= G_GUINT64_CONSTANT(0xc4ceb9fe1a85ec53);
+    value ^= value >> 33;
+    return value;
+}
+
+
+guint64
+ipset_node_cache_fingerprint(ipset_node_cache_t *cache,
+                             ipset_node_id_t node_id)
+{
+    if (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE)
+    {
+        /*
+         * Terminals are cheap to fingerprint, so we don't bother
+         * caching them.
+         */
+
+        guint32  value = ipset_terminal_value(node_id);
+        return mix64(TERMINAL_SEED ^ value);
+    }
+
+    /*
+     * Check whether we've already fingerprinted this nonterminal.
+     */
+
+    guint64  *cached =
+        g_hash_table_lookup(cache->fingerprint_cache, node_id);
+
+    if (cached != NULL)
+        return *cached;
+
+    /*
+     * If not, combine the node's variable with the fingerprints of
+     * its children.  Each step feeds the previous result back through
+     * the mixer, so swapping the children changes the fingerprint.
+     */
+
+    ipset_node_t  *node = ipset_nonterminal_node(node_id);
+
+    guint64  result = mix64(NONTERMINAL_SEED ^ node->variable);
+    result = mix64(result ^
+                   ipset_node_cache_fingerprint(cache, node->low));
+    result = mix64(result ^
+                   ipset_node_cache_fingerprint(cache, node->high));
+
+    g_d_debug("Fingerprint of node %p is %016" G_GINT64_MODIFIER "x",
+              node_id, result);
+
+    cached = g_new(guint64, 1);
+    *cached = result;
+    g_hash_table_insert(cache->fingerprint_cache, node_id, cached);
+
+    return result;
+}
@@ -13,6 +13,7 @@
 #include <glib.h>
 #include <gio/gio.h>
 
+#include <ipset/bdd/internal.h>
 #include <ipset/bdd/nodes.h>
 #include <ipset/logging.h>
 
@@ -45,17 +46,6 @@ static const gsize  MAGIC_NUMBER_LENGTH = 6;
     } G_STMT_END
 
 
-/**
- * On disk, we use a different node ID scheme than we do in memory.
- * Terminal node IDs are non-negative, and are equal to the terminal
- * value.  Nonterminal node IDs are negative, starting with -1.
- * Nonterminal -1 appears first on disk, then nonterminal -2, and so
- * on.
- */
-
-typedef gint  serialized_id_t;
-
-
 /**
  * A helper function that verifies that we've read exactly as many
  * bytes as we should, returning an error otherwise.
@@ -99,6 +89,7 @@ verify_cap(gsize bytes_read, gsize cap, GError **err)
 static ipset_node_id_t
 load_v1(GDataInputStream *dstream,
         ipset_node_cache_t *cache,
+        GCancellable *cancellable,
         GError **err)
 {
     ipset_node_id_t  result;
@@ -115,7 +106,7 @@ load_v1(GDataInputStream *dstream,
     g_debug("Reading encoded length");
     TRY_OR_RETURN(0,
                   length = g_data_input_stream_read_uint64,
-                  dstream, NULL);
+                  dstream, cancellable);
 
     /*
      * The length includes the magic number, version number, and the
@@ -139,7 +130,7 @@ load_v1(GDataInputStream *dstream,
     g_debug("Reading number of nonterminals");
     TRY_OR_RETURN(0,
                   nonterminal_count = g_data_input_stream_read_uint32,
-                  dstream, NULL);
+                  dstream, cancellable);
     bytes_read += sizeof(guint32);
 
     /*
@@ -153,7 +144,7 @@ load_v1(GDataInputStream *dstream,
         g_debug("Reading single terminal value");
         TRY_OR_RETURN(0,
                       value = g_data_input_stream_read_uint32,
-                      dstream, NULL);
+                      dstream, cancellable);
         bytes_read += sizeof(guint32);
 
         /*
@@ -193,19 +184,19 @@ load_v1(GDataInputStream *dstream,
         guint8  variable;
         TRY_OR_RETURN(0,
                       variable = g_data_input_stream_read_byte,
-                      dstream, NULL);
+                      dstream, cancellable);
         bytes_read += sizeof(guint8);
 
         gint32  low;
         TRY_OR_RETURN(0,
                       low = g_data_input_stream_read_int32,
-                      dstream, NULL);
+                      dstream, cancellable);
         bytes_read += sizeof(gint32);
 
         gint32  high;
         TRY_OR_RETURN(0,
                       high = g_data_input_stream_read_int32,
-                      dstream, NULL);
+                      dstream, cancellable);
         bytes_read += sizeof(gint32);
 
         g_d_debug("Read serialized node %d = (%d,"
@@ -310,23 +301,138 @@ load_v1(GDataInputStream *dstream,
 }
 
 
-ipset_node_id_t
-ipset_node_cache_load(GInputStream *stream,
-                      ipset_node_cache_t *cache,
-                      GError **err)
+/**
+ * The codec IDs that we store in the header of a compressed file.
+ */
+
+#define COMPRESSION_CODEC_ZLIB  0x01
+
+
+/**
+ * A helper function for reading a compressed BDD stream.  The
+ * compressed data is an ordinary BDD stream, which we read through a
+ * decompressing filter.  The filter only decompresses as much of the
+ * stream as the node reader asks for, so we never need the entire
+ * decompressed BDD in memory at once.
+ */
+
+static ipset_node_id_t
+load_compressed(GDataInputStream *dstream,
+                ipset_node_cache_t *cache,
+                GCancellable *cancellable,
+                GError **err)
 {
-    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+    ipset_node_id_t  result = 0;
+    GConverter  *converter = NULL;
+    GInputStream  *cstream = NULL;
 
-    ipset_node_id_t  result;
-    gsize bytes_read;
+    g_debug("Stream contains compressed IP set");
 
     /*
-     * Create a GDataInputStream to read in the binary data.
+     * We've already read in the magic number and version.  Next
+     * should be the codec that was used to compress the set.
      */
 
-    GDataInputStream  *dstream = g_data_input_stream_new(stream);
-    g_data_input_stream_set_byte_order
-        (dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+    guint8  codec;
+    g_debug("Reading compression codec");
+    TRY_OR_RETURN(0,
+                  codec = g_data_input_stream_read_byte,
+                  dstream, cancellable);
+
+    if (codec != COMPRESSION_CODEC_ZLIB)
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Unknown compression codec %u",
+                    (guint) codec);
+        return 0;
+    }
+
+    /*
+     * Read the compressed set through a decompressing stream.  Note
+     * that we have to wrap the data stream, and not its base stream,
+     * since the data stream might have already buffered some of the
+     * compressed data.
+     */
+
+    converter = G_CONVERTER(g_zlib_decompressor_new
+                            (G_ZLIB_COMPRESSOR_FORMAT_ZLIB));
+    cstream = g_converter_input_stream_new
+        (G_INPUT_STREAM(dstream), converter);
+
+    TRY_OR_RETURN(0,
+                  result = ipset_node_cache_load_cancellable,
+                  cstream, cache, cancellable);
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    if (cstream != NULL)
+        g_object_unref(cstream);
+
+    if (converter != NULL)
+        g_object_unref(converter);
+
+    return result;
+}
+
+
+/**
+ * A helper function for reading a fingerprinted BDD stream.  The
+ * fingerprint is followed by a complete BDD stream, which we read in
+ * and then check against the fingerprint.
+ */
+
+static ipset_node_id_t
+load_fingerprinted(GDataInputStream *dstream,
+                   ipset_node_cache_t *cache,
+                   GCancellable *cancellable,
+                   GError **err)
+{
+    ipset_node_id_t  result = 0;
+
+    g_debug("Stream contains fingerprinted IP set");
+
+    guint64  fingerprint;
+    g_debug("Reading fingerprint");
+    TRY_OR_RETURN(0,
+                  fingerprint = g_data_input_stream_read_uint64,
+                  dstream, cancellable);
+
+    TRY_OR_RETURN(0,
+                  result = ipset_node_cache_load_cancellable,
+                  G_INPUT_STREAM(dstream), cache, cancellable);
+
+    if (ipset_node_cache_fingerprint(cache, result) != fingerprint)
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Malformed set: fingerprint doesn't match "
+                    "contents.");
+        return 0;
+    }
+
+  error:
+    return result;
+}
+
+
+/**
+ * A helper function that reads in the magic number and version number
+ * at the start of every IP set stream.  Returns the version number.
+ */
+
+static guint16
+read_header(GDataInputStream *dstream,
+            GCancellable *cancellable,
+            GError **err)
+{
+    guint16  result = 0;
+    gsize bytes_read;
 
     /*
      * First, read in the magic number from the stream to ensure that
@@ -340,7 +446,7 @@ ipset_node_cache_load(GInputStream *stream,
                   g_input_stream_read_all,
                   G_INPUT_STREAM(dstream),
                   magic, MAGIC_NUMBER_LENGTH,
-                  &bytes_read, NULL);
+                  &bytes_read, cancellable);
 
     if (bytes_read != MAGIC_NUMBER_LENGTH)
     {
@@ -370,23 +476,91 @@ ipset_node_cache_load(GInputStream *stream,
     }
 
     /*
-     * Read in the version number and dispatch to the right reading
-     * function.
+     * Then read in the version number.
      */
 
-    guint16  version;
     g_debug("Reading IP set version");
     TRY_OR_RETURN(0,
-                  version = g_data_input_stream_read_uint16,
-                  dstream, NULL);
+                  result = g_data_input_stream_read_uint16,
+                  dstream, cancellable);
+
+  error:
+    return result;
+}
+
+
+ipset_node_id_t
+ipset_node_cache_load_cancellable(GInputStream *stream,
+                                  ipset_node_cache_t *cache,
+                                  GCancellable *cancellable,
+                                  GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+    ipset_node_id_t  result;
+
+    /*
+     * Create a GDataInputStream to read in the binary data.
+     */
 
+    GDataInputStream  *dstream = g_data_input_stream_new(stream);
+    g_data_input_stream_set_byte_order
+        (dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    /*
+     * Read in the magic number and version number, and dispatch to
+     * the right reading function.
+     */
+
+    guint16  version;
+    TRY_OR_RETURN(0,
+                  version = read_header,
+                  dstream, cancellable);
 
     switch (version)
     {
       case 0x0001:
         TRY_OR_RETURN(0,
                       result = load_v1,
-                      dstream, cache);
+                      dstream, cache, cancellable);
+        return result;
+
+      case 0x0002:
+        TRY_OR_RETURN(0,
+                      result = load_compressed,
+                      dstream, cache, cancellable);
+        return result;
+
+      case 0x0003:
+        /*
+         * Archives contain more than one BDD, so they have to be read
+         * with the archive functions.
+         */
+
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Stream contains an archive of IP sets, "
+                    "not a single IP set.");
+        return 0;
+
+      case 0x0004:
+        /*
+         * Patches can only be applied on top of the set that they
+         * were created from.
+         */
+
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Stream contains a patch, "
+                    "not a complete IP set.");
+        return 0;
+
+      case 0x0005:
+        TRY_OR_RETURN(0,
+                      result = load_fingerprinted,
+                      dstream, cache, cancellable);
         return result;
 
       default:
@@ -413,3 +587,697 @@ ipset_node_cache_load(GInputStream *stream,
 
     return result;
 }
+
+
+ipset_node_id_t
+ipset_node_cache_load(GInputStream *stream,
+                      ipset_node_cache_t *cache,
+                      GError **err)
+{
+    return ipset_node_cache_load_cancellable(stream, cache, NULL, err);
+}
+
+
+gboolean
+ipset_node_cache_read_fingerprint(GInputStream *stream,
+                                  guint64 *fingerprint,
+                                  GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+    gboolean  result = FALSE;
+
+    GDataInputStream  *dstream = g_data_input_stream_new(stream);
+    g_data_input_stream_set_byte_order
+        (dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    guint16  version;
+    TRY_OR_RETURN(FALSE,
+                  version = read_header,
+                  dstream, NULL);
+
+    if (version != 0x0005)
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Stream doesn't contain a fingerprint.");
+        goto error;
+    }
+
+    TRY_OR_RETURN(FALSE,
+                  *fingerprint = g_data_input_stream_read_uint64,
+                  dstream, NULL);
+
+    result = TRUE;
+
+  error:
+    g_object_unref(dstream);
+    return result;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Archives
+ */
+
+/**
+ * The contents of an archive's header and root table.
+ */
+
+typedef struct archive_header
+{
+    /**
+     * The number of bytes that we should read from the stream after
+     * the version number, if we read the entire archive.
+     */
+
+    gsize  cap;
+
+    /**
+     * The number of bytes that we've read since the version number.
+     */
+
+    gsize  bytes_read;
+
+    /**
+     * The name of each BDD in the archive.
+     */
+
+    GPtrArray  *names;
+
+    /**
+     * The serialized ID of the root of each BDD in the archive.
+     */
+
+    GArray  *roots;
+
+    /**
+     * The number of nonterminals in the archive's node table.
+     */
+
+    guint32  nonterminal_count;
+
+} archive_header_t;
+
+
+static void
+archive_header_free(archive_header_t *header)
+{
+    guint  i;
+
+    for (i = 0; i < header->names->len; i++)
+    {
+        g_free(g_ptr_array_index(header->names, i));
+    }
+
+    g_ptr_array_free(header->names, TRUE);
+    g_array_free(header->roots, TRUE);
+}
+
+
+/**
+ * Read in the header and root table of an archive.  The header's
+ * arrays are allocated even if there's an error, and must be freed
+ * with archive_header_free().
+ */
+
+static gboolean
+read_archive_header(GDataInputStream *dstream,
+                    archive_header_t *header,
+                    GError **err)
+{
+    gboolean  result = FALSE;
+
+    header->bytes_read = 0;
+    header->names = g_ptr_array_new();
+    header->roots = g_array_new(FALSE, FALSE, sizeof(serialized_id_t));
+
+    guint16  version;
+    TRY_OR_RETURN(FALSE,
+                  version = read_header,
+                  dstream, NULL);
+
+    if (version != 0x0003)
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Stream doesn't contain an archive of IP sets.");
+        return FALSE;
+    }
+
+    g_debug("Stream contains IP set archive");
+
+    /*
+     * Like in a v1 set, the length includes the magic number, version
+     * number, and the length field itself.
+     */
+
+    guint64  length;
+    g_debug("Reading encoded length");
+    TRY_OR_RETURN(FALSE,
+                  length = g_data_input_stream_read_uint64,
+                  dstream, NULL);
+
+    header->cap = length -
+        MAGIC_NUMBER_LENGTH -
+        sizeof(guint16) -
+        sizeof(guint64);
+
+    guint32  root_count;
+    g_debug("Reading number of roots");
+    TRY_OR_RETURN(FALSE,
+                  root_count = g_data_input_stream_read_uint32,
+                  dstream, NULL);
+    header->bytes_read += sizeof(guint32);
+
+    g_debug("Reading number of nonterminals");
+    TRY_OR_RETURN(FALSE,
+                  header->nonterminal_count =
+                  g_data_input_stream_read_uint32,
+                  dstream, NULL);
+    header->bytes_read += sizeof(guint32);
+
+    /*
+     * Read in the name and serialized root of each BDD.
+     */
+
+    guint  i;
+    for (i = 0; i < root_count; i++)
+    {
+        guint16  name_length;
+        TRY_OR_RETURN(FALSE,
+                      name_length = g_data_input_stream_read_uint16,
+                      dstream, NULL);
+        header->bytes_read += sizeof(guint16);
+
+        gchar  *name = g_malloc(name_length + 1);
+        g_ptr_array_add(header->names, name);
+
+        gsize  bytes_read;
+        TRY_OR_RETURN(FALSE,
+                      g_input_stream_read_all,
+                      G_INPUT_STREAM(dstream),
+                      name, name_length,
+                      &bytes_read, NULL);
+        header->bytes_read += bytes_read;
+        name[bytes_read] = '\0';
+
+        if (bytes_read != name_length)
+        {
+            g_set_error(err,
+                        IPSET_ERROR,
+                        IPSET_ERROR_PARSE_ERROR,
+                        "Unexpected end of file");
+            return FALSE;
+        }
+
+        serialized_id_t  root;
+        TRY_OR_RETURN(FALSE,
+                      root = g_data_input_stream_read_int32,
+                      dstream, NULL);
+        header->bytes_read += sizeof(gint32);
+
+        /*
+         * Negate into a 64-bit value, since a corrupt file might
+         * contain G_MININT32, which we can't negate as a gint.
+         */
+
+        if ((root < 0) && (-(gint64) root > header->nonterminal_count))
+        {
+            g_set_error(err,
+                        IPSET_ERROR,
+                        IPSET_ERROR_PARSE_ERROR,
+                        "Malformed archive: root of %s "
+                        "doesn't exist.", name);
+            return FALSE;
+        }
+
+        g_d_debug("Archive entry %s has root %d", name, root);
+        g_array_append_val(header->roots, root);
+    }
+
+    return TRUE;
+
+  error:
+    return result;
+}
+
+
+/**
+ * Read in the next nonterminal in an archive's or patch's node table.
+ * Any reference to a nonterminal must point at a node that we've
+ * already read in.
+ */
+
+static gboolean
+read_table_node(GDataInputStream *dstream,
+                gsize *bytes_read,
+                guint index,
+                archive_node_t *node,
+                GError **err)
+{
+    gboolean  result = FALSE;
+
+    TRY_OR_RETURN(FALSE,
+                  node->variable = g_data_input_stream_read_byte,
+                  dstream, NULL);
+    TRY_OR_RETURN(FALSE,
+                  node->low = g_data_input_stream_read_int32,
+                  dstream, NULL);
+    TRY_OR_RETURN(FALSE,
+                  node->high = g_data_input_stream_read_int32,
+                  dstream, NULL);
+
+    *bytes_read +=
+        sizeof(guint8) + sizeof(gint32) + sizeof(gint32);
+
+    if (((node->low < 0) && (-(gint64) node->low > index)) ||
+        ((node->high < 0) && (-(gint64) node->high > index)))
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Malformed set: node %d refers to "
+                    "a later node.", -(gint) (index+1));
+        return FALSE;
+    }
+
+    return TRUE;
+
+  error:
+    return result;
+}
+
+
+/**
+ * Turn a serialized node ID into an ID in the node cache, given an
+ * array of the cache IDs of the nonterminals we've seen so far.
+ */
+
+static ipset_node_id_t
+archive_cache_id(ipset_node_cache_t *cache,
+                 GArray *cache_ids,
+                 serialized_id_t serialized_id)
+{
+    if (serialized_id >= 0)
+    {
+        return ipset_node_cache_terminal(cache, serialized_id);
+    } else {
+        return g_array_index(cache_ids, ipset_node_id_t,
+                             -serialized_id - 1);
+    }
+}
+
+
+gboolean
+ipset_node_cache_load_archive(GInputStream *stream,
+                              ipset_node_cache_t *cache,
+                              GPtrArray *names,
+                              GArray *roots,
+                              GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+    gboolean  result = FALSE;
+    archive_header_t  header;
+    GArray  *cache_ids = NULL;
+
+    GDataInputStream  *dstream = g_data_input_stream_new(stream);
+    g_data_input_stream_set_byte_order
+        (dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    TRY_OR_RETURN(FALSE,
+                  read_archive_header,
+                  dstream, &header);
+
+    /*
+     * Every node in the table is reachable from at least one of the
+     * roots, so we can add each one to the node cache as soon as
+     * we've read it.
+     */
+
+    cache_ids = g_array_sized_new(FALSE, FALSE,
+                                  sizeof(ipset_node_id_t),
+                                  header.nonterminal_count);
+
+    guint  i;
+    for (i = 0; i < header.nonterminal_count; i++)
+    {
+        archive_node_t  node;
+        TRY_OR_RETURN(FALSE,
+                      read_table_node,
+                      dstream, &header.bytes_read, i, &node);
+
+        ipset_node_id_t  node_id = ipset_node_cache_nonterminal
+            (cache, node.variable,
+             archive_cache_id(cache, cache_ids, node.low),
+             archive_cache_id(cache, cache_ids, node.high));
+
+        g_array_append_val(cache_ids, node_id);
+    }
+
+    TRY_OR_RETURN(FALSE,
+                  verify_cap,
+                  header.bytes_read, header.cap);
+
+    /*
+     * Hand the names and roots over to the caller.
+     */
+
+    for (i = 0; i < header.roots->len; i++)
+    {
+        ipset_node_id_t  root = archive_cache_id
+            (cache, cache_ids,
+             g_array_index(header.roots, serialized_id_t, i));
+
+        g_ptr_array_add(names, g_ptr_array_index(header.names, i));
+        g_ptr_array_index(header.names, i) = NULL;
+        g_array_append_val(roots, root);
+    }
+
+    result = TRUE;
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    archive_header_free(&header);
+
+    if (cache_ids != NULL)
+        g_array_free(cache_ids, TRUE);
+
+    g_object_unref(dstream);
+
+    return result;
+}
+
+
+/**
+ * Add a nonterminal from an archive's node table to the node cache,
+ * along with any of its descendants that haven't been added yet.
+ */
+
+static ipset_node_id_t
+archive_materialize(ipset_node_cache_t *cache,
+                    GArray *nodes,
+                    GArray *cache_ids,
+                    serialized_id_t serialized_id)
+{
+    if (serialized_id >= 0)
+    {
+        return ipset_node_cache_terminal(cache, serialized_id);
+    }
+
+    guint  index = -serialized_id - 1;
+    ipset_node_id_t  result =
+        g_array_index(cache_ids, ipset_node_id_t, index);
+
+    if (result == NULL)
+    {
+        archive_node_t  *node =
+            &g_array_index(nodes, archive_node_t, index);
+
+        ipset_node_id_t  low = archive_materialize
+            (cache, nodes, cache_ids, node->low);
+        ipset_node_id_t  high = archive_materialize
+            (cache, nodes, cache_ids, node->high);
+
+        result = ipset_node_cache_nonterminal
+            (cache, node->variable, low, high);
+        g_array_index(cache_ids, ipset_node_id_t, index) = result;
+    }
+
+    return result;
+}
+
+
+ipset_node_id_t
+ipset_node_cache_load_archive_entry(GInputStream *stream,
+                                    ipset_node_cache_t *cache,
+                                    const gchar *name,
+                                    GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+    ipset_node_id_t  result = NULL;
+    archive_header_t  header;
+    GArray  *nodes = NULL;
+    GArray  *cache_ids = NULL;
+
+    GDataInputStream  *dstream = g_data_input_stream_new(stream);
+    g_data_input_stream_set_byte_order
+        (dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    TRY_OR_RETURN(NULL,
+                  read_archive_header,
+                  dstream, &header);
+
+    /*
+     * Find the root of the requested BDD.
+     */
+
+    guint  i;
+    for (i = 0; i < header.names->len; i++)
+    {
+        if (strcmp(g_ptr_array_index(header.names, i), name) == 0)
+            break;
+    }
+
+    if (i == header.names->len)
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Archive doesn't contain %s.", name);
+        goto error;
+    }
+
+    serialized_id_t  root =
+        g_array_index(header.roots, serialized_id_t, i);
+
+    if (root >= 0)
+    {
+        result = ipset_node_cache_terminal(cache, root);
+        goto error;
+    }
+
+    /*
+     * Every node that's reachable from the root appears before the
+     * root in the node table, so we don't have to read anything after
+     * it.  We only add the reachable nodes to the node cache, though,
+     * since the others belong to the archive's other BDDs.
+     */
+
+    guint  node_count = -(gint64) root;
+    nodes = g_array_sized_new(FALSE, FALSE,
+                              sizeof(archive_node_t), node_count);
+    cache_ids = g_array_sized_new(FALSE, TRUE,
+                                  sizeof(ipset_node_id_t), node_count);
+    g_array_set_size(cache_ids, node_count);
+
+    for (i = 0; i < node_count; i++)
+    {
+        archive_node_t  node;
+        TRY_OR_RETURN(NULL,
+                      read_table_node,
+                      dstream, &header.bytes_read, i, &node);
+        g_array_append_val(nodes, node);
+    }
+
+    result = archive_materialize(cache, nodes, cache_ids, root);
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    archive_header_free(&header);
+
+    if (nodes != NULL)
+        g_array_free(nodes, TRUE);
+
+    if (cache_ids != NULL)
+        g_array_free(cache_ids, TRUE);
+
+    g_object_unref(dstream);
+
+    return result;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Patches
+ */
+
+/**
+ * Assign serialized IDs to the nonterminals in a BDD, in the same
+ * order that we'd write them to disk.  The nodes are appended to the
+ * ids array, so that the node with serialized ID -n ends up at index
+ * n-1.
+ */
+
+static void
+index_base_nodes(GHashTable *seen,
+                 GArray *ids,
+                 ipset_node_id_t node_id)
+{
+    if ((ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE) ||
+        g_hash_table_lookup_extended(seen, node_id, NULL, NULL))
+    {
+        return;
+    }
+
+    ipset_node_t  *node = ipset_nonterminal_node(node_id);
+    index_base_nodes(seen, ids, node->low);
+    index_base_nodes(seen, ids, node->high);
+
+    g_hash_table_insert(seen, node_id, NULL);
+    g_array_append_val(ids, node_id);
+}
+
+
+ipset_node_id_t
+ipset_node_cache_load_patch(GInputStream *stream,
+                            ipset_node_cache_t *cache,
+                            ipset_node_id_t base,
+                            GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, NULL);
+
+    ipset_node_id_t  result = NULL;
+    GHashTable  *seen = NULL;
+    GArray  *cache_ids = NULL;
+    gsize  bytes_read = 0;
+
+    GDataInputStream  *dstream = g_data_input_stream_new(stream);
+    g_data_input_stream_set_byte_order
+        (dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    guint16  version;
+    TRY_OR_RETURN(NULL,
+                  version = read_header,
+                  dstream, NULL);
+
+    if (version != 0x0004)
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Stream doesn't contain an IP set patch.");
+        goto error;
+    }
+
+    g_debug("Stream contains IP set patch");
+
+    guint64  length;
+    g_debug("Reading encoded length");
+    TRY_OR_RETURN(NULL,
+                  length = g_data_input_stream_read_uint64,
+                  dstream, NULL);
+
+    gsize  cap = length -
+        MAGIC_NUMBER_LENGTH -
+        sizeof(guint16) -
+        sizeof(guint64);
+
+    guint32  base_count;
+    g_debug("Reading number of base nonterminals");
+    TRY_OR_RETURN(NULL,
+                  base_count = g_data_input_stream_read_uint32,
+                  dstream, NULL);
+    bytes_read += sizeof(guint32);
+
+    guint64  base_fingerprint;
+    g_debug("Reading fingerprint of base");
+    TRY_OR_RETURN(NULL,
+                  base_fingerprint = g_data_input_stream_read_uint64,
+                  dstream, NULL);
+    bytes_read += sizeof(guint64);
+
+    guint32  nonterminal_count;
+    g_debug("Reading number of new nonterminals");
+    TRY_OR_RETURN(NULL,
+                  nonterminal_count = g_data_input_stream_read_uint32,
+                  dstream, NULL);
+    bytes_read += sizeof(guint32);
+
+    serialized_id_t  root;
+    TRY_OR_RETURN(NULL,
+                  root = g_data_input_stream_read_int32,
+                  dstream, NULL);
+    bytes_read += sizeof(gint32);
+
+    /*
+     * The patch refers to the base's nodes using the serialized IDs
+     * that they'd have in a saved copy of the base, so we rebuild that
+     * numbering from the base that's already in memory.  The new
+     * nodes in the patch continue the numbering where the base left
+     * off.
+     */
+
+    seen = g_hash_table_new(NULL, NULL);
+    cache_ids = g_array_sized_new(FALSE, FALSE,
+                                  sizeof(ipset_node_id_t),
+                                  base_count + nonterminal_count);
+    index_base_nodes(seen, cache_ids, base);
+
+    if ((cache_ids->len != base_count) ||
+        (ipset_node_cache_fingerprint(cache, base) != base_fingerprint))
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Patch doesn't apply to this IP set.");
+        goto error;
+    }
+
+    if ((root < 0) &&
+        (-(gint64) root > (gint64) base_count + nonterminal_count))
+    {
+        g_set_error(err,
+                    IPSET_ERROR,
+                    IPSET_ERROR_PARSE_ERROR,
+                    "Malformed patch: root doesn't exist.");
+        goto error;
+    }
+
+    guint  i;
+    for (i = 0; i < nonterminal_count; i++)
+    {
+        archive_node_t  node;
+        TRY_OR_RETURN(NULL,
+                      read_table_node,
+                      dstream, &bytes_read, base_count + i, &node);
+
+        ipset_node_id_t  node_id = ipset_node_cache_nonterminal
+            (cache, node.variable,
+             archive_cache_id(cache, cache_ids, node.low),
+             archive_cache_id(cache, cache_ids, node.high));
+
+        g_array_append_val(cache_ids, node_id);
+    }
+
+    TRY_OR_RETURN(NULL,
+                  verify_cap,
+                  bytes_read, cap);
+
+    result = archive_cache_id(cache, cache_ids, root);
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    if (seen != NULL)
+        g_hash_table_destroy(seen);
+
+    if (cache_ids != NULL)
+        g_array_free(cache_ids, TRUE);
+
+    g_object_unref(dstream);
+
+    return result;
+}
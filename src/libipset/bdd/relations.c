@@ -0,0 +1,280 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/logging.h>
+
+
+/*-----------------------------------------------------------------------
+ * Helpers
+ */
+
+static void
+free_key(gpointer key)
+{
+    g_slice_free(ipset_binary_key_t, key);
+}
+
+
+static GHashTable *
+new_memo(GDestroyNotify free_value)
+{
+    return g_hash_table_new_full((GHashFunc) ipset_binary_key_hash,
+                                 (GEqualFunc) ipset_binary_key_equal,
+                                 free_key, free_value);
+}
+
+
+static void
+memo_insert(GHashTable *memo, const ipset_binary_key_t *key,
+            gpointer value)
+{
+    ipset_binary_key_t  *real_key = g_slice_new(ipset_binary_key_t);
+    *real_key = *key;
+    g_hash_table_insert(memo, real_key, value);
+}
+
+
+static gboolean
+is_zero(ipset_node_id_t node_id)
+{
+    return (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE) &&
+        (ipset_terminal_value(node_id) == 0);
+}
+
+
+static ipset_variable_t
+node_variable(ipset_node_id_t node_id)
+{
+    if (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE)
+        return IPSET_ASSIGNMENT_MAX_VARIABLES;
+
+    return ipset_nonterminal_node(node_id)->variable;
+}
+
+
+/**
+ * Split two BDDs on the smaller of their root variables.  If a BDD
+ * doesn't test that variable, both of its branches are the BDD
+ * itself.
+ */
+
+static ipset_variable_t
+split(ipset_node_id_t lhs, ipset_node_id_t rhs,
+      ipset_node_id_t *lhs_low, ipset_node_id_t *lhs_high,
+      ipset_node_id_t *rhs_low, ipset_node_id_t *rhs_high)
+{
+    ipset_variable_t  lhs_var = node_variable(lhs);
+    ipset_variable_t  rhs_var = node_variable(rhs);
+    ipset_variable_t  var = MIN(lhs_var, rhs_var);
+
+    if (lhs_var == var)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(lhs);
+        *lhs_low = node->low;
+        *lhs_high = node->high;
+    } else {
+        *lhs_low = *lhs_high = lhs;
+    }
+
+    if (rhs_var == var)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(rhs);
+        *rhs_low = node->low;
+        *rhs_high = node->high;
+    } else {
+        *rhs_low = *rhs_high = rhs;
+    }
+
+    return var;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Implication
+ */
+
+static gboolean
+implies(GHashTable *memo, ipset_node_id_t lhs, ipset_node_id_t rhs)
+{
+    /*
+     * A BDD implies itself, and FALSE implies everything.  If rhs is
+     * a nonzero terminal, everything implies it.
+     */
+
+    if ((lhs == rhs) || is_zero(lhs))
+        return TRUE;
+
+    if (ipset_node_get_type(rhs) == IPSET_TERMINAL_NODE)
+    {
+        if (!is_zero(rhs))
+            return TRUE;
+
+        /*
+         * Since lhs isn't a zero terminal, it has at least one nonzero
+         * assignment, which rhs maps to zero.
+         */
+
+        return FALSE;
+    }
+
+    /*
+     * We only memoize pairs that turned out to be TRUE, since a FALSE
+     * result stops the whole traversal.
+     */
+
+    ipset_binary_key_t  key = { lhs, rhs };
+
+    if (g_hash_table_lookup_extended(memo, &key, NULL, NULL))
+        return TRUE;
+
+    ipset_node_id_t  lhs_low, lhs_high, rhs_low, rhs_high;
+    split(lhs, rhs, &lhs_low, &lhs_high, &rhs_low, &rhs_high);
+
+    if (!implies(memo, lhs_low, rhs_low) ||
+        !implies(memo, lhs_high, rhs_high))
+        return FALSE;
+
+    memo_insert(memo, &key, NULL);
+    return TRUE;
+}
+
+
+gboolean
+ipset_node_implies(ipset_node_id_t lhs, ipset_node_id_t rhs)
+{
+    GHashTable  *memo = new_memo(NULL);
+    gboolean  result = implies(memo, lhs, rhs);
+
+    g_d_debug("%p implies %p: %s", lhs, rhs, result? "yes": "no");
+    g_hash_table_destroy(memo);
+    return result;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Disjointness
+ */
+
+static gboolean
+disjoint(GHashTable *memo, ipset_node_id_t lhs, ipset_node_id_t rhs)
+{
+    if (is_zero(lhs) || is_zero(rhs))
+        return TRUE;
+
+    /*
+     * Any BDD other than a zero terminal has at least one nonzero
+     * assignment.  So if either BDD is a nonzero terminal, or if the
+     * two BDDs are the same, then they overlap.
+     */
+
+    if ((lhs == rhs) ||
+        (ipset_node_get_type(lhs) == IPSET_TERMINAL_NODE) ||
+        (ipset_node_get_type(rhs) == IPSET_TERMINAL_NODE))
+        return FALSE;
+
+    ipset_binary_key_t  key;
+    ipset_binary_key_commutative(&key, lhs, rhs);
+
+    if (g_hash_table_lookup_extended(memo, &key, NULL, NULL))
+        return TRUE;
+
+    ipset_node_id_t  lhs_low, lhs_high, rhs_low, rhs_high;
+    split(lhs, rhs, &lhs_low, &lhs_high, &rhs_low, &rhs_high);
+
+    if (!disjoint(memo, lhs_low, rhs_low) ||
+        !disjoint(memo, lhs_high, rhs_high))
+        return FALSE;
+
+    memo_insert(memo, &key, NULL);
+    return TRUE;
+}
+
+
+gboolean
+ipset_node_disjoint(ipset_node_id_t lhs, ipset_node_id_t rhs)
+{
+    GHashTable  *memo = new_memo(NULL);
+    gboolean  result = disjoint(memo, lhs, rhs);
+
+    g_d_debug("%p and %p disjoint: %s", lhs, rhs, result? "yes": "no");
+    g_hash_table_destroy(memo);
+    return result;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Counting the intersection
+ */
+
+static void
+and_count(GHashTable *memo, ipset_node_id_t lhs, ipset_node_id_t rhs,
+          ipset_variable_t var, ipset_variable_t end, ipset_count_t *count)
+{
+    if (is_zero(lhs) || is_zero(rhs))
+    {
+        count->high = count->low = 0;
+        return;
+    }
+
+    if ((ipset_node_get_type(lhs) == IPSET_TERMINAL_NODE) &&
+        (ipset_node_get_type(rhs) == IPSET_TERMINAL_NODE))
+    {
+        /*
+         * Every assignment of the remaining variables is nonzero in
+         * both.
+         */
+
+        ipset_count_t  one = { 0, 1 };
+        ipset_count_shift(count, &one, end - var);
+        return;
+    }
+
+    /*
+     * The memoized count is relative to the smaller of the two root
+     * variables.
+     */
+
+    ipset_variable_t  top = MIN(node_variable(lhs), node_variable(rhs));
+    ipset_binary_key_t  key;
+    ipset_binary_key_commutative(&key, lhs, rhs);
+
+    ipset_count_t  *cached = g_hash_table_lookup(memo, &key);
+
+    if (cached == NULL)
+    {
+        ipset_node_id_t  lhs_low, lhs_high, rhs_low, rhs_high;
+        ipset_count_t  low_count;
+        ipset_count_t  high_count;
+
+        split(lhs, rhs, &lhs_low, &lhs_high, &rhs_low, &rhs_high);
+        and_count(memo, lhs_low, rhs_low, top + 1, end, &low_count);
+        and_count(memo, lhs_high, rhs_high, top + 1, end, &high_count);
+
+        cached = g_new(ipset_count_t, 1);
+        ipset_count_add(cached, &low_count, &high_count);
+        memo_insert(memo, &key, cached);
+    }
+
+    ipset_count_shift(count, cached, top - var);
+}
+
+
+void
+ipset_node_and_count(ipset_node_id_t lhs, ipset_node_id_t rhs,
+                     ipset_variable_t var, ipset_variable_t end,
+                     ipset_count_t *count)
+{
+    GHashTable  *memo = new_memo(g_free);
+    and_count(memo, lhs, rhs, var, end, count);
+    g_hash_table_destroy(memo);
+}
@@ -0,0 +1,72 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/logging.h>
+
+
+static ipset_node_id_t
+transform(ipset_node_cache_t *cache,
+          GHashTable *memo,
+          ipset_node_id_t node_id,
+          ipset_transform_func_t func,
+          gpointer user_data)
+{
+    gpointer  result;
+
+    /*
+     * Terminal IDs go into the memo along with nonterminals, so that
+     * func is only called once for each distinct value.
+     */
+
+    if (g_hash_table_lookup_extended(memo, node_id, NULL, &result))
+        return result;
+
+    if (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE)
+    {
+        ipset_range_t  value = ipset_terminal_value(node_id);
+        result = ipset_node_cache_terminal(cache, func(value, user_data));
+        g_hash_table_insert(memo, node_id, result);
+        return result;
+    }
+
+    /*
+     * Rebuild the node from its transformed children.  If they turn
+     * out to be the same, the node cache drops this node.
+     */
+
+    ipset_node_t  *node = ipset_nonterminal_node(node_id);
+    ipset_node_id_t  low =
+        transform(cache, memo, node->low, func, user_data);
+    ipset_node_id_t  high =
+        transform(cache, memo, node->high, func, user_data);
+
+    result = ipset_node_cache_nonterminal(cache, node->variable, low, high);
+    g_hash_table_insert(memo, node_id, result);
+    return result;
+}
+
+
+ipset_node_id_t
+ipset_node_cache_transform(ipset_node_cache_t *cache,
+                           ipset_node_id_t node,
+                           ipset_transform_func_t func,
+                           gpointer user_data)
+{
+    GHashTable  *memo = g_hash_table_new(NULL, NULL);
+    ipset_node_id_t  result =
+        transform(cache, memo, node, func, user_data);
+
+    g_d_debug("Transformed %p into %p", node, result);
+    g_hash_table_destroy(memo);
+    return result;
+}
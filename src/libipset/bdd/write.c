@@ -8,9 +8,12 @@
  * ----------------------------------------------------------------------
  */
 
+#include <string.h>
+
 #include <glib.h>
 #include <gio/gio.h>
 
+#include <ipset/bdd/internal.h>
 #include <ipset/bdd/nodes.h>
 #include <ipset/logging.h>
 
@@ -43,17 +46,6 @@
  * Generic saving logic
  */
 
-/**
- * On disk, we use a different node ID scheme than we do in memory.
- * Terminal node IDs are non-negative, and are equal to the terminal
- * value.  Nonterminal node IDs are negative, starting with -1.
- * Nonterminal -1 appears first on disk, then nonterminal -2, and so
- * on.
- */
-
-typedef gint  serialized_id_t;
-
-
 /* forward declaration */
 
 typedef struct save_data save_data_t;
@@ -567,6 +559,567 @@ ipset_node_cache_save(GOutputStream *stream,
 }
 
 
+/*-----------------------------------------------------------------------
+ * Compressed BDD file
+ */
+
+/**
+ * The codec IDs that we store in the header of a compressed file.
+ */
+
+#define COMPRESSION_CODEC_ZLIB  0x01
+
+
+gboolean
+ipset_node_cache_save_compressed(GOutputStream *stream,
+                                 ipset_node_cache_t *cache,
+                                 ipset_node_id_t node,
+                                 ipset_compression_t compression,
+                                 GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+    gboolean  result = FALSE;
+    GDataOutputStream  *hstream = NULL;
+    GConverter  *converter = NULL;
+    GOutputStream  *cstream = NULL;
+    gsize  bytes_written;
+    gint  level;
+
+    save_data_t  save_data = {
+        NULL,                   /* output stream */
+        NULL,                   /* serialized ID cache */
+        0,                      /* next serialized ID */
+        write_header_v1,        /* header writer */
+        write_footer_v1,        /* footer writer */
+        write_terminal_v1,      /* terminal writer */
+        write_nonterminal_v1,   /* nonterminal writer */
+        NULL                    /* user data */
+    };
+
+    switch (compression)
+    {
+      case IPSET_COMPRESSION_NONE:
+        return ipset_node_cache_save(stream, cache, node, err);
+
+      case IPSET_COMPRESSION_ZLIB:
+        level = -1;
+        break;
+
+      case IPSET_COMPRESSION_ZLIB_FAST:
+        level = 1;
+        break;
+
+      default:
+        g_return_val_if_reached(FALSE);
+    }
+
+    /*
+     * The header of a compressed file is not itself compressed, so
+     * that we can tell which decompressor to use.  We don't want to
+     * close the caller's stream when we're done with the header, so
+     * that we can keep writing to it.
+     */
+
+    hstream = g_data_output_stream_new(stream);
+    g_filter_output_stream_set_close_base_stream
+        (G_FILTER_OUTPUT_STREAM(hstream), FALSE);
+    g_data_output_stream_set_byte_order
+        (hstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    TRY_OR_RETURN(FALSE,
+                  g_output_stream_write_all,
+                  G_OUTPUT_STREAM(hstream),
+                  MAGIC_NUMBER, MAGIC_NUMBER_LENGTH,
+                  &bytes_written, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint16,
+                  hstream, 0x0002, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_byte,
+                  hstream, COMPRESSION_CODEC_ZLIB, NULL);
+
+    /*
+     * The rest of the file is an ordinary V1 BDD, run through the
+     * compressor on its way to the caller's stream.
+     */
+
+    converter = G_CONVERTER(g_zlib_compressor_new
+                            (G_ZLIB_COMPRESSOR_FORMAT_ZLIB, level));
+    cstream = g_converter_output_stream_new(stream, converter);
+
+    save_data.dstream = g_data_output_stream_new(cstream);
+
+    TRY_OR_RETURN(FALSE,
+                  save_bdd,
+                  &save_data, cache, node);
+
+    /*
+     * Closing the stream explicitly flushes out the last compressed
+     * block, and lets us report any errors that happen while doing
+     * so.
+     */
+
+    TRY_OR_RETURN(FALSE,
+                  g_output_stream_close,
+                  G_OUTPUT_STREAM(save_data.dstream), NULL);
+
+    result = TRUE;
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    if (save_data.dstream != NULL)
+        g_object_unref(save_data.dstream);
+
+    if (cstream != NULL)
+        g_object_unref(cstream);
+
+    if (converter != NULL)
+        g_object_unref(converter);
+
+    g_object_unref(hstream);
+
+    return result;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Fingerprinted BDD file
+ */
+
+gboolean
+ipset_node_cache_save_fingerprinted(GOutputStream *stream,
+                                    ipset_node_cache_t *cache,
+                                    ipset_node_id_t node,
+                                    ipset_compression_t compression,
+                                    GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+    gboolean  result = FALSE;
+    gsize  bytes_written;
+
+    /*
+     * Like with a compressed file, we don't want to close the
+     * caller's stream when we're done with the header.
+     */
+
+    GDataOutputStream  *hstream = g_data_output_stream_new(stream);
+    g_filter_output_stream_set_close_base_stream
+        (G_FILTER_OUTPUT_STREAM(hstream), FALSE);
+    g_data_output_stream_set_byte_order
+        (hstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    TRY_OR_RETURN(FALSE,
+                  g_output_stream_write_all,
+                  G_OUTPUT_STREAM(hstream),
+                  MAGIC_NUMBER, MAGIC_NUMBER_LENGTH,
+                  &bytes_written, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint16,
+                  hstream, 0x0005, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint64,
+                  hstream, ipset_node_cache_fingerprint(cache, node),
+                  NULL);
+
+    /*
+     * The rest of the file is a complete BDD, with its own header.
+     */
+
+    TRY_OR_RETURN(FALSE,
+                  ipset_node_cache_save_compressed,
+                  stream, cache, node, compression);
+
+    result = TRUE;
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    g_object_unref(hstream);
+
+    return result;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Archive file
+ */
+
+static gboolean
+write_terminal_archive(save_data_t *save_data,
+                       ipset_range_t terminal_value,
+                       GError **err)
+{
+    /*
+     * Terminals are stored inline in the nonterminals that point to
+     * them, so there's nothing to output.
+     */
+
+    return TRUE;
+}
+
+
+static gboolean
+write_nonterminal_archive(save_data_t *save_data,
+                          serialized_id_t serialized_id,
+                          ipset_variable_t variable,
+                          serialized_id_t serialized_low,
+                          serialized_id_t serialized_high,
+                          GError **err)
+{
+    /*
+     * We can't output the node table until we know how many nodes
+     * there are, so we collect them into an array first.
+     */
+
+    GArray  *nodes = save_data->user_data;
+    archive_node_t  node = { variable, serialized_low, serialized_high };
+    g_array_append_val(nodes, node);
+    return TRUE;
+}
+
+
+gboolean
+ipset_node_cache_save_archive(GOutputStream *stream,
+                              ipset_node_cache_t *cache,
+                              guint root_count,
+                              const gchar * const *names,
+                              const ipset_node_id_t *roots,
+                              GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+    gboolean  result = FALSE;
+    GArray  *nodes = g_array_new(FALSE, FALSE, sizeof(archive_node_t));
+    serialized_id_t  *serialized_roots = g_new(serialized_id_t, root_count);
+    gsize  bytes_written;
+    guint  i;
+
+    save_data_t  save_data = {
+        NULL,                   /* output stream */
+        NULL,                   /* serialized ID cache */
+        -1,                     /* next serialized ID */
+        NULL,                   /* header writer */
+        NULL,                   /* footer writer */
+        write_terminal_archive, /* terminal writer */
+        write_nonterminal_archive, /* nonterminal writer */
+        nodes                   /* user data */
+    };
+
+    /*
+     * Visit each of the BDDs using the same serialized ID cache, so
+     * that any nodes that they share only appear in the node table
+     * once.
+     */
+
+    save_data.serialized_ids = g_hash_table_new(NULL, NULL);
+
+    for (i = 0; i < root_count; i++)
+    {
+        g_d_debug("Collecting nodes for archive entry %s", names[i]);
+
+        TRY_OR_RETURN(FALSE,
+                      serialized_roots[i] = save_visit_node,
+                      &save_data, roots[i]);
+    }
+
+    /*
+     * Determine the size of the archive.
+     */
+
+    gsize  archive_size =
+        MAGIC_NUMBER_LENGTH +    /* magic number */
+        sizeof(guint16) +        /* version number  */
+        sizeof(guint64) +        /* length of archive */
+        sizeof(guint32) +        /* number of roots */
+        sizeof(guint32) +        /* number of nonterminals */
+        (nodes->len *            /* for each nonterminal: */
+         (sizeof(guint8) +       /*   variable number */
+          sizeof(guint32) +      /*   low pointer */
+          sizeof(guint32)        /*   high pointer */
+         ));
+
+    for (i = 0; i < root_count; i++)
+    {
+        gsize  name_length = strlen(names[i]);
+
+        if (name_length > G_MAXUINT16)
+        {
+            g_set_error(err,
+                        IPSET_ERROR,
+                        IPSET_ERROR_PARSE_ERROR,
+                        "Archive entry name is too long.");
+            goto error;
+        }
+
+        archive_size +=
+            sizeof(guint16) +    /* length of name */
+            name_length +        /* name */
+            sizeof(guint32);     /* root pointer */
+    }
+
+    /*
+     * Output the header and root table.  The data should all be
+     * big-endian.
+     */
+
+    save_data.dstream = g_data_output_stream_new(stream);
+    g_data_output_stream_set_byte_order
+        (save_data.dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    TRY_OR_RETURN(FALSE,
+                  g_output_stream_write_all,
+                  G_OUTPUT_STREAM(save_data.dstream),
+                  MAGIC_NUMBER, MAGIC_NUMBER_LENGTH,
+                  &bytes_written, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint16,
+                  save_data.dstream, 0x0003, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint64,
+                  save_data.dstream, archive_size, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint32,
+                  save_data.dstream, root_count, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint32,
+                  save_data.dstream, nodes->len, NULL);
+
+    for (i = 0; i < root_count; i++)
+    {
+        gsize  name_length = strlen(names[i]);
+
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_uint16,
+                      save_data.dstream, name_length, NULL);
+
+        TRY_OR_RETURN(FALSE,
+                      g_output_stream_write_all,
+                      G_OUTPUT_STREAM(save_data.dstream),
+                      names[i], name_length,
+                      &bytes_written, NULL);
+
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_int32,
+                      save_data.dstream, serialized_roots[i], NULL);
+    }
+
+    /*
+     * Then output the shared node table, which is in the same format
+     * as the nonterminals in a V1 BDD.
+     */
+
+    for (i = 0; i < nodes->len; i++)
+    {
+        archive_node_t  *node = &g_array_index(nodes, archive_node_t, i);
+
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_byte,
+                      save_data.dstream, node->variable, NULL);
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_int32,
+                      save_data.dstream, node->low, NULL);
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_int32,
+                      save_data.dstream, node->high, NULL);
+    }
+
+    result = TRUE;
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    if (save_data.dstream != NULL)
+        g_object_unref(save_data.dstream);
+
+    g_hash_table_destroy(save_data.serialized_ids);
+    g_array_free(nodes, TRUE);
+    g_free(serialized_roots);
+
+    return result;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Patch file
+ */
+
+static gboolean
+write_nonterminal_patch_base(save_data_t *save_data,
+                             serialized_id_t serialized_id,
+                             ipset_variable_t variable,
+                             serialized_id_t serialized_low,
+                             serialized_id_t serialized_high,
+                             GError **err)
+{
+    /*
+     * The base's nodes are already on the other end, so we only need
+     * to know which serialized IDs they have.
+     */
+
+    return TRUE;
+}
+
+
+gboolean
+ipset_node_cache_save_patch(GOutputStream *stream,
+                            ipset_node_cache_t *cache,
+                            ipset_node_id_t base,
+                            ipset_node_id_t node,
+                            GError **err)
+{
+    g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+
+    gboolean  result = FALSE;
+    GArray  *nodes = g_array_new(FALSE, FALSE, sizeof(archive_node_t));
+    gsize  bytes_written;
+    guint  i;
+
+    save_data_t  save_data = {
+        NULL,                   /* output stream */
+        NULL,                   /* serialized ID cache */
+        -1,                     /* next serialized ID */
+        NULL,                   /* header writer */
+        NULL,                   /* footer writer */
+        write_terminal_archive, /* terminal writer */
+        write_nonterminal_patch_base, /* nonterminal writer */
+        nodes                   /* user data */
+    };
+
+    /*
+     * First number the base's nodes in the same order that they'd
+     * appear in a saved copy of the base.  Then visit the new BDD
+     * using the same serialized ID cache, so that we only collect the
+     * nodes that don't appear in the base.
+     */
+
+    save_data.serialized_ids = g_hash_table_new(NULL, NULL);
+
+    g_d_debug("Numbering base nodes");
+
+    TRY_OR_RETURN(FALSE,
+                  save_visit_node,
+                  &save_data, base);
+
+    guint32  base_count = -(save_data.next_serialized_id + 1);
+
+    g_d_debug("Collecting new nodes");
+
+    save_data.write_nonterminal = write_nonterminal_archive;
+
+    serialized_id_t  root;
+    TRY_OR_RETURN(FALSE,
+                  root = save_visit_node,
+                  &save_data, node);
+
+    gsize  patch_size =
+        MAGIC_NUMBER_LENGTH +    /* magic number */
+        sizeof(guint16) +        /* version number  */
+        sizeof(guint64) +        /* length of patch */
+        sizeof(guint32) +        /* number of base nonterminals */
+        sizeof(guint64) +        /* fingerprint of base */
+        sizeof(guint32) +        /* number of new nonterminals */
+        sizeof(guint32) +        /* root pointer */
+        (nodes->len *            /* for each nonterminal: */
+         (sizeof(guint8) +       /*   variable number */
+          sizeof(guint32) +      /*   low pointer */
+          sizeof(guint32)        /*   high pointer */
+         ));
+
+    /*
+     * Output the header, followed by the new nodes.  The data should
+     * all be big-endian.
+     */
+
+    save_data.dstream = g_data_output_stream_new(stream);
+    g_data_output_stream_set_byte_order
+        (save_data.dstream, G_DATA_STREAM_BYTE_ORDER_BIG_ENDIAN);
+
+    TRY_OR_RETURN(FALSE,
+                  g_output_stream_write_all,
+                  G_OUTPUT_STREAM(save_data.dstream),
+                  MAGIC_NUMBER, MAGIC_NUMBER_LENGTH,
+                  &bytes_written, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint16,
+                  save_data.dstream, 0x0004, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint64,
+                  save_data.dstream, patch_size, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint32,
+                  save_data.dstream, base_count, NULL);
+
+    /*
+     * The base's fingerprint lets the reader check that it's applying
+     * the patch to the right set, even if some other set happens to
+     * have the same number of nodes.
+     */
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint64,
+                  save_data.dstream,
+                  ipset_node_cache_fingerprint(cache, base), NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_uint32,
+                  save_data.dstream, nodes->len, NULL);
+
+    TRY_OR_RETURN(FALSE,
+                  g_data_output_stream_put_int32,
+                  save_data.dstream, root, NULL);
+
+    for (i = 0; i < nodes->len; i++)
+    {
+        archive_node_t  *anode = &g_array_index(nodes, archive_node_t, i);
+
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_byte,
+                      save_data.dstream, anode->variable, NULL);
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_int32,
+                      save_data.dstream, anode->low, NULL);
+        TRY_OR_RETURN(FALSE,
+                      g_data_output_stream_put_int32,
+                      save_data.dstream, anode->high, NULL);
+    }
+
+    result = TRUE;
+
+  error:
+    /*
+     * Clean up the objects that we've created before returning.
+     */
+
+    if (save_data.dstream != NULL)
+        g_object_unref(save_data.dstream);
+
+    g_hash_table_destroy(save_data.serialized_ids);
+    g_array_free(nodes, TRUE);
+
+    return result;
+}
+
+
 /*-----------------------------------------------------------------------
  * GraphViz dot file
  */
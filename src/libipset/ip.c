@@ -8,11 +8,9 @@
  * ----------------------------------------------------------------------
  */
 
-#include <arpa/inet.h>
 #include <string.h>
 
 #include <glib.h>
-#include <glib/gprintf.h>
 
 #include <ipset/ip.h>
 #include "hash.c.in"
@@ -72,19 +70,185 @@ ipset_ip_equal(const ipset_ip_t *addr1,
 }
 
 
+/*-----------------------------------------------------------------------
+ * Parsing
+ */
+
+/**
+ * Parse a dotted-quad IPv4 address from the characters between str
+ * and end.  Like inet_pton, we require exactly four decimal octets,
+ * and don't allow leading zeros.  The octets are written to dest as
+ * they're parsed, so dest might be partly filled in even if this
+ * returns FALSE.
+ */
+
+static gboolean
+parse_ipv4(const gchar *str, const gchar *end, guint8 *dest)
+{
+    guint  octets = 0;
+
+    while (TRUE)
+    {
+        guint  value = 0;
+        guint  digits = 0;
+
+        while ((str < end) && g_ascii_isdigit(*str))
+        {
+            if ((digits > 0) && (value == 0))
+                return FALSE;
+
+            value = value * 10 + (*str++ - '0');
+            digits++;
+
+            if (value > 255)
+                return FALSE;
+        }
+
+        if ((digits == 0) || (octets == 4))
+            return FALSE;
+
+        dest[octets++] = value;
+
+        if (str == end)
+            return (octets == 4);
+
+        if (*str++ != '.')
+            return FALSE;
+    }
+}
+
+
+/**
+ * Parse an IPv6 address from the characters between str and end,
+ * following the same rules as inet_pton.
+ */
+
+static gboolean
+parse_ipv6(const gchar *str, const gchar *end, guint8 *dest)
+{
+    guint8  tmp[16];
+    const gchar  *current_token;
+    gint  colon_pos = -1;
+    guint  pos = 0;
+    guint  value = 0;
+    guint  digits = 0;
+
+    memset(tmp, 0, sizeof(tmp));
+
+    /*
+     * A leading colon is only allowed as part of a leading "::".
+     */
+
+    if ((str < end) && (*str == ':'))
+    {
+        if ((++str == end) || (*str != ':'))
+            return FALSE;
+    }
+
+    current_token = str;
+
+    while (str < end)
+    {
+        gchar  ch = *str++;
+
+        if (g_ascii_isxdigit(ch))
+        {
+            value = (value << 4) | g_ascii_xdigit_value(ch);
+
+            if (++digits > 4)
+                return FALSE;
+
+            continue;
+        }
+
+        if (ch == ':')
+        {
+            current_token = str;
+
+            if (digits == 0)
+            {
+                if (colon_pos >= 0)
+                    return FALSE;
+
+                colon_pos = pos;
+                continue;
+            }
+
+            if ((str == end) || (pos + 2 > 16))
+                return FALSE;
+
+            tmp[pos++] = value >> 8;
+            tmp[pos++] = value & 0xff;
+            value = 0;
+            digits = 0;
+            continue;
+        }
+
+        /*
+         * An embedded IPv4 address has to take up the last four bytes
+         * of the address.
+         */
+
+        if ((ch == '.') && (pos + 4 <= 16) &&
+            parse_ipv4(current_token, end, tmp + pos))
+        {
+            pos += 4;
+            digits = 0;
+            break;
+        }
+
+        return FALSE;
+    }
+
+    if (digits > 0)
+    {
+        if (pos + 2 > 16)
+            return FALSE;
+
+        tmp[pos++] = value >> 8;
+        tmp[pos++] = value & 0xff;
+    }
+
+    if (colon_pos >= 0)
+    {
+        /*
+         * Shift everything after the "::" to the end of the address,
+         * and fill in the gap with zeros.
+         */
+
+        guint  moved = pos - colon_pos;
+
+        if (pos == 16)
+            return FALSE;
+
+        memmove(tmp + 16 - moved, tmp + colon_pos, moved);
+        memset(tmp + colon_pos, 0, 16 - moved - colon_pos);
+        pos = 16;
+    }
+
+    if (pos != 16)
+        return FALSE;
+
+    memcpy(dest, tmp, sizeof(tmp));
+    return TRUE;
+}
+
+
 gboolean
-ipset_ip_from_string(ipset_ip_t *addr, const gchar *str)
+ipset_ip_parse(ipset_ip_t *addr, const gchar *str, gsize length)
 {
-    int  rc;
+    const gchar  *end = str + length;
+    guint8  ipv4[4];
 
     /*
-     * Try to parse the line as an IPv4 address.  If that works,
-     * return.
+     * Try to parse the string as an IPv4 address.  If that works,
+     * return.  We parse into a temporary buffer so that addr isn't
+     * touched unless the parse succeeds.
      */
 
-    rc = inet_pton(AF_INET, str, addr->addr);
-    if (rc == 1)
+    if (parse_ipv4(str, end, ipv4))
     {
+        memcpy(addr->addr, ipv4, sizeof(ipv4));
         addr->addr[1] = 0;
         addr->addr[2] = 0;
         addr->addr[3] = 0;
@@ -96,8 +260,7 @@ ipset_ip_from_string(ipset_ip_t *addr, const gchar *str)
      * If that didn't work, try IPv6.
      */
 
-    rc = inet_pton(AF_INET6, str, addr->addr);
-    if (rc == 1)
+    if (parse_ipv6(str, end, (guint8 *) addr->addr))
     {
         addr->is_ipv4 = FALSE;
         return TRUE;
@@ -111,38 +274,136 @@ ipset_ip_from_string(ipset_ip_t *addr, const gchar *str)
 }
 
 
-#define IPV4_BUFFER_LENGTH  (sizeof "xxx.xxx.xxx.xxx")
-static gchar IPV4_BUFFER[IPV4_BUFFER_LENGTH];
+gboolean
+ipset_ip_parse_network(ipset_ip_t *addr, guint *netmask,
+                       const gchar *str, gsize length)
+{
+    const gchar  *slash = memchr(str, '/', length);
+    const gchar  *end = str + length;
+    ipset_ip_t  parsed;
+    guint  size;
+    guint  value = 0;
+
+    /*
+     * Like ipset_ip_parse, we don't touch addr or netmask unless the
+     * whole string is valid, so we parse into a temporary first.
+     */
+
+    if (slash == NULL)
+    {
+        if (!ipset_ip_parse(&parsed, str, length))
+            return FALSE;
+
+        *addr = parsed;
+        *netmask = parsed.is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+        return TRUE;
+    }
+
+    if (!ipset_ip_parse(&parsed, str, slash - str))
+        return FALSE;
+
+    size = parsed.is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+
+    /*
+     * The prefix length has to be a decimal number no larger than the
+     * size of the address.  As with the octets of an IPv4 address, we
+     * don't allow leading zeros.
+     */
+
+    if ((slash + 1 == end) || (end - (slash + 1) > 3))
+        return FALSE;
+
+    if ((slash[1] == '0') && (slash + 2 != end))
+        return FALSE;
+
+    for (str = slash + 1; str < end; str++)
+    {
+        if (!g_ascii_isdigit(*str))
+            return FALSE;
+
+        value = value * 10 + (*str - '0');
+    }
+
+    if (value > size)
+        return FALSE;
+
+    *addr = parsed;
+    *netmask = value;
+    return TRUE;
+}
+
+
+gboolean
+ipset_ip_from_string(ipset_ip_t *addr, const gchar *str)
+{
+    return ipset_ip_parse(addr, str, strlen(str));
+}
+
+
+/*-----------------------------------------------------------------------
+ * Formatting
+ */
 
+/**
+ * Write a decimal number less than 1000, without any leading zeros.
+ * Returns a pointer just past the last digit.
+ */
 
-static void
-raw_ipv4_to_string(gchar *dest, const guint8 *bytes)
+static gchar *
+format_decimal(gchar *dest, guint value)
 {
-    g_snprintf(dest, IPV4_BUFFER_LENGTH,
-               "%u.%u.%u.%u",
-               bytes[0], bytes[1], bytes[2], bytes[3]);
+    if (value >= 100)
+        *dest++ = '0' + value / 100;
+    if (value >= 10)
+        *dest++ = '0' + (value / 10) % 10;
+    *dest++ = '0' + value % 10;
+    return dest;
 }
 
 
-static const gchar *
-ipv4_to_string(const ipset_ip_t *addr)
+static gchar *
+format_raw_ipv4(gchar *dest, const guint8 *bytes)
 {
-    raw_ipv4_to_string(IPV4_BUFFER,
-                       (const guint8 *) addr->addr);
-    return IPV4_BUFFER;
+    dest = format_decimal(dest, bytes[0]);
+    *dest++ = '.';
+    dest = format_decimal(dest, bytes[1]);
+    *dest++ = '.';
+    dest = format_decimal(dest, bytes[2]);
+    *dest++ = '.';
+    dest = format_decimal(dest, bytes[3]);
+    return dest;
 }
 
 
-#define IPV6_BUFFER_LENGTH \
-    (sizeof "ffff:ffff:ffff:ffff:ffff:ffff:255.255.255.255")
-static gchar IPV6_BUFFER[IPV6_BUFFER_LENGTH];
+static const gchar  HEX_DIGITS[] = "0123456789abcdef";
+
+
+/**
+ * Write a 16-bit value in hex, without any leading zeros.  Returns a
+ * pointer just past the last digit.
+ */
+
+static gchar *
+format_hex(gchar *dest, guint value)
+{
+    gint  shift = 12;
+
+    while ((shift > 0) && ((value >> shift) == 0))
+        shift -= 4;
+
+    for (; shift >= 0; shift -= 4)
+        *dest++ = HEX_DIGITS[(value >> shift) & 0xf];
+
+    return dest;
+}
+
 
 #define NS_IN6ADDRSZ 16
 #define NS_INT16SZ 2
 
 
-static const gchar *
-ipv6_to_string(const ipset_ip_t *addr)
+static gchar *
+format_ipv6(gchar *dest, const ipset_ip_t *addr)
 {
     const guint8  *src = (const guint8 *) addr->addr;
 
@@ -194,7 +455,7 @@ ipv6_to_string(const ipset_ip_t *addr)
     /*
      * Format the result.
      */
-    tp = IPV6_BUFFER;
+    tp = dest;
     for (i = 0; i < (NS_IN6ADDRSZ / NS_INT16SZ); i++) {
         /* Are we inside the best run of 0x00's? */
         if (best.base != -1 && i >= best.base &&
@@ -209,33 +470,63 @@ ipv6_to_string(const ipset_ip_t *addr)
         /* Is this address an encapsulated IPv4? */
         if (i == 6 && best.base == 0 &&
             (best.len == 6 || (best.len == 5 && words[5] == 0xffff))) {
-            raw_ipv4_to_string(tp, src+12);
-            tp += strlen(tp);
+            tp = format_raw_ipv4(tp, src+12);
             break;
         }
-        tp += g_sprintf(tp, "%x", words[i]);
+        tp = format_hex(tp, words[i]);
     }
     /* Was it a trailing run of 0x00's? */
     if (best.base != -1 && (best.base + best.len) ==
         (NS_IN6ADDRSZ / NS_INT16SZ))
         *tp++ = ':';
-    *tp++ = '\0';
 
     /*
      * And we're done.
      */
 
-    return IPV6_BUFFER;
+    return tp;
 }
 
 
-const gchar *
-ipset_ip_to_string(const ipset_ip_t *addr)
+static gchar *
+format_ip(gchar *dest, const ipset_ip_t *addr)
 {
     if (addr->is_ipv4)
     {
-        return ipv4_to_string(addr);
+        return format_raw_ipv4(dest, (const guint8 *) addr->addr);
     } else {
-        return ipv6_to_string(addr);
+        return format_ipv6(dest, addr);
     }
 }
+
+
+gsize
+ipset_ip_format(const ipset_ip_t *addr, gchar *buf)
+{
+    gchar  *end = format_ip(buf, addr);
+    *end = '\0';
+    return end - buf;
+}
+
+
+gsize
+ipset_ip_format_network(const ipset_ip_t *addr, guint netmask,
+                        gchar *buf)
+{
+    gchar  *end = format_ip(buf, addr);
+    *end++ = '/';
+    end = format_decimal(end, netmask);
+    *end = '\0';
+    return end - buf;
+}
+
+
+static gchar  IP_BUFFER[IPSET_IP_STRING_LENGTH];
+
+
+const gchar *
+ipset_ip_to_string(const ipset_ip_t *addr)
+{
+    ipset_ip_format(addr, IP_BUFFER);
+    return IP_BUFFER;
+}
@@ -0,0 +1,233 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+#include <ipset/logging.h>
+
+
+static guint
+address_size(const ipmap_entry_t *entry)
+{
+    return entry->addr.is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+}
+
+
+/**
+ * Compare two entries using the order that ipmap_build_from_sorted
+ * expects.  Only the network bits of each address are compared.
+ */
+
+static gint
+compare_entries(const ipmap_entry_t *entry1, const ipmap_entry_t *entry2)
+{
+    guint  netmask = MIN(entry1->netmask, entry2->netmask);
+    guint  i;
+
+    if (entry1->addr.is_ipv4 != entry2->addr.is_ipv4)
+        return entry1->addr.is_ipv4? -1: 1;
+
+    for (i = 0; i < netmask; i++)
+    {
+        gboolean  bit1 = IPSET_BIT_GET(entry1->addr.addr, i);
+        gboolean  bit2 = IPSET_BIT_GET(entry2->addr.addr, i);
+
+        if (bit1 != bit2)
+            return bit1? 1: -1;
+    }
+
+    /*
+     * One network is nested inside the other (or they're the same),
+     * so the larger network comes first.
+     */
+
+    if (entry1->netmask != entry2->netmask)
+        return (entry1->netmask < entry2->netmask)? -1: 1;
+
+    return 0;
+}
+
+
+static int
+compare_entries_qsort(const void *entry1, const void *entry2)
+{
+    return compare_entries(entry1, entry2);
+}
+
+
+static gboolean
+check_entries(const ipmap_entry_t *entries, gsize count)
+{
+    gsize  i;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((entries[i].netmask == 0) ||
+            (entries[i].netmask > address_size(&entries[i])))
+        {
+            g_d_debug("Entry %" G_GSIZE_FORMAT " has a bad netmask", i);
+            return FALSE;
+        }
+
+        if ((i > 0) && (compare_entries(&entries[i-1], &entries[i]) > 0))
+        {
+            g_d_debug("Entry %" G_GSIZE_FORMAT " is out of order", i);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/**
+ * Build the BDD for the block of addresses that share the first depth
+ * bits with the entries from first to last (exclusive).  Every
+ * network in that range is inside the block; value is the value of
+ * the innermost network that contains the whole block.
+ */
+
+static ipset_node_id_t
+build(const ipmap_entry_t *entries, gsize first, gsize last,
+      guint depth, gint value)
+{
+    gsize  middle;
+
+    /*
+     * Any networks that cover exactly this block come first, and
+     * override the value from the enclosing networks.  If there are
+     * duplicates, the last one wins.
+     */
+
+    while ((first < last) && (entries[first].netmask == depth))
+    {
+        value = entries[first].value;
+        first++;
+    }
+
+    if (first == last)
+        return ipset_node_cache_terminal(ipset_cache, value);
+
+    /*
+     * The remaining networks are all smaller than this block.  The
+     * ones in the low half come before the ones in the high half.
+     */
+
+    for (middle = first; middle < last; middle++)
+    {
+        if (IPSET_BIT_GET(entries[middle].addr.addr, depth))
+            break;
+    }
+
+    ipset_node_id_t  low =
+        build(entries, first, middle, depth + 1, value);
+    ipset_node_id_t  high =
+        build(entries, middle, last, depth + 1, value);
+
+    return ipset_node_cache_nonterminal(ipset_cache, depth + 1, low, high);
+}
+
+
+ip_map_t *
+ipmap_build_from_sorted(const ipmap_entry_t *entries, gsize count,
+                        gint default_value)
+{
+    ip_map_t  *map;
+    gsize  ipv6_start;
+
+    if (!check_entries(entries, count))
+        return NULL;
+
+    map = ipmap_new(default_value);
+    if (map == NULL)
+        return NULL;
+
+    /*
+     * The IPv4 entries come first.  Build each kind of address
+     * separately, and then join them with variable 0.
+     */
+
+    for (ipv6_start = 0; ipv6_start < count; ipv6_start++)
+    {
+        if (!entries[ipv6_start].addr.is_ipv4)
+            break;
+    }
+
+    ipset_node_id_t  ipv4_bdd =
+        build(entries, 0, ipv6_start, 0, default_value);
+    ipset_node_id_t  ipv6_bdd =
+        build(entries, ipv6_start, count, 0, default_value);
+
+    map->map_bdd = ipset_node_cache_nonterminal
+        (ipset_cache, 0, ipv6_bdd, ipv4_bdd);
+
+    return map;
+}
+
+
+void
+ipmap_ip_add_values(ip_map_t *map,
+                    const ipset_ip_t *addrs,
+                    const gint *deltas,
+                    gsize count)
+{
+    ipmap_entry_t  *entries;
+    gsize  merged;
+    gsize  i;
+
+    if (count == 0)
+        return;
+
+    /*
+     * Sort the addresses, and merge any duplicates by adding their
+     * deltas together.
+     */
+
+    entries = g_new(ipmap_entry_t, count);
+
+    for (i = 0; i < count; i++)
+    {
+        entries[i].addr = addrs[i];
+        entries[i].netmask = address_size(&entries[i]);
+        entries[i].value = deltas[i];
+    }
+
+    qsort(entries, count, sizeof(ipmap_entry_t), compare_entries_qsort);
+
+    merged = 0;
+    for (i = 1; i < count; i++)
+    {
+        if (compare_entries(&entries[merged], &entries[i]) == 0)
+        {
+            guint  sum = (guint) entries[merged].value +
+                (guint) entries[i].value;
+            entries[merged].value = sum & IPSET_TERMINAL_VALUE_MASK;
+        } else {
+            entries[++merged] = entries[i];
+        }
+    }
+    merged++;
+
+    /*
+     * Build a map of the deltas, which is 0 everywhere else, and add
+     * it to the map in a single operation.
+     */
+
+    ip_map_t  *delta_map = ipmap_build_from_sorted(entries, merged, 0);
+    ipmap_combine(map, map, delta_map, IPMAP_OPERATOR_SUM);
+
+    ipmap_free(delta_map);
+    g_free(entries);
+}
@@ -0,0 +1,88 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+
+
+/**
+ * A value with every bit that a classifier can use turned on.
+ */
+
+#define ALL_SETS  ((1u << IPMAP_CLASSIFIER_MAX_SETS) - 1)
+
+
+/**
+ * Turn a set into a BDD whose value is the set's bit for the addresses
+ * in the set, and 0 everywhere else.  A set's BDD only has 0 and 1
+ * for values, so we can use it as the condition of an ITE.
+ */
+
+static ipset_node_id_t
+shifted_set(ip_set_t *set, guint index)
+{
+    return ipset_node_cache_ite
+        (ipset_cache, set->set_bdd,
+         ipset_node_cache_terminal(ipset_cache, 1 << index),
+         ipset_node_cache_terminal(ipset_cache, 0));
+}
+
+
+gboolean
+ipmap_init_classifier(ip_map_t *map, ip_set_t **sets, guint count)
+{
+    const ipset_operator_t  *bit_or = ipmap_operator(IPMAP_OPERATOR_BIT_OR);
+    ipset_node_id_t  map_bdd;
+    guint  i;
+
+    if (count > IPMAP_CLASSIFIER_MAX_SETS)
+        return FALSE;
+
+    map_bdd = ipset_node_cache_terminal(ipset_cache, 0);
+
+    for (i = 0; i < count; i++)
+    {
+        map_bdd = ipset_node_cache_apply
+            (ipset_cache, bit_or, map_bdd, shifted_set(sets[i], i));
+    }
+
+    ipmap_init(map, 0);
+    map->map_bdd = map_bdd;
+    return TRUE;
+}
+
+
+gboolean
+ipmap_classifier_update(ip_map_t *map, guint index, ip_set_t *set)
+{
+    ipset_node_id_t  map_bdd;
+
+    if (index >= IPMAP_CLASSIFIER_MAX_SETS)
+        return FALSE;
+
+    /*
+     * Clear the set's bit by ANDing with a constant mask, and then OR
+     * in the new contents of the set.
+     */
+
+    map_bdd = ipset_node_cache_apply
+        (ipset_cache, ipmap_operator(IPMAP_OPERATOR_BIT_AND),
+         map->map_bdd,
+         ipset_node_cache_terminal(ipset_cache, ALL_SETS & ~(1u << index)));
+
+    map->map_bdd = ipset_node_cache_apply
+        (ipset_cache, ipmap_operator(IPMAP_OPERATOR_BIT_OR),
+         map_bdd, shifted_set(set, index));
+
+    return TRUE;
+}
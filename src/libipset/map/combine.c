@@ -0,0 +1,171 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+
+
+/*-----------------------------------------------------------------------
+ * Built-in operators
+ */
+
+static ipset_range_t
+sum_op(ipset_range_t lhs_value, ipset_range_t rhs_value)
+{
+    /*
+     * Terminals can only hold 31 bits, so we add modulo 2^31.  Doing
+     * the addition unsigned means it can't overflow.
+     */
+
+    guint  sum = (guint) lhs_value + (guint) rhs_value;
+    return sum & IPSET_TERMINAL_VALUE_MASK;
+}
+
+
+static ipset_range_t
+max_op(ipset_range_t lhs_value, ipset_range_t rhs_value)
+{
+    return MAX(lhs_value, rhs_value);
+}
+
+
+static ipset_range_t
+min_op(ipset_range_t lhs_value, ipset_range_t rhs_value)
+{
+    return MIN(lhs_value, rhs_value);
+}
+
+
+static ipset_range_t
+overlay_op(ipset_range_t lhs_value, ipset_range_t rhs_value)
+{
+    return (lhs_value != 0)? lhs_value: rhs_value;
+}
+
+
+static ipset_range_t
+bit_or_op(ipset_range_t lhs_value, ipset_range_t rhs_value)
+{
+    return lhs_value | rhs_value;
+}
+
+
+static ipset_range_t
+bit_and_op(ipset_range_t lhs_value, ipset_range_t rhs_value)
+{
+    return lhs_value & rhs_value;
+}
+
+
+/**
+ * The built-in operators, in the same order as their IDs.
+ */
+
+static ipset_operator_t  BUILTIN_OPERATORS[] =
+{
+    { "SUM", sum_op, TRUE },
+    { "MAX", max_op, TRUE },
+    { "MIN", min_op, TRUE },
+    { "OVERLAY", overlay_op, FALSE },
+    { "BIT_OR", bit_or_op, TRUE },
+    { "BIT_AND", bit_and_op, TRUE }
+};
+
+
+/*-----------------------------------------------------------------------
+ * Operator registry
+ */
+
+/**
+ * Every operator that ipmap_combine knows about, indexed by ID.  The
+ * node cache keys each operator's computed table by its address, so
+ * operators are never freed.
+ */
+
+static GPtrArray  *operators = NULL;
+
+
+static void
+init_operators()
+{
+    guint  i;
+
+    if (operators != NULL)
+        return;
+
+    operators = g_ptr_array_new();
+
+    for (i = 0; i < G_N_ELEMENTS(BUILTIN_OPERATORS); i++)
+        g_ptr_array_add(operators, &BUILTIN_OPERATORS[i]);
+}
+
+
+guint
+ipmap_register_operator(const gchar *name,
+                        ipset_operator_func_t func,
+                        gboolean commutative)
+{
+    ipset_operator_t  *op = g_new(ipset_operator_t, 1);
+
+    init_operators();
+
+    op->name = name;
+    op->func = func;
+    op->commutative = commutative;
+    g_ptr_array_add(operators, op);
+
+    return operators->len - 1;
+}
+
+
+/*-----------------------------------------------------------------------
+ * Combining maps
+ */
+
+const ipset_operator_t *
+ipmap_operator(guint operator_id)
+{
+    init_operators();
+
+    if (operator_id >= operators->len)
+        return NULL;
+
+    return g_ptr_array_index(operators, operator_id);
+}
+
+
+gboolean
+ipmap_combine(ip_map_t *dest, ip_map_t *map1, ip_map_t *map2,
+              guint operator_id)
+{
+    const ipset_operator_t  *op = ipmap_operator(operator_id);
+    ipset_node_id_t  default_bdd;
+    ipset_node_id_t  map_bdd;
+
+    if (op == NULL)
+        return FALSE;
+
+    /*
+     * Compute both BDDs before touching dest, since it might be one
+     * of the inputs.
+     */
+
+    default_bdd = ipset_node_cache_apply
+        (ipset_cache, op, map1->default_bdd, map2->default_bdd);
+    map_bdd = ipset_node_cache_apply
+        (ipset_cache, op, map1->map_bdd, map2->map_bdd);
+
+    dest->default_bdd = default_bdd;
+    dest->map_bdd = map_bdd;
+    return TRUE;
+}
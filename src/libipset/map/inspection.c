@@ -54,6 +54,13 @@ ipmap_memory_size(ip_map_t *map)
 }
 
 
+guint64
+ipmap_fingerprint(ip_map_t *map)
+{
+    return ipset_node_cache_fingerprint(ipset_cache, map->map_bdd);
+}
+
+
 void
 ipmap_ip_set(ip_map_t *map, ipset_ip_t *addr, gint value)
 {
@@ -81,6 +88,38 @@ ipmap_ip_set_network(ip_map_t *map,
 }
 
 
+void
+ipmap_ip_set_range(ip_map_t *map,
+                   ipset_ip_t *first,
+                   ipset_ip_t *last,
+                   gint value)
+{
+    if (first->is_ipv4 != last->is_ipv4)
+    {
+        return;
+    } else if (first->is_ipv4) {
+        ipmap_ipv4_set_range(map, first->addr, last->addr, value);
+    } else {
+        ipmap_ipv6_set_range(map, first->addr, last->addr, value);
+    }
+}
+
+
+void
+ipmap_ip_add_value(ip_map_t *map,
+                   ipset_ip_t *addr,
+                   guint netmask,
+                   gint delta)
+{
+    if (addr->is_ipv4)
+    {
+        ipmap_ipv4_add_value(map, addr->addr, netmask, delta);
+    } else {
+        ipmap_ipv6_add_value(map, addr->addr, netmask, delta);
+    }
+}
+
+
 gint
 ipmap_ip_get(ip_map_t *map, ipset_ip_t *addr)
 {
@@ -91,3 +130,15 @@ ipmap_ip_get(ip_map_t *map, ipset_ip_t *addr)
         return ipmap_ipv6_get(map, addr->addr);
     }
 }
+
+
+gint
+ipmap_ip_lookup_prefix(ip_map_t *map, ipset_ip_t *addr, guint *netmask)
+{
+    if (addr->is_ipv4)
+    {
+        return ipmap_ipv4_lookup_prefix(map, addr->addr, netmask);
+    } else {
+        return ipmap_ipv6_lookup_prefix(map, addr->addr, netmask);
+    }
+}
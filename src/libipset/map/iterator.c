@@ -0,0 +1,36 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+
+
+ipset_iterator_t *
+ipmap_iterate_networks(ip_map_t *map)
+{
+    return ipset_iterate_bdd(map->map_bdd, IPSET_MATCH_ANY,
+                             0, TRUE);
+}
+
+
+ipset_iterator_t *
+ipmap_iterate_non_default_networks(ip_map_t *map)
+{
+    /*
+     * The default BDD is a single terminal, so its value is the map's
+     * default value.
+     */
+
+    return ipset_iterate_bdd(map->map_bdd, IPSET_MATCH_NOT_EQUAL,
+                             ipset_terminal_value(map->default_bdd),
+                             TRUE);
+}
@@ -0,0 +1,72 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+
+
+typedef struct predicate_data
+{
+    ipmap_predicate_t  predicate;
+    gpointer  user_data;
+} predicate_data_t;
+
+
+static ipset_range_t
+apply_predicate(ipset_range_t value, gpointer user_data)
+{
+    predicate_data_t  *data = user_data;
+    return data->predicate(value, data->user_data)? TRUE: FALSE;
+}
+
+
+void
+ipmap_to_set(ip_set_t *set, ip_map_t *map,
+             ipmap_predicate_t predicate, gpointer user_data)
+{
+    predicate_data_t  data;
+
+    data.predicate = predicate;
+    data.user_data = user_data;
+
+    ipset_init(set);
+    set->set_bdd = ipset_node_cache_transform
+        (ipset_cache, map->map_bdd, apply_predicate, &data);
+}
+
+
+typedef struct range_data
+{
+    gint  low;
+    gint  high;
+} range_data_t;
+
+
+static gboolean
+in_range(gint value, gpointer user_data)
+{
+    range_data_t  *range = user_data;
+    return (value >= range->low) && (value <= range->high);
+}
+
+
+void
+ipmap_value_in_range(ip_set_t *set, ip_map_t *map,
+                     gint low, gint high)
+{
+    range_data_t  range;
+
+    range.low = low;
+    range.high = high;
+    ipmap_to_set(set, map, in_range, &range);
+}
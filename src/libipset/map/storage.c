@@ -33,6 +33,28 @@ ipmap_save(GOutputStream *stream,
 }
 
 
+gboolean
+ipmap_save_compressed(GOutputStream *stream,
+                      ip_map_t *map,
+                      ipset_compression_t compression,
+                      GError **err)
+{
+    return ipset_node_cache_save_compressed
+        (stream, ipset_cache, map->map_bdd, compression, err);
+}
+
+
+gboolean
+ipmap_save_fingerprinted(GOutputStream *stream,
+                         ip_map_t *map,
+                         ipset_compression_t compression,
+                         GError **err)
+{
+    return ipset_node_cache_save_fingerprinted
+        (stream, ipset_cache, map->map_bdd, compression, err);
+}
+
+
 ip_map_t *
 ipmap_load(GInputStream *stream,
            GError **err)
@@ -63,3 +85,141 @@ ipmap_load(GInputStream *stream,
     map->map_bdd = node;
     return map;
 }
+
+
+ip_map_t *
+ipmap_load_from_archive(GInputStream *stream,
+                        const gchar *name,
+                        GError **err)
+{
+    ip_map_t  *map;
+    ipset_node_id_t  node;
+
+    /*
+     * Like in ipmap_load(), it doesn't matter what default value we
+     * use here.
+     */
+
+    map = ipmap_new(0);
+    if (map == NULL) return NULL;
+
+    GError  *suberror = NULL;
+
+    node = ipset_node_cache_load_archive_entry
+        (stream, ipset_cache, name, &suberror);
+    if (suberror != NULL)
+    {
+        g_propagate_error(err, suberror);
+        ipmap_free(map);
+        return NULL;
+    }
+
+    map->map_bdd = node;
+    return map;
+}
+
+
+gboolean
+ipmap_diff_save(GOutputStream *stream,
+                ip_map_t *old_map,
+                ip_map_t *new_map,
+                GError **err)
+{
+    return ipset_node_cache_save_patch
+        (stream, ipset_cache, old_map->map_bdd, new_map->map_bdd, err);
+}
+
+
+ip_map_t *
+ipmap_patch_load(GInputStream *stream,
+                 ip_map_t *old_map,
+                 GError **err)
+{
+    ip_map_t  *map;
+    ipset_node_id_t  node;
+
+    /*
+     * Like in ipmap_load(), it doesn't matter what default value we
+     * use here.
+     */
+
+    map = ipmap_new(0);
+    if (map == NULL) return NULL;
+
+    GError  *suberror = NULL;
+
+    node = ipset_node_cache_load_patch
+        (stream, ipset_cache, old_map->map_bdd, &suberror);
+    if (suberror != NULL)
+    {
+        g_propagate_error(err, suberror);
+        ipmap_free(map);
+        return NULL;
+    }
+
+    map->map_bdd = node;
+    return map;
+}
+
+
+void
+ipmap_load_async(GInputStream *stream,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data)
+{
+    ipset_node_cache_load_async(stream, cancellable, callback, user_data);
+}
+
+
+ip_map_t *
+ipmap_load_finish(GAsyncResult *result,
+                  GError **err)
+{
+    ip_map_t  *map;
+    ipset_node_id_t  node;
+
+    /*
+     * Like in ipmap_load(), it doesn't matter what default value we
+     * use here.
+     */
+
+    map = ipmap_new(0);
+    if (map == NULL) return NULL;
+
+    GError  *suberror = NULL;
+
+    node = ipset_node_cache_load_finish
+        (ipset_cache, result, &suberror);
+    if (suberror != NULL)
+    {
+        g_propagate_error(err, suberror);
+        ipmap_free(map);
+        return NULL;
+    }
+
+    map->map_bdd = node;
+    return map;
+}
+
+
+void
+ipmap_save_async(GOutputStream *stream,
+                 ip_map_t *map,
+                 ipset_compression_t compression,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data)
+{
+    ipset_node_cache_save_async
+        (stream, ipset_cache, map->map_bdd, compression,
+         cancellable, callback, user_data);
+}
+
+
+gboolean
+ipmap_save_finish(GAsyncResult *result,
+                  GError **err)
+{
+    return ipset_node_cache_save_finish(result, err);
+}
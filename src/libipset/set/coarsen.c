@@ -0,0 +1,103 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+
+
+/**
+ * Quantify away every variable after netmask.  Since the BDD is
+ * reduced, and only has TRUE and FALSE terminals, any nonterminal
+ * leads to both.  So a nonterminal that tests one of the quantified
+ * variables can be replaced by TRUE for existential quantification,
+ * or FALSE for universal quantification.
+ */
+
+static ipset_node_id_t
+quantify(GHashTable *memo, ipset_node_id_t node_id,
+         guint netmask, ipset_node_id_t replacement)
+{
+    if (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE)
+        return node_id;
+
+    ipset_node_t  *node = ipset_nonterminal_node(node_id);
+
+    if (node->variable > netmask)
+        return replacement;
+
+    gpointer  result;
+
+    if (g_hash_table_lookup_extended(memo, node_id, NULL, &result))
+        return result;
+
+    ipset_node_id_t  low =
+        quantify(memo, node->low, netmask, replacement);
+    ipset_node_id_t  high =
+        quantify(memo, node->high, netmask, replacement);
+
+    result = ipset_node_cache_nonterminal
+        (ipset_cache, node->variable, low, high);
+    g_hash_table_insert(memo, node_id, result);
+    return result;
+}
+
+
+static ipset_node_id_t
+quantify_family(ip_set_t *set, gboolean is_ipv4,
+                guint netmask, gboolean replacement)
+{
+    GHashTable  *memo = g_hash_table_new(NULL, NULL);
+    ipset_node_id_t  result = quantify
+        (memo, ipset_family_root(set->set_bdd, is_ipv4), netmask,
+         ipset_node_cache_terminal(ipset_cache, replacement));
+
+    g_hash_table_destroy(memo);
+    return result;
+}
+
+
+static void
+coarsen(ip_set_t *dest, ip_set_t *set,
+        guint ipv4_netmask, guint ipv6_netmask,
+        gboolean replacement)
+{
+    /*
+     * The two kinds of address can have different netmasks, so we
+     * quantify each one separately, and then put them back together.
+     */
+
+    ipset_node_id_t  ipv4_bdd =
+        quantify_family(set, TRUE, ipv4_netmask, replacement);
+    ipset_node_id_t  ipv6_bdd =
+        quantify_family(set, FALSE, ipv6_netmask, replacement);
+
+    ipset_init(dest);
+    dest->set_bdd = ipset_node_cache_nonterminal
+        (ipset_cache, 0, ipv6_bdd, ipv4_bdd);
+}
+
+
+void
+ipset_coarsen_any(ip_set_t *dest, ip_set_t *set,
+                  guint ipv4_netmask, guint ipv6_netmask)
+{
+    coarsen(dest, set, ipv4_netmask, ipv6_netmask, TRUE);
+}
+
+
+void
+ipset_coarsen_all(ip_set_t *dest, ip_set_t *set,
+                  guint ipv4_netmask, guint ipv6_netmask)
+{
+    coarsen(dest, set, ipv4_netmask, ipv6_netmask, FALSE);
+}
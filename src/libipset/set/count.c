@@ -0,0 +1,50 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+
+
+ipset_node_id_t
+ipset_family_root(ipset_node_id_t set_bdd, gboolean is_ipv4)
+{
+    /*
+     * Variable 0 tells us whether an address is IPv4 (TRUE) or IPv6
+     * (FALSE).
+     */
+
+    if (ipset_node_get_type(set_bdd) == IPSET_NONTERMINAL_NODE)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(set_bdd);
+
+        if (node->variable == 0)
+            return is_ipv4? node->high: node->low;
+    }
+
+    return set_bdd;
+}
+
+
+void
+ipset_family_count(ipset_node_id_t node_id, guint depth,
+                   gboolean is_ipv4, ipset_count_t *count)
+{
+    /*
+     * Variable 0 is the address family, so the address bits are
+     * variables 1 through size.
+     */
+
+    ipset_variable_t  end =
+        (is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE) + 1;
+    ipset_node_cache_count(ipset_cache, node_id, depth + 1, end, count);
+}
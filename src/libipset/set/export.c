@@ -0,0 +1,304 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/logging.h>
+
+
+/**
+ * The depth at which we split the BDD into independent subtrees.  IPv6
+ * sets tend to be concentrated in a small part of the address space,
+ * so we split them further down.  Only the subtrees that actually
+ * exist in the BDD become jobs, so a deep split doesn't cost anything
+ * for a sparse set.
+ */
+
+#define IPV4_PARTITION_DEPTH  16
+#define IPV6_PARTITION_DEPTH  32
+
+
+/**
+ * The number of jobs per thread that we let the workers get ahead of
+ * the writer.  This bounds the amount of formatted output that's held
+ * in memory at any one time.
+ */
+
+#define JOBS_PER_THREAD  4
+
+
+/**
+ * One subtree of the BDD, and the formatted text of its contents.
+ */
+
+typedef struct export_job
+{
+    ipset_ip_t  addr;
+    guint  netmask;
+    GString  *output;
+    gboolean  done;
+} export_job_t;
+
+
+typedef struct export_state
+{
+    ip_set_t  *set;
+    gboolean  summarize;
+    GMutex  lock;
+    GCond  job_done;
+} export_state_t;
+
+
+/**
+ * Walk down the BDD until we reach the partition depth, and add a job
+ * for each subtree that might contain some addresses.  Jobs are added
+ * in the same order that the set iterator would visit them.  When
+ * we're summarizing, a terminal above the partition depth is a single
+ * network, and so it becomes a single job.  Otherwise we keep
+ * splitting it, so that no job has to format more individual
+ * addresses than a subtree at the partition depth.
+ */
+
+static void
+collect_jobs(GArray *jobs,
+             ipset_node_id_t node_id,
+             ipset_ip_t *addr,
+             guint depth,
+             guint partition_depth,
+             gboolean summarize)
+{
+    gboolean  is_terminal =
+        (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE);
+
+    if (is_terminal && !ipset_terminal_value(node_id))
+        return;
+
+    if ((is_terminal && summarize) || (depth == partition_depth))
+    {
+        export_job_t  job;
+
+        job.addr = *addr;
+        job.netmask = depth;
+        job.output = NULL;
+        job.done = FALSE;
+        g_array_append_val(jobs, job);
+        return;
+    }
+
+    /*
+     * If the BDD skips over this bit (or has already reached a
+     * terminal), both branches lead to the same node.
+     */
+
+    ipset_node_id_t  low = node_id;
+    ipset_node_id_t  high = node_id;
+
+    if (!is_terminal)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(node_id);
+
+        if (node->variable == depth + 1)
+        {
+            low = node->low;
+            high = node->high;
+        }
+    }
+
+    IPSET_BIT_SET(addr->addr, depth, FALSE);
+    collect_jobs(jobs, low, addr, depth + 1, partition_depth, summarize);
+
+    IPSET_BIT_SET(addr->addr, depth, TRUE);
+    collect_jobs(jobs, high, addr, depth + 1, partition_depth, summarize);
+
+    IPSET_BIT_SET(addr->addr, depth, FALSE);
+}
+
+
+static void
+collect_address_kind(GArray *jobs, ip_set_t *set, gboolean is_ipv4,
+                     gboolean summarize)
+{
+    ipset_node_id_t  root = set->set_bdd;
+    ipset_ip_t  addr;
+
+    /*
+     * Variable 0 tells us whether an address is IPv4 (TRUE) or IPv6
+     * (FALSE).
+     */
+
+    if (ipset_node_get_type(root) == IPSET_NONTERMINAL_NODE)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(root);
+
+        if (node->variable == 0)
+            root = is_ipv4? node->high: node->low;
+    }
+
+    memset(&addr, 0, sizeof(ipset_ip_t));
+    addr.is_ipv4 = is_ipv4;
+
+    collect_jobs(jobs, root, &addr, 0,
+                 is_ipv4? IPV4_PARTITION_DEPTH: IPV6_PARTITION_DEPTH,
+                 summarize);
+}
+
+
+static void
+run_job(export_job_t *job, export_state_t *state)
+{
+    ipset_iterator_t  *it;
+    gchar  buf[IPSET_NETWORK_STRING_LENGTH];
+
+    job->output = g_string_new(NULL);
+
+    for (it = ipset_iterate_within(state->set, &job->addr, job->netmask,
+                                   TRUE, state->summarize);
+         !it->finished;
+         ipset_iterator_advance(it))
+    {
+        gsize  length = state->summarize?
+            ipset_ip_format_network(&it->addr, it->netmask, buf):
+            ipset_ip_format(&it->addr, buf);
+
+        g_string_append_len(job->output, buf, length);
+        g_string_append_c(job->output, '\n');
+    }
+
+    ipset_iterator_free(it);
+}
+
+
+static void
+export_thread(gpointer data, gpointer user_data)
+{
+    export_job_t  *job = data;
+    export_state_t  *state = user_data;
+
+    run_job(job, state);
+
+    g_mutex_lock(&state->lock);
+    job->done = TRUE;
+    g_cond_broadcast(&state->job_done);
+    g_mutex_unlock(&state->lock);
+}
+
+
+gboolean
+ipset_export(GOutputStream *stream,
+             ip_set_t *set,
+             gboolean summarize,
+             guint thread_count,
+             GError **err)
+{
+    gboolean  result = TRUE;
+    GThreadPool  *pool = NULL;
+    export_state_t  state;
+    GArray  *jobs;
+    guint  window;
+    guint  i;
+
+    state.set = set;
+    state.summarize = summarize;
+    g_mutex_init(&state.lock);
+    g_cond_init(&state.job_done);
+
+    jobs = g_array_new(FALSE, FALSE, sizeof(export_job_t));
+    collect_address_kind(jobs, set, TRUE, summarize);
+    collect_address_kind(jobs, set, FALSE, summarize);
+
+    g_d_debug("Exporting %u subtrees with %u threads",
+              jobs->len, thread_count);
+
+    window = thread_count * JOBS_PER_THREAD;
+
+    if (thread_count > 1)
+    {
+        pool = g_thread_pool_new(export_thread, &state,
+                                 thread_count, TRUE, err);
+
+        if (pool == NULL)
+        {
+            result = FALSE;
+            goto done;
+        }
+
+        for (i = 0; (i < window) && (i < jobs->len); i++)
+        {
+            g_thread_pool_push
+                (pool, &g_array_index(jobs, export_job_t, i), NULL);
+        }
+    }
+
+    /*
+     * Write out each job's output in order, waiting for the workers
+     * to finish them as needed.  Each time we write out a job, we let
+     * the workers start on another one.
+     */
+
+    for (i = 0; i < jobs->len; i++)
+    {
+        export_job_t  *job = &g_array_index(jobs, export_job_t, i);
+
+        if (pool == NULL)
+        {
+            run_job(job, &state);
+        } else {
+            g_mutex_lock(&state.lock);
+            while (!job->done)
+                g_cond_wait(&state.job_done, &state.lock);
+            g_mutex_unlock(&state.lock);
+
+            if (i + window < jobs->len)
+            {
+                g_thread_pool_push
+                    (pool, &g_array_index(jobs, export_job_t, i + window),
+                     NULL);
+            }
+        }
+
+        result = g_output_stream_write_all
+            (stream, job->output->str, job->output->len,
+             NULL, NULL, err);
+
+        g_string_free(job->output, TRUE);
+        job->output = NULL;
+
+        if (!result)
+            break;
+    }
+
+  done:
+    /*
+     * If we stopped early, drop any jobs that haven't started yet, and
+     * wait for the rest before freeing their output.
+     */
+
+    if (pool != NULL)
+        g_thread_pool_free(pool, TRUE, TRUE);
+
+    for (i = 0; i < jobs->len; i++)
+    {
+        export_job_t  *job = &g_array_index(jobs, export_job_t, i);
+
+        if (job->output != NULL)
+            g_string_free(job->output, TRUE);
+    }
+
+    g_array_free(jobs, TRUE);
+    g_mutex_clear(&state.lock);
+    g_cond_clear(&state.job_done);
+
+    return result;
+}
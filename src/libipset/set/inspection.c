@@ -47,12 +47,93 @@ ipset_is_not_equal(ip_set_t *set1, ip_set_t *set2)
     return (set1->set_bdd != set2->set_bdd);
 }
 
+gboolean
+ipset_is_subset(ip_set_t *set1, ip_set_t *set2)
+{
+    return ipset_node_implies(set1->set_bdd, set2->set_bdd);
+}
+
+gboolean
+ipset_is_disjoint(ip_set_t *set1, ip_set_t *set2)
+{
+    return ipset_node_disjoint(set1->set_bdd, set2->set_bdd);
+}
+
+void
+ipset_intersection_count(ip_set_t *set1, ip_set_t *set2,
+                         ipset_count_t *count)
+{
+    ipset_count_t  ipv6_count;
+
+    /*
+     * Count each kind of address separately, so that each count only
+     * covers the bits that its addresses have.
+     */
+
+    ipset_node_and_count(ipset_family_root(set1->set_bdd, TRUE),
+                         ipset_family_root(set2->set_bdd, TRUE),
+                         1, IPV4_BIT_SIZE + 1, count);
+
+    ipset_node_and_count(ipset_family_root(set1->set_bdd, FALSE),
+                         ipset_family_root(set2->set_bdd, FALSE),
+                         1, IPV6_BIT_SIZE + 1, &ipv6_count);
+    ipset_count_add(count, count, &ipv6_count);
+}
+
+ipset_network_relation_t
+ipset_network_relation(ip_set_t *set, ipset_ip_t *addr, guint netmask)
+{
+    ipset_node_id_t  node_id =
+        ipset_family_root(set->set_bdd, addr->is_ipv4);
+    guint  size = addr->is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+    guint  depth;
+
+    netmask = MIN(netmask, size);
+
+    /*
+     * Follow the network's bits down the BDD.  If we reach a terminal
+     * early, the rest of the network has the same value.
+     */
+
+    for (depth = 0;
+         (depth < netmask) &&
+         (ipset_node_get_type(node_id) == IPSET_NONTERMINAL_NODE);
+         depth++)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(node_id);
+
+        if (node->variable == depth + 1)
+        {
+            node_id = IPSET_BIT_GET(addr->addr, depth)?
+                node->high: node->low;
+        }
+    }
+
+    /*
+     * Whatever is left describes the addresses in the network.  Since
+     * BDDs are reduced, a nonterminal always leads to both TRUE and
+     * FALSE.
+     */
+
+    if (ipset_node_get_type(node_id) == IPSET_NONTERMINAL_NODE)
+        return IPSET_NETWORK_SOME;
+
+    return ipset_terminal_value(node_id)?
+        IPSET_NETWORK_ALL: IPSET_NETWORK_NONE;
+}
+
 gsize
 ipset_memory_size(ip_set_t *set)
 {
     return ipset_node_memory_size(set->set_bdd);
 }
 
+guint64
+ipset_fingerprint(ip_set_t *set)
+{
+    return ipset_node_cache_fingerprint(ipset_cache, set->set_bdd);
+}
+
 
 gboolean
 ipset_ip_add(ip_set_t *set, ipset_ip_t *addr)
@@ -77,3 +158,16 @@ ipset_ip_add_network(ip_set_t *set, ipset_ip_t *addr, guint netmask)
     }
 }
 
+
+gboolean
+ipset_ip_add_range(ip_set_t *set, ipset_ip_t *first, ipset_ip_t *last)
+{
+    if (first->is_ipv4 != last->is_ipv4)
+    {
+        return TRUE;
+    } else if (first->is_ipv4) {
+        return ipset_ipv4_add_range(set, first->addr, last->addr);
+    } else {
+        return ipset_ipv6_add_range(set, first->addr, last->addr);
+    }
+}
@@ -17,366 +17,357 @@
 #include <ipset/logging.h>
 
 
-/* Forward declarations */
+/**
+ * Get and set individual bits of the iterator's current address.  Bit
+ * 0 is the most significant bit of the address.
+ */
 
-static void
-process_assignment(ipset_iterator_t *iterator);
+#define BIT_WORD(i)   ((i) / 32)
+#define BIT_MASK(i)   (((guint32) 0x80000000) >> ((i) % 32))
 
-static void
-expand_ipv6(ipset_iterator_t *iterator);
+#define GET_BIT(iterator, i) \
+    (((iterator)->bits[BIT_WORD(i)] & BIT_MASK(i)) != 0)
+
+#define SET_BIT(iterator, i) \
+    ((iterator)->bits[BIT_WORD(i)] |= BIT_MASK(i))
+
+#define CLEAR_BIT(iterator, i) \
+    ((iterator)->bits[BIT_WORD(i)] &= ~BIT_MASK(i))
 
 
 /**
- * Find the highest non-EITHER bit in an assignment, starting from the
- * given bit index.
+ * Return the number of address bits in the current address.
  */
 
-static guint
-find_last_non_either_bit(ipset_assignment_t *assignment,
-                         guint starting_bit)
+static inline guint
+address_size(ipset_iterator_t *iterator)
 {
-    guint  i;
-
-    for (i = starting_bit; i >= 1; i--)
-    {
-        ipset_tribool_t  value = ipset_assignment_get(assignment, i);
-        if (value != IPSET_EITHER)
-        {
-            return i;
-        }
-    }
-
-    return 0;
+    return iterator->addr.is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
 }
 
 
 /**
- * Create a generic IP address object from the current expanded
- * assignment.
+ * Return the node that we should start walking from for the current
+ * kind of address.  Variable 0 tells us whether an address is IPv4
+ * (TRUE) or IPv6 (FALSE).
  */
 
-static void
-create_ip_address(ipset_iterator_t *iterator)
+static ipset_node_id_t
+address_root(ipset_iterator_t *iterator)
 {
-    ipset_ip_t  *addr = &iterator->addr;
-    ipset_expanded_assignment_t  *exp =
-        iterator->assignment_iterator;
-
-    /*
-     * Check variable 0 to see if this is an IPv4 or IPv6 address.
-     */
+    ipset_node_id_t  root = iterator->root;
 
-    addr->is_ipv4 = IPSET_BIT_GET(exp->values->data, 0);
-
-    /*
-     * Initialize the address to all 0 bits.
-     */
-
-    memset(addr->addr, 0, sizeof(guint32) * 4);
-
-    /*
-     * Copy bits from the expanded assignment.  The number of bits to
-     * copy is given as the current netmask.  We'll have calculated
-     * that already based on the non-expanded assignment.
-     */
-
-    guint  i;
-    for (i = 0; i < iterator->netmask; i++)
+    if (ipset_node_get_type(root) == IPSET_NONTERMINAL_NODE)
     {
-        IPSET_BIT_SET(addr->addr, i,
-                      IPSET_BIT_GET(exp->values->data, i+1));
+        ipset_node_t  *node = ipset_nonterminal_node(root);
+
+        if (node->variable == 0)
+        {
+            return iterator->addr.is_ipv4? node->high: node->low;
+        }
     }
 
-    g_d_debug("Current IP address is %s/%u",
-              ipset_ip_to_string(addr), iterator->netmask);
+    return root;
 }
 
 
 /**
- * Advance the BDD iterator, taking into account that some assignments
- * need to be expanded twice.
+ * Return whether a terminal node has a value that the iterator should
+ * return.
  */
 
-static void
-advance_assignment(ipset_iterator_t *iterator)
+static inline gboolean
+matches(ipset_iterator_t *iterator, ipset_node_id_t node_id)
 {
-    /*
-     * Check the current state of the iterator to determine how to
-     * advance.
-     */
-
-    /*
-     * In most cases, the assignment we just finished only needed to
-     * be expanded once.  So we move on to the next assignment and
-     * process it.
-     */
-
-    if (G_LIKELY(iterator->multiple_expansion_state ==
-                 IPSET_ITERATOR_NORMAL))
+    switch (iterator->match)
     {
-        ipset_bdd_iterator_advance(iterator->bdd_iterator);
-        process_assignment(iterator);
-        return;
-    }
+      case IPSET_MATCH_EQUAL:
+        return ipset_terminal_value(node_id) == iterator->desired_value;
 
-    /*
-     * If the assignment needs to be expanded twice, we'll do the IPv4
-     * expansion first.  If that's what we've just finished, do the
-     * IPv6 expansion next.
-     */
+      case IPSET_MATCH_NOT_EQUAL:
+        return ipset_terminal_value(node_id) != iterator->desired_value;
 
-    if (iterator->multiple_expansion_state ==
-        IPSET_ITERATOR_MULTIPLE_IPV4)
-    {
-        g_d_debug("Expanding IPv6 second");
-
-        iterator->multiple_expansion_state =
-            IPSET_ITERATOR_MULTIPLE_IPV6;
-        ipset_assignment_set
-            (iterator->bdd_iterator->assignment,
-             0, IPSET_FALSE);
-        expand_ipv6(iterator);
-        return;
+      default:
+        return TRUE;
     }
+}
 
-    /*
-     * If we've just finished the IPv6 expansion, then we've finished
-     * with this assignment.  Before moving on to the next one, we
-     * have to reset variable 0 to EITHER (which it was before we
-     * started this whole mess).
-     */
 
-    if (iterator->multiple_expansion_state ==
-        IPSET_ITERATOR_MULTIPLE_IPV6)
+/**
+ * Return the node that we reach by following one branch from the node
+ * at a particular depth.  If the node doesn't test the variable for
+ * that depth, then the BDD skipped over the variable, and both
+ * branches lead back to the same node.
+ */
+
+static inline ipset_node_id_t
+follow(ipset_node_id_t node_id, guint depth, gboolean value)
+{
+    if (ipset_node_get_type(node_id) == IPSET_NONTERMINAL_NODE)
     {
-        g_d_debug("Finished both expansions");
+        ipset_node_t  *node = ipset_nonterminal_node(node_id);
 
-        ipset_assignment_set
-            (iterator->bdd_iterator->assignment,
-             0, IPSET_EITHER);
-        ipset_bdd_iterator_advance(iterator->bdd_iterator);
-        process_assignment(iterator);
-        return;
+        if (node->variable == depth + 1)
+        {
+            return value? node->high: node->low;
+        }
     }
+
+    return node_id;
 }
 
 
 /**
- * Process the current expanded assignment in the current BDD
- * assignment.
+ * Fill in the iterator's public address from the first netmask bits
+ * of the current address.
  */
 
 static void
-process_expanded_assignment(ipset_iterator_t *iterator)
+create_ip_address(ipset_iterator_t *iterator)
 {
-    if (iterator->assignment_iterator->finished)
-    {
-        /*
-         * If there isn't anything in the expanded assignment, advance
-         * to the next BDD assignment.
-         */
-
-        g_d_debug("Expanded assignment is finished");
+    guint  i;
 
-        ipset_expanded_assignment_free(iterator->assignment_iterator);
-        iterator->assignment_iterator = NULL;
+    for (i = 0; i < 4; i++)
+    {
+        gint  covered = (gint) iterator->netmask - (gint) (i * 32);
+        guint32  mask;
 
-        advance_assignment(iterator);
-    } else {
-        /*
-         * Otherwise, we've found a fully expanded assignment, so
-         * create an IP address for it and return.
-         */
+        if (covered <= 0)
+            mask = 0;
+        else if (covered >= 32)
+            mask = 0xffffffff;
+        else
+            mask = ~(((guint32) 0xffffffff) >> covered);
 
-        create_ip_address(iterator);
+        iterator->addr.addr[i] = g_htonl(iterator->bits[i] & mask);
     }
+
+#ifndef NDEBUG
+    gchar  buf[IPSET_NETWORK_STRING_LENGTH];
+    ipset_ip_format_network(&iterator->addr, iterator->netmask, buf);
+    g_d_debug("Current IP address is %s", buf);
+#endif
 }
 
 
 /**
- * Expand the current assignment as IPv4 addresses.
+ * Walk down from a node at the given depth, always taking the low
+ * branch, until we reach a terminal.  Returns whether we found a
+ * result; either way, the netmask field is left at the depth where
+ * we stopped.
  */
 
-static void
-expand_ipv4(ipset_iterator_t *iterator)
+static gboolean
+descend(ipset_iterator_t *iterator,
+        ipset_node_id_t node_id,
+        guint depth)
 {
-    guint  last_bit;
+    guint  size = address_size(iterator);
 
-    if (iterator->summarize)
+    while (depth < size)
     {
-        last_bit = find_last_non_either_bit
-            (iterator->bdd_iterator->assignment,
-             IPV4_BIT_SIZE);
+        if (ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE)
+        {
+            /*
+             * If this terminal has the wrong value, there aren't any
+             * results below this point.  Otherwise, we can stop here
+             * if we're summarizing; if not, we have to keep going
+             * until we've filled in every bit of the address.
+             */
 
-        g_d_debug("Last non-either bit is %u", last_bit);
-    } else {
-        last_bit = IPV4_BIT_SIZE;
+            if (!matches(iterator, node_id))
+            {
+                iterator->netmask = depth;
+                return FALSE;
+            }
+
+            if (iterator->summarize)
+                break;
+        }
+
+        iterator->path[depth] = node_id;
+        CLEAR_BIT(iterator, depth);
+        node_id = follow(node_id, depth, FALSE);
+        depth++;
     }
 
-    iterator->assignment_iterator =
-        ipset_assignment_expand
-        (iterator->bdd_iterator->assignment,
-         last_bit + 1);
-    iterator->netmask = last_bit;
+    iterator->netmask = depth;
+
+    if ((ipset_node_get_type(node_id) != IPSET_TERMINAL_NODE) ||
+        !matches(iterator, node_id))
+    {
+        return FALSE;
+    }
 
-    process_expanded_assignment(iterator);
+    iterator->value = ipset_terminal_value(node_id);
+    create_ip_address(iterator);
+    return TRUE;
 }
 
 
 /**
- * Expand the current assignment as IPv4 addresses.
+ * Start walking the paths for the current kind of address.  Returns
+ * whether we found a result.
  */
 
-static void
-expand_ipv6(ipset_iterator_t *iterator)
+static gboolean
+start_address_kind(ipset_iterator_t *iterator)
 {
-    guint  last_bit;
-
-    if (iterator->summarize)
-    {
-        last_bit = find_last_non_either_bit
-            (iterator->bdd_iterator->assignment,
-             IPV6_BIT_SIZE);
+    g_d_debug("Iterating %s addresses",
+              iterator->addr.is_ipv4? "IPv4": "IPv6");
 
-        g_d_debug("Last non-either bit is %u", last_bit);
-    } else {
-        last_bit = IPV6_BIT_SIZE;
-    }
-
-    iterator->assignment_iterator =
-        ipset_assignment_expand
-        (iterator->bdd_iterator->assignment,
-         last_bit + 1);
-    iterator->netmask = last_bit;
-
-    process_expanded_assignment(iterator);
+    memset(iterator->bits, 0, sizeof(iterator->bits));
+    return descend(iterator, address_root(iterator), 0);
 }
 
 
 /**
- * Process the current assignment in the BDD iterator.
+ * Find the next result, starting from the current netmask.  We
+ * backtrack to the deepest bit whose high branch we haven't tried
+ * yet, and then walk down from there.
  */
 
 static void
-process_assignment(ipset_iterator_t *iterator)
+find_next(ipset_iterator_t *iterator)
 {
-    while (!iterator->bdd_iterator->finished)
+    while (TRUE)
     {
-        if (iterator->bdd_iterator->value ==
-            iterator->desired_value)
+        guint  depth = iterator->netmask;
+
+        while ((depth > iterator->base_depth) &&
+               GET_BIT(iterator, depth-1))
+        {
+            depth--;
+        }
+
+        if (depth <= iterator->base_depth)
         {
             /*
-             * If the BDD iterator hasn't finished, and the result of
-             * the function with this assignment matches what the
-             * caller wants, then we've found an assignment to
-             * generate IP addresses from.
-             *
-             * Try to expand this assignment, and process the first
-             * expanded assignment.  We want 32 + 1 variables if the
-             * current address is IPv4; 128 + 1 if it's IPv6.
+             * We've tried every path for this kind of address.  After
+             * IPv4, move on to IPv6; after IPv6, we're done.  If we're
+             * restricted to a single network, then we're done once
+             * we've tried every path in that network.
              */
 
-            g_d_debug("Got a matching BDD assignment");
-
-            ipset_tribool_t  address_type = ipset_assignment_get
-                (iterator->bdd_iterator->assignment, 0);
-
-            if (address_type == IPSET_FALSE)
+            if (iterator->addr.is_ipv4 && !iterator->restricted)
             {
-                /*
-                 * FALSE means IPv6
-                 */
-
-                g_d_debug("Assignment is IPv6");
-                iterator->multiple_expansion_state =
-                    IPSET_ITERATOR_NORMAL;
-                expand_ipv6(iterator);
-                return;
-            } else if (address_type == IPSET_TRUE) {
-                /*
-                 * TRUE means IPv4
-                 */
-
-                g_d_debug("Assignment is IPv4");
-                iterator->multiple_expansion_state =
-                    IPSET_ITERATOR_NORMAL;
-                expand_ipv4(iterator);
-                return;
-            } else {
-                /*
-                 * EITHER means that this assignment contains both
-                 * IPv4 and IPv6 addresses.  Expand it as IPv4 first.
-                 */
-
-                g_d_debug("Assignment is both IPv4 and IPv6");
-                g_d_debug("Expanding IPv4 first");
-
-                iterator->multiple_expansion_state =
-                    IPSET_ITERATOR_MULTIPLE_IPV4;
-                ipset_assignment_set
-                    (iterator->bdd_iterator->assignment,
-                     0, IPSET_TRUE);
-                expand_ipv4(iterator);
-                return;
+                iterator->addr.is_ipv4 = FALSE;
+                if (start_address_kind(iterator))
+                    return;
+                continue;
             }
+
+            g_d_debug("Set iterator is finished");
+            iterator->finished = TRUE;
+            return;
         }
 
-        /*
-         * The BDD iterator has a value, but it doesn't match the one
-         * we want.  Advance the BDD iterator and try again.
-         */
+        depth--;
+        SET_BIT(iterator, depth);
 
-        g_d_debug("Value is %d, skipping",
-                  iterator->bdd_iterator->value);
-        ipset_bdd_iterator_advance(iterator->bdd_iterator);
+        if (descend(iterator,
+                    follow(iterator->path[depth], depth, TRUE),
+                    depth + 1))
+        {
+            return;
+        }
     }
+}
 
-    /*
-     * If we fall through, then the BDD iterator has finished.  That
-     * means there's nothing left for the set iterator.
-     */
 
-    g_d_debug("Set iterator is finished");
+/**
+ * Walk down the BDD along the path for the first depth bits of a
+ * particular address, without trying any of the other branches.
+ * Then walk down from there as usual.  Returns whether we found a
+ * result.
+ *
+ * Any branch that we skip because the address has a 1 bit is less
+ * than the address, and won't be visited when we backtrack, since its
+ * bit is already set.  Any branch that we skip because the address
+ * has a 0 bit is greater than the address, and will be visited when
+ * we backtrack.
+ */
+
+static gboolean
+seek(ipset_iterator_t *iterator,
+     ipset_ip_t *addr,
+     guint depth)
+{
+    ipset_node_id_t  node_id;
+    guint  i;
+
+    iterator->addr.is_ipv4 = addr->is_ipv4;
+
+    for (i = 0; i < 4; i++)
+    {
+        iterator->bits[i] = g_ntohl(addr->addr[i]);
+    }
+
+#ifndef NDEBUG
+    gchar  buf[IPSET_NETWORK_STRING_LENGTH];
+    ipset_ip_format_network(addr, depth, buf);
+    g_d_debug("Seeking to %s", buf);
+#endif
 
-    ipset_expanded_assignment_free(iterator->assignment_iterator);
-    iterator->assignment_iterator = NULL;
+    node_id = address_root(iterator);
 
-    ipset_bdd_iterator_free(iterator->bdd_iterator);
-    iterator->bdd_iterator = NULL;
+    for (i = 0; i < depth; i++)
+    {
+        if ((ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE) &&
+            !matches(iterator, node_id))
+        {
+            /*
+             * There aren't any results below this point, so start
+             * backtracking from here.
+             */
+
+            iterator->netmask = i;
+            return FALSE;
+        }
 
-    iterator->finished = TRUE;
+        iterator->path[i] = node_id;
+        node_id = follow(node_id, i, GET_BIT(iterator, i));
+    }
+
+    return descend(iterator, node_id, depth);
 }
 
 
 static ipset_iterator_t *
-create_iterator(ip_set_t *set, gboolean desired_value,
-                gboolean summarize)
+new_iterator(ipset_node_id_t root,
+             ipset_iterator_match_t match,
+             gint desired_value,
+             gboolean summarize)
 {
-    /*
-     * First allocate the iterator itself.
-     */
-
     ipset_iterator_t  *iterator;
 
     iterator = g_slice_new(ipset_iterator_t);
     iterator->finished = FALSE;
-    iterator->assignment_iterator = NULL;
     iterator->desired_value = desired_value;
+    iterator->match = match;
     iterator->summarize = summarize;
+    iterator->root = root;
+    iterator->restricted = FALSE;
+    iterator->base_depth = 0;
+    iterator->addr.is_ipv4 = TRUE;
+    return iterator;
+}
 
-    /*
-     * Then create the iterator that returns each BDD assignment.
-     */
 
-    g_d_debug("Iterating set");
-    iterator->bdd_iterator = ipset_node_iterate(set->set_bdd);
+ipset_iterator_t *
+ipset_iterate_bdd(ipset_node_id_t root,
+                  ipset_iterator_match_t match,
+                  gint desired_value,
+                  gboolean summarize)
+{
+    ipset_iterator_t  *iterator =
+        new_iterator(root, match, desired_value, summarize);
 
-    /*
-     * Then drill down from the current BDD assignment, creating an
-     * expanded assignment for it.
-     */
+    g_d_debug("Iterating BDD");
+
+    if (!start_address_kind(iterator))
+        find_next(iterator);
 
-    process_assignment(iterator);
     return iterator;
 }
 
@@ -384,14 +375,79 @@ create_iterator(ip_set_t *set, gboolean desired_value,
 ipset_iterator_t *
 ipset_iterate(ip_set_t *set, gboolean desired_value)
 {
-    return create_iterator(set, desired_value, FALSE);
+    return ipset_iterate_bdd(set->set_bdd, IPSET_MATCH_EQUAL,
+                             desired_value, FALSE);
 }
 
 
 ipset_iterator_t *
 ipset_iterate_networks(ip_set_t *set, gboolean desired_value)
 {
-    return create_iterator(set, desired_value, TRUE);
+    return ipset_iterate_bdd(set->set_bdd, IPSET_MATCH_EQUAL,
+                             desired_value, TRUE);
+}
+
+
+ipset_iterator_t *
+ipset_iterate_from(ip_set_t *set, ipset_ip_t *addr,
+                   gboolean desired_value, gboolean summarize)
+{
+    ipset_iterator_t  *iterator =
+        new_iterator(set->set_bdd, IPSET_MATCH_EQUAL,
+                     desired_value, summarize);
+
+    /*
+     * We only have to follow the address's path down to its last 1
+     * bit.  Everything below that point is greater than or equal to
+     * the address, so we can walk it as usual.
+     */
+
+    guint  depth = addr->is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+
+    while ((depth > 0) &&
+           ((g_ntohl(addr->addr[BIT_WORD(depth-1)]) &
+             BIT_MASK(depth-1)) == 0))
+    {
+        depth--;
+    }
+
+    if (!seek(iterator, addr, depth))
+        find_next(iterator);
+
+    return iterator;
+}
+
+
+ipset_iterator_t *
+ipset_iterate_within(ip_set_t *set, ipset_ip_t *addr, guint netmask,
+                     gboolean desired_value, gboolean summarize)
+{
+    guint  size = addr->is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+    g_return_val_if_fail(netmask <= size, NULL);
+
+    ipset_iterator_t  *iterator =
+        new_iterator(set->set_bdd, IPSET_MATCH_EQUAL,
+                     desired_value, summarize);
+    iterator->restricted = TRUE;
+    iterator->base_depth = netmask;
+
+    /*
+     * Clear out any host bits in the address before seeking to the
+     * start of the network.
+     */
+
+    ipset_ip_t  network = *addr;
+    guint  i;
+
+    for (i = netmask; i < size; i++)
+    {
+        IPSET_BIT_SET(network.addr, i, FALSE);
+    }
+
+    if (!seek(iterator, &network, netmask))
+        find_next(iterator);
+
+    return iterator;
 }
 
 
@@ -401,8 +457,6 @@ ipset_iterator_free(ipset_iterator_t *iterator)
     if (iterator == NULL)
         return;
 
-    ipset_bdd_iterator_free(iterator->bdd_iterator);
-    ipset_expanded_assignment_free(iterator->assignment_iterator);
     g_slice_free(ipset_iterator_t, iterator);
 }
 
@@ -419,13 +473,137 @@ ipset_iterator_advance(ipset_iterator_t *iterator)
         return;
     }
 
+    g_d_debug("Advancing set iterator");
+    find_next(iterator);
+}
+
+
+gsize
+ipset_iterator_next_batch(ipset_iterator_t *iterator,
+                          ipset_ip_t *addrs,
+                          guint *netmasks,
+                          gsize count)
+{
+    gsize  i;
+
+    for (i = 0; (i < count) && !iterator->finished; i++)
+    {
+        addrs[i] = iterator->addr;
+
+        if (netmasks != NULL)
+            netmasks[i] = iterator->netmask;
+
+        find_next(iterator);
+    }
+
+    return i;
+}
+
+
+/**
+ * Fill in the host-order words of the last address in a network.
+ */
+
+static void
+network_last(const ipset_ip_t *addr, guint netmask, guint32 *last)
+{
+    guint  size = addr->is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+    guint  i;
+
+    for (i = 0; i < 4; i++)
+    {
+        gint  start = (gint) netmask - (gint) (i * 32);
+        gint  end = (gint) size - (gint) (i * 32);
+        guint32  host_mask;
+
+        if (end <= 0)
+            host_mask = 0;
+        else if (start <= 0)
+            host_mask = 0xffffffff;
+        else if (start >= 32)
+            host_mask = 0;
+        else
+            host_mask = ((guint32) 0xffffffff) >> start;
+
+        last[i] = g_ntohl(addr->addr[i]) | host_mask;
+    }
+}
+
+
+/**
+ * Return whether addr is the address immediately after last.
+ */
+
+static gboolean
+is_next_address(const guint32 *last, const ipset_ip_t *addr)
+{
+    guint32  next[4];
+    gboolean  carry = TRUE;
+    gint  i;
+
     /*
-     * Otherwise, advance the expanded assignment iterator to the next
-     * assignment, and then drill down into it.
+     * An IPv4 address only uses the first word.
      */
 
-    g_d_debug("Advancing set iterator");
+    memcpy(next, last, sizeof(next));
+
+    for (i = addr->is_ipv4? 0: 3; i >= 0; i--)
+    {
+        next[i] = last[i] + (carry? 1: 0);
+        carry = carry && (next[i] == 0);
+    }
+
+    /*
+     * If we wrapped around, there's nothing after last.
+     */
+
+    if (carry)
+        return FALSE;
+
+    for (i = 0; i < 4; i++)
+    {
+        if (g_ntohl(addr->addr[i]) != next[i])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+gboolean
+ipset_iterator_next_range(ipset_iterator_t *iterator,
+                          ipset_ip_t *first,
+                          ipset_ip_t *last)
+{
+    guint32  end[4];
+    guint  i;
+
+    if (iterator->finished)
+        return FALSE;
+
+    *first = iterator->addr;
+    network_last(&iterator->addr, iterator->netmask, end);
+    find_next(iterator);
+
+    /*
+     * Keep absorbing results for as long as they pick up right where
+     * the range leaves off.
+     */
+
+    while (!iterator->finished &&
+           (iterator->addr.is_ipv4 == first->is_ipv4) &&
+           is_next_address(end, &iterator->addr))
+    {
+        network_last(&iterator->addr, iterator->netmask, end);
+        find_next(iterator);
+    }
+
+    last->is_ipv4 = first->is_ipv4;
+
+    for (i = 0; i < 4; i++)
+    {
+        last->addr[i] = g_htonl(end[i]);
+    }
 
-    ipset_expanded_assignment_advance(iterator->assignment_iterator);
-    process_expanded_assignment(iterator);
+    return TRUE;
 }
@@ -0,0 +1,155 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+
+
+/**
+ * Return the nodes that the BDD leads to for each value of the bit at
+ * the given depth.  If the BDD skips over the bit, both values lead
+ * to the same node.
+ */
+
+static void
+children(ipset_node_id_t node_id, guint depth,
+         ipset_node_id_t *low, ipset_node_id_t *high)
+{
+    if (ipset_node_get_type(node_id) == IPSET_NONTERMINAL_NODE)
+    {
+        ipset_node_t  *node = ipset_nonterminal_node(node_id);
+
+        if (node->variable == depth + 1)
+        {
+            *low = node->low;
+            *high = node->high;
+            return;
+        }
+    }
+
+    *low = node_id;
+    *high = node_id;
+}
+
+
+gboolean
+ipset_select(ip_set_t *set, const ipset_count_t *k, ipset_ip_t *addr)
+{
+    ipset_count_t  index = *k;
+    ipset_count_t  family_count;
+    ipset_node_id_t  node_id;
+    gboolean  is_ipv4;
+    guint  size;
+    guint  depth;
+
+    /*
+     * IPv4 addresses come before IPv6 addresses.
+     */
+
+    is_ipv4 = TRUE;
+    node_id = ipset_family_root(set->set_bdd, TRUE);
+    ipset_family_count(node_id, 0, TRUE, &family_count);
+
+    if (ipset_count_compare(&index, &family_count) >= 0)
+    {
+        ipset_count_sub(&index, &index, &family_count);
+
+        is_ipv4 = FALSE;
+        node_id = ipset_family_root(set->set_bdd, FALSE);
+        ipset_family_count(node_id, 0, FALSE, &family_count);
+
+        if (ipset_count_compare(&index, &family_count) >= 0)
+            return FALSE;
+    }
+
+    size = is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+    memset(addr, 0, sizeof(ipset_ip_t));
+    addr->is_ipv4 = is_ipv4;
+
+    /*
+     * At each bit, the addresses in the low branch come first.  If
+     * there are more than index of them, the address we want is in
+     * the low branch; otherwise we skip over them.
+     */
+
+    for (depth = 0; depth < size; depth++)
+    {
+        ipset_node_id_t  low;
+        ipset_node_id_t  high;
+        ipset_count_t  low_count;
+
+        children(node_id, depth, &low, &high);
+        ipset_family_count(low, depth + 1, is_ipv4, &low_count);
+
+        if (ipset_count_compare(&index, &low_count) < 0)
+        {
+            IPSET_BIT_SET(addr->addr, depth, FALSE);
+            node_id = low;
+        } else {
+            ipset_count_sub(&index, &index, &low_count);
+            IPSET_BIT_SET(addr->addr, depth, TRUE);
+            node_id = high;
+        }
+    }
+
+    return TRUE;
+}
+
+
+void
+ipset_rank(ip_set_t *set, ipset_ip_t *addr, ipset_count_t *rank)
+{
+    ipset_node_id_t  node_id;
+    guint  size = addr->is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+    guint  depth;
+
+    rank->high = rank->low = 0;
+
+    /*
+     * Every IPv4 address comes before an IPv6 address.
+     */
+
+    if (!addr->is_ipv4)
+    {
+        ipset_family_count(ipset_family_root(set->set_bdd, TRUE),
+                           0, TRUE, rank);
+    }
+
+    /*
+     * Whenever the address takes the high branch, everything in the
+     * low branch is smaller than it.
+     */
+
+    node_id = ipset_family_root(set->set_bdd, addr->is_ipv4);
+
+    for (depth = 0; depth < size; depth++)
+    {
+        ipset_node_id_t  low;
+        ipset_node_id_t  high;
+
+        children(node_id, depth, &low, &high);
+
+        if (IPSET_BIT_GET(addr->addr, depth))
+        {
+            ipset_count_t  low_count;
+
+            ipset_family_count(low, depth + 1, addr->is_ipv4, &low_count);
+            ipset_count_add(rank, rank, &low_count);
+            node_id = high;
+        } else {
+            node_id = low;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/* -*- coding: utf-8 -*-
+ * ----------------------------------------------------------------------
+ * Copyright © 2010, RedJack, LLC.
+ * All rights reserved.
+ *
+ * Please see the LICENSE.txt file in this distribution for license
+ * details.
+ * ----------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <ipset/bdd/nodes.h>
+#include <ipset/ipset.h>
+#include <ipset/internal.h>
+#include <ipset/logging.h>
+
+
+/**
+ * Walk down from a node, choosing each branch with a probability
+ * proportional to the number of addresses below it.
+ */
+
+static void
+sample_one(GRand *rng, ipset_node_id_t node_id,
+           gboolean is_ipv4, ipset_ip_t *addr)
+{
+    guint  size = is_ipv4? IPV4_BIT_SIZE: IPV6_BIT_SIZE;
+    guint  depth;
+
+    memset(addr, 0, sizeof(ipset_ip_t));
+    addr->is_ipv4 = is_ipv4;
+
+    for (depth = 0; depth < size; depth++)
+    {
+        gboolean  bit;
+
+        /*
+         * If we've reached a terminal, or the BDD skips over this
+         * bit, then both values of the bit are equally likely.
+         */
+
+        if ((ipset_node_get_type(node_id) == IPSET_TERMINAL_NODE) ||
+            (ipset_nonterminal_node(node_id)->variable != depth + 1))
+        {
+            bit = g_rand_boolean(rng);
+        } else {
+            ipset_node_t  *node = ipset_nonterminal_node(node_id);
+            ipset_count_t  low_count;
+            ipset_count_t  high_count;
+            ipset_count_t  total;
+            ipset_count_t  choice;
+
+            ipset_family_count(node->low, depth + 1, is_ipv4, &low_count);
+            ipset_family_count(node->high, depth + 1, is_ipv4, &high_count);
+            ipset_count_add(&total, &low_count, &high_count);
+
+            ipset_count_random(&choice, rng, &total);
+            bit = (ipset_count_compare(&choice, &low_count) >= 0);
+            node_id = bit? node->high: node->low;
+        }
+
+        IPSET_BIT_SET(addr->addr, depth, bit);
+    }
+}
+
+
+gboolean
+ipset_sample(ip_set_t *set, GRand *rng, gsize count, ipset_ip_t *out)
+{
+    ipset_count_t  ipv4_count;
+    ipset_count_t  ipv6_count;
+    ipset_count_t  total;
+    gsize  i;
+
+    ipset_family_count(ipset_family_root(set->set_bdd, TRUE),
+                       0, TRUE, &ipv4_count);
+    ipset_family_count(ipset_family_root(set->set_bdd, FALSE),
+                       0, FALSE, &ipv6_count);
+    ipset_count_add(&total, &ipv4_count, &ipv6_count);
+
+    if ((total.high == 0) && (total.low == 0))
+        return FALSE;
+
+    for (i = 0; i < count; i++)
+    {
+        /*
+         * First decide which kind of address to return, and then walk
+         * down that part of the BDD.
+         */
+
+        ipset_count_t  choice;
+        gboolean  is_ipv4;
+
+        ipset_count_random(&choice, rng, &total);
+        is_ipv4 = (ipset_count_compare(&choice, &ipv4_count) < 0);
+
+        sample_one(rng, ipset_family_root(set->set_bdd, is_ipv4),
+                   is_ipv4, &out[i]);
+    }
+
+    return TRUE;
+}
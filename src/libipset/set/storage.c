@@ -29,6 +29,37 @@ ipset_save(GOutputStream *stream,
 }
 
 
+gboolean
+ipset_save_compressed(GOutputStream *stream,
+                      ip_set_t *set,
+                      ipset_compression_t compression,
+                      GError **err)
+{
+    return ipset_node_cache_save_compressed
+        (stream, ipset_cache, set->set_bdd, compression, err);
+}
+
+
+gboolean
+ipset_save_fingerprinted(GOutputStream *stream,
+                         ip_set_t *set,
+                         ipset_compression_t compression,
+                         GError **err)
+{
+    return ipset_node_cache_save_fingerprinted
+        (stream, ipset_cache, set->set_bdd, compression, err);
+}
+
+
+gboolean
+ipset_read_fingerprint(GInputStream *stream,
+                       guint64 *fingerprint,
+                       GError **err)
+{
+    return ipset_node_cache_read_fingerprint(stream, fingerprint, err);
+}
+
+
 gboolean
 ipset_save_dot(GOutputStream *stream,
                ip_set_t *set,
@@ -63,3 +94,126 @@ ipset_load(GInputStream *stream,
     set->set_bdd = node;
     return set;
 }
+
+
+ip_set_t *
+ipset_load_from_archive(GInputStream *stream,
+                        const gchar *name,
+                        GError **err)
+{
+    ip_set_t  *set;
+    ipset_node_id_t  node;
+
+    set = ipset_new();
+    if (set == NULL) return NULL;
+
+    GError  *suberror = NULL;
+
+    node = ipset_node_cache_load_archive_entry
+        (stream, ipset_cache, name, &suberror);
+    if (suberror != NULL)
+    {
+        g_propagate_error(err, suberror);
+        ipset_free(set);
+        return NULL;
+    }
+
+    set->set_bdd = node;
+    return set;
+}
+
+
+gboolean
+ipset_diff_save(GOutputStream *stream,
+                ip_set_t *old_set,
+                ip_set_t *new_set,
+                GError **err)
+{
+    return ipset_node_cache_save_patch
+        (stream, ipset_cache, old_set->set_bdd, new_set->set_bdd, err);
+}
+
+
+ip_set_t *
+ipset_patch_load(GInputStream *stream,
+                 ip_set_t *old_set,
+                 GError **err)
+{
+    ip_set_t  *set;
+    ipset_node_id_t  node;
+
+    set = ipset_new();
+    if (set == NULL) return NULL;
+
+    GError  *suberror = NULL;
+
+    node = ipset_node_cache_load_patch
+        (stream, ipset_cache, old_set->set_bdd, &suberror);
+    if (suberror != NULL)
+    {
+        g_propagate_error(err, suberror);
+        ipset_free(set);
+        return NULL;
+    }
+
+    set->set_bdd = node;
+    return set;
+}
+
+
+void
+ipset_load_async(GInputStream *stream,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data)
+{
+    ipset_node_cache_load_async(stream, cancellable, callback, user_data);
+}
+
+
+ip_set_t *
+ipset_load_finish(GAsyncResult *result,
+                  GError **err)
+{
+    ip_set_t  *set;
+    ipset_node_id_t  node;
+
+    set = ipset_new();
+    if (set == NULL) return NULL;
+
+    GError  *suberror = NULL;
+
+    node = ipset_node_cache_load_finish
+        (ipset_cache, result, &suberror);
+    if (suberror != NULL)
+    {
+        g_propagate_error(err, suberror);
+        ipset_free(set);
+        return NULL;
+    }
+
+    set->set_bdd = node;
+    return set;
+}
+
+
+void
+ipset_save_async(GOutputStream *stream,
+                 ip_set_t *set,
+                 ipset_compression_t compression,
+                 GCancellable *cancellable,
+                 GAsyncReadyCallback callback,
+                 gpointer user_data)
+{
+    ipset_node_cache_save_async
+        (stream, ipset_cache, set->set_bdd, compression,
+         cancellable, callback, user_data);
+}
+
+
+gboolean
+ipset_save_finish(GAsyncResult *result,
+                  GError **err)
+{
+    return ipset_node_cache_save_finish(result, err);
+}
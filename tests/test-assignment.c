@@ -230,6 +230,65 @@ START_TEST(test_bdd_assignment_expand_3)
 END_TEST
 
 
+START_TEST(test_bdd_assignment_expand_4)
+{
+    ipset_assignment_t  *a;
+
+    /*
+     * Leave a variable on either side of a byte boundary as EITHER,
+     * and make sure that the carry crosses the boundary.
+     */
+
+    a = ipset_assignment_new();
+    ipset_assignment_set(a, 6, TRUE);
+    ipset_assignment_set(a, 8, FALSE);
+
+    ipset_expanded_assignment_t  *it;
+    it = ipset_assignment_expand(a, 10);
+
+    GByteArray  *ea = g_byte_array_sized_new(2);
+    memset(ea->data, 0, 2);
+    IPSET_BIT_SET(ea->data, 6, TRUE);
+
+    /*
+     * Variables 0-5, 7, and 9 are EITHER, so there should be 2^8
+     * expanded assignments.
+     */
+
+    guint  count = 0;
+
+    while (!it->finished)
+    {
+        count++;
+
+        if (count == 2)
+        {
+            IPSET_BIT_SET(ea->data, 9, TRUE);
+            fail_unless(memcmp(ea->data, it->values->data, 2) == 0,
+                        "Expanded assignment 2 doesn't match");
+        }
+
+        if (count == 3)
+        {
+            IPSET_BIT_SET(ea->data, 7, TRUE);
+            IPSET_BIT_SET(ea->data, 9, FALSE);
+            fail_unless(memcmp(ea->data, it->values->data, 2) == 0,
+                        "Expanded assignment 3 doesn't match");
+        }
+
+        ipset_expanded_assignment_advance(it);
+    }
+
+    fail_unless(count == 256,
+                "Expanded assignment should have 256 elements");
+
+    g_byte_array_free(ea, TRUE);
+    ipset_expanded_assignment_free(it);
+    ipset_assignment_free(a);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * Testing harness
  */
@@ -250,6 +309,7 @@ test_suite()
     tcase_add_test(tc_expanded, test_bdd_assignment_expand_1);
     tcase_add_test(tc_expanded, test_bdd_assignment_expand_2);
     tcase_add_test(tc_expanded, test_bdd_assignment_expand_3);
+    tcase_add_test(tc_expanded, test_bdd_assignment_expand_4);
     suite_add_tcase(s, tc_expanded);
 
     return s;
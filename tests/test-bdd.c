@@ -1063,6 +1063,298 @@ START_TEST(test_bdd_load_2)
 }
 END_TEST
 
+START_TEST(test_bdd_save_compressed_1)
+{
+    ipset_node_cache_t  *cache = ipset_node_cache_new();
+
+    /*
+     * Create a BDD representing
+     *   f(x) = (x[0] ∧ x[1]) ∨ (¬x[0] ∧ x[2])
+     */
+
+    ipset_node_id_t  n_false =
+        ipset_node_cache_terminal(cache, FALSE);
+    ipset_node_id_t  n_true =
+        ipset_node_cache_terminal(cache, TRUE);
+
+    ipset_node_id_t  t0 =
+        ipset_node_cache_nonterminal(cache, 0, n_false, n_true);
+    ipset_node_id_t  f0 =
+        ipset_node_cache_nonterminal(cache, 0, n_true, n_false);
+    ipset_node_id_t  t1 =
+        ipset_node_cache_nonterminal(cache, 1, n_false, n_true);
+    ipset_node_id_t  t2 =
+        ipset_node_cache_nonterminal(cache, 2, n_false, n_true);
+
+    ipset_node_id_t  n1 =
+        ipset_node_cache_and(cache, t0, t1);
+    ipset_node_id_t  n2 =
+        ipset_node_cache_and(cache, f0, t2);
+    ipset_node_id_t  node =
+        ipset_node_cache_or(cache, n1, n2);
+
+    /*
+     * Serialize the BDD into a string, and verify that the header is
+     * uncompressed.
+     */
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mstream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_node_cache_save_compressed
+                (ostream, cache, node, IPSET_COMPRESSION_ZLIB, NULL),
+                "Cannot serialize BDD");
+
+    const char  *raw_expected =
+        "IP set"                             // magic number
+        "\x00\x02"                           // version
+        "\x01"                               // codec
+        ;
+    const size_t  expected_length = 9;
+
+    gpointer  buf = g_memory_output_stream_get_data(mstream);
+    gsize  len = g_memory_output_stream_get_data_size(mstream);
+
+    fail_unless(len > expected_length,
+                "Serialized BDD is too short");
+
+    fail_unless(memcmp(raw_expected, buf, expected_length) == 0,
+                "Serialized BDD has incorrect header");
+
+    /*
+     * Then read it back in.
+     */
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    GError  *error = NULL;
+    ipset_node_id_t  read =
+        ipset_node_cache_load(istream, cache, &error);
+
+    fail_unless(error == NULL,
+                "Error reading BDD from stream");
+
+    fail_unless(read == node,
+                "BDD from stream doesn't match expected");
+
+    g_object_unref(istream);
+    g_object_unref(ostream);
+    ipset_node_cache_free(cache);
+}
+END_TEST
+
+
+START_TEST(test_bdd_save_archive_1)
+{
+    ipset_node_cache_t  *cache = ipset_node_cache_new();
+
+    /*
+     * Create two BDDs that share a node:
+     *   f(x) = x[0] ∧ x[1]
+     *   g(x) = (x[0] ∧ x[1]) ∨ (¬x[0] ∧ x[2])
+     */
+
+    ipset_node_id_t  n_false =
+        ipset_node_cache_terminal(cache, FALSE);
+    ipset_node_id_t  n_true =
+        ipset_node_cache_terminal(cache, TRUE);
+
+    ipset_node_id_t  t0 =
+        ipset_node_cache_nonterminal(cache, 0, n_false, n_true);
+    ipset_node_id_t  f0 =
+        ipset_node_cache_nonterminal(cache, 0, n_true, n_false);
+    ipset_node_id_t  t1 =
+        ipset_node_cache_nonterminal(cache, 1, n_false, n_true);
+    ipset_node_id_t  t2 =
+        ipset_node_cache_nonterminal(cache, 2, n_false, n_true);
+
+    ipset_node_id_t  n1 =
+        ipset_node_cache_and(cache, t0, t1);
+    ipset_node_id_t  n2 =
+        ipset_node_cache_and(cache, f0, t2);
+    ipset_node_id_t  node =
+        ipset_node_cache_or(cache, n1, n2);
+
+    /*
+     * Serialize both BDDs into an archive.  The x[1] node should
+     * only appear in the node table once.
+     */
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mstream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    const gchar  *names[] = { "f", "g" };
+    ipset_node_id_t  roots[] = { n1, node };
+
+    fail_unless(ipset_node_cache_save_archive
+                (ostream, cache, 2, names, roots, NULL),
+                "Cannot serialize archive");
+
+    const char  *raw_expected =
+        "IP set"                             // magic number
+        "\x00\x03"                           // version
+        "\x00\x00\x00\x00\x00\x00\x00\x4a"   // length
+        "\x00\x00\x00\x02"                   // root count
+        "\x00\x00\x00\x04"                   // node count
+        /* root table */
+        "\x00\x01" "f" "\xff\xff\xff\xfe"    // f = -2
+        "\x00\x01" "g" "\xff\xff\xff\xfc"    // g = -4
+        /* node table */
+        "\x01\x00\x00\x00\x00\x00\x00\x00\x01"  // -1: x1 ? 1: 0
+        "\x00\x00\x00\x00\x00\xff\xff\xff\xff"  // -2: x0 ? -1: 0
+        "\x02\x00\x00\x00\x00\x00\x00\x00\x01"  // -3: x2 ? 1: 0
+        "\x00\xff\xff\xff\xfd\xff\xff\xff\xff"  // -4: x0 ? -1: -3
+        ;
+    const size_t  expected_length = 74;
+
+    gpointer  buf = g_memory_output_stream_get_data(mstream);
+    gsize  len = g_memory_output_stream_get_data_size(mstream);
+
+    fail_unless(len == expected_length,
+                "Serialized archive has incorrect length "
+                "(expected %zu, got %zu)",
+                expected_length, len);
+
+    fail_unless(memcmp(raw_expected, buf, expected_length) == 0,
+                "Serialized archive incorrect");
+
+    /*
+     * Read all of the BDDs back in.
+     */
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data(buf, len, NULL);
+    GPtrArray  *read_names = g_ptr_array_new();
+    GArray  *read_roots =
+        g_array_new(FALSE, FALSE, sizeof(ipset_node_id_t));
+
+    GError  *error = NULL;
+    ipset_node_cache_load_archive
+        (istream, cache, read_names, read_roots, &error);
+
+    fail_unless(error == NULL,
+                "Error reading archive from stream");
+
+    fail_unless(read_roots->len == 2,
+                "Archive has wrong number of entries");
+
+    fail_unless(strcmp(g_ptr_array_index(read_names, 1), "g") == 0,
+                "Archive entry has wrong name");
+
+    fail_unless(g_array_index(read_roots, ipset_node_id_t, 0) == n1,
+                "BDD from archive doesn't match expected");
+
+    fail_unless(g_array_index(read_roots, ipset_node_id_t, 1) == node,
+                "BDD from archive doesn't match expected");
+
+    g_free(g_ptr_array_index(read_names, 0));
+    g_free(g_ptr_array_index(read_names, 1));
+    g_ptr_array_free(read_names, TRUE);
+    g_array_free(read_roots, TRUE);
+    g_object_unref(istream);
+
+    /*
+     * Then read in a single BDD.
+     */
+
+    istream = g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    ipset_node_id_t  read =
+        ipset_node_cache_load_archive_entry(istream, cache, "g", &error);
+
+    fail_unless(error == NULL,
+                "Error reading archive entry from stream");
+
+    fail_unless(read == node,
+                "BDD from archive doesn't match expected");
+
+    g_object_unref(istream);
+
+    /*
+     * An archive can't be read in as a single BDD.
+     */
+
+    istream = g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    ipset_node_cache_load(istream, cache, &error);
+
+    fail_unless(error != NULL,
+                "Shouldn't be able to read archive as a BDD");
+
+    g_clear_error(&error);
+    g_object_unref(istream);
+    g_object_unref(ostream);
+    ipset_node_cache_free(cache);
+}
+END_TEST
+
+
+START_TEST(test_bdd_fingerprint_1)
+{
+    ipset_node_cache_t  *cache1 = ipset_node_cache_new();
+    ipset_node_cache_t  *cache2 = ipset_node_cache_new();
+
+    /*
+     * Create the same BDD in two different node caches, building its
+     * nodes in a different order each time:
+     *   f(x) = (x[0] ∧ x[1]) ∨ (¬x[0] ∧ x[2])
+     */
+
+    ipset_node_id_t  n_false1 =
+        ipset_node_cache_terminal(cache1, FALSE);
+    ipset_node_id_t  n_true1 =
+        ipset_node_cache_terminal(cache1, TRUE);
+    ipset_node_id_t  t1_1 =
+        ipset_node_cache_nonterminal(cache1, 1, n_false1, n_true1);
+    ipset_node_id_t  t2_1 =
+        ipset_node_cache_nonterminal(cache1, 2, n_false1, n_true1);
+    ipset_node_id_t  node1 =
+        ipset_node_cache_nonterminal(cache1, 0, t2_1, t1_1);
+
+    ipset_node_id_t  n_false2 =
+        ipset_node_cache_terminal(cache2, FALSE);
+    ipset_node_id_t  n_true2 =
+        ipset_node_cache_terminal(cache2, TRUE);
+    ipset_node_id_t  t2_2 =
+        ipset_node_cache_nonterminal(cache2, 2, n_false2, n_true2);
+    ipset_node_id_t  t1_2 =
+        ipset_node_cache_nonterminal(cache2, 1, n_false2, n_true2);
+    ipset_node_id_t  node2 =
+        ipset_node_cache_nonterminal(cache2, 0, t2_2, t1_2);
+
+    /*
+     * And a BDD with the children swapped.
+     */
+
+    ipset_node_id_t  swapped =
+        ipset_node_cache_nonterminal(cache2, 0, t1_2, t2_2);
+
+    guint64  fp1 = ipset_node_cache_fingerprint(cache1, node1);
+    guint64  fp2 = ipset_node_cache_fingerprint(cache2, node2);
+
+    fail_unless(fp1 == fp2,
+                "Equal BDDs should have equal fingerprints");
+
+    fail_unless(fp1 == ipset_node_cache_fingerprint(cache1, node1),
+                "Fingerprint should be stable");
+
+    fail_unless(fp1 != ipset_node_cache_fingerprint(cache2, swapped),
+                "Different BDDs should have different fingerprints");
+
+    fail_unless(ipset_node_cache_fingerprint(cache1, n_false1) !=
+                ipset_node_cache_fingerprint(cache1, n_true1),
+                "Different terminals should have different fingerprints");
+
+    ipset_node_cache_free(cache1);
+    ipset_node_cache_free(cache2);
+}
+END_TEST
+
 
 /*-----------------------------------------------------------------------
  * Iteration
@@ -1244,6 +1536,9 @@ test_suite()
     tcase_add_test(tc_serialization, test_bdd_bad_save_1);
     tcase_add_test(tc_serialization, test_bdd_load_1);
     tcase_add_test(tc_serialization, test_bdd_load_2);
+    tcase_add_test(tc_serialization, test_bdd_save_compressed_1);
+    tcase_add_test(tc_serialization, test_bdd_save_archive_1);
+    tcase_add_test(tc_serialization, test_bdd_fingerprint_1);
     suite_add_tcase(s, tc_serialization);
 
     TCase  *tc_iteration = tcase_create("iteration");
@@ -9,6 +9,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <check.h>
 #include <glib.h>
@@ -49,6 +50,61 @@ START_TEST(test_ipv4_parse_01)
 END_TEST
 
 
+START_TEST(test_ipv4_format_01)
+{
+    ipset_ip_t  ip;
+    gchar  buf[IPSET_NETWORK_STRING_LENGTH];
+
+    ipset_ip_from_ipv4(&ip, IPV4_ADDR_1);
+
+    fail_unless(ipset_ip_format(&ip, buf) == 13,
+                "IPv4 address has the wrong length");
+    fail_unless(strcmp(buf, "192.168.1.100") == 0,
+                "IPv4 address formatted incorrectly");
+
+    fail_unless(ipset_ip_format_network(&ip, 8, buf) == 15,
+                "IPv4 network has the wrong length");
+    fail_unless(strcmp(buf, "192.168.1.100/8") == 0,
+                "IPv4 network formatted incorrectly");
+}
+END_TEST
+
+
+START_TEST(test_ipv4_parse_network_01)
+{
+    ipset_ip_t  ip1;
+    ipset_ip_t  ip2;
+    guint  netmask;
+
+    /*
+     * The string doesn't need to be NUL-terminated.
+     */
+
+    ipset_ip_from_ipv4(&ip1, IPV4_ADDR_1);
+
+    fail_unless(ipset_ip_parse_network(&ip2, &netmask,
+                                       "192.168.1.100/24xxx", 16),
+                "Could not parse IPv4 network");
+    fail_unless(ipset_ip_equal(&ip1, &ip2),
+                "IPv4 addresses should be equal");
+    fail_unless(netmask == 24,
+                "IPv4 netmask should be 24");
+
+    fail_unless(ipset_ip_parse_network(&ip2, &netmask,
+                                       "192.168.1.100", 13),
+                "Could not parse IPv4 address");
+    fail_unless(netmask == 32,
+                "IPv4 netmask should be 32");
+
+    fail_if(ipset_ip_parse_network(&ip2, &netmask,
+                                   "192.168.1.100/33", 16),
+            "IPv4 netmask should be too large");
+    fail_if(ipset_ip_parse(&ip2, "192.168.01.100", 14),
+            "IPv4 address shouldn't allow leading zeros");
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * IPv6
  */
@@ -80,6 +136,132 @@ START_TEST(test_ipv6_parse_02)
 }
 END_TEST
 
+START_TEST(test_ipv6_parse_03)
+{
+    ipset_ip_t  ip1;
+    ipset_ip_t  ip2;
+    ipv6_addr_t  zero;
+    ipv6_addr_t  one;
+
+    memset(zero, 0, sizeof(zero));
+    memset(one, 0, sizeof(one));
+    one[1] = 1;
+
+    ipset_ip_from_ipv6(&ip1, zero);
+    fail_unless(ipset_ip_from_string(&ip2, "::"),
+                "Could not parse ::");
+    fail_unless(ipset_ip_equal(&ip1, &ip2),
+                "IPv6 addresses should be equal");
+
+    ipset_ip_from_ipv6(&ip1, one);
+    fail_unless(ipset_ip_from_string(&ip2, "1::"),
+                "Could not parse 1::");
+    fail_unless(ipset_ip_equal(&ip1, &ip2),
+                "IPv6 addresses should be equal");
+
+    ipset_ip_from_ipv6(&ip1, IPV6_ADDR_2);
+    fail_unless(ipset_ip_from_string(&ip2, "0:0:0:0:0:ffff:192.168.1.100"),
+                "Could not parse address with an embedded IPv4 tail");
+    fail_unless(ipset_ip_equal(&ip1, &ip2),
+                "IPv6 addresses should be equal");
+}
+END_TEST
+
+
+START_TEST(test_ipv6_parse_invalid_01)
+{
+    ipset_ip_t  ip;
+
+    fail_if(ipset_ip_from_string(&ip, ":::"),
+            "Shouldn't parse :::");
+    fail_if(ipset_ip_from_string(&ip, "1:2:3:4:5:6:7:8::"),
+            "Shouldn't parse a :: after eight groups");
+    fail_if(ipset_ip_from_string(&ip, "12345::"),
+            "Shouldn't parse a 5-digit group");
+    fail_if(ipset_ip_from_string(&ip, "::ffff:192.168.1.100:1"),
+            "Shouldn't parse an embedded IPv4 address that isn't last");
+}
+END_TEST
+
+
+START_TEST(test_parse_invalid_unchanged_01)
+{
+    ipset_ip_t  ip1;
+    ipset_ip_t  ip2;
+
+    /*
+     * A failed parse shouldn't touch the address, even if it starts
+     * with a valid IPv4 address.
+     */
+
+    ipset_ip_from_ipv6(&ip1, IPV6_ADDR_1);
+    ipset_ip_from_ipv6(&ip2, IPV6_ADDR_1);
+
+    fail_if(ipset_ip_from_string(&ip2, "192.168.1.100x"),
+            "Shouldn't parse trailing garbage");
+    fail_unless(ipset_ip_equal(&ip1, &ip2),
+                "Failed parse shouldn't change the address");
+}
+END_TEST
+
+START_TEST(test_parse_network_invalid_unchanged_01)
+{
+    ipset_ip_t  ip1;
+    ipset_ip_t  ip2;
+    guint  netmask = 7;
+
+    /*
+     * A bad prefix shouldn't touch the address or netmask, even
+     * though the address before the slash is valid.
+     */
+
+    ipset_ip_from_ipv6(&ip1, IPV6_ADDR_1);
+    ipset_ip_from_ipv6(&ip2, IPV6_ADDR_1);
+
+    fail_if(ipset_ip_parse_network(&ip2, &netmask,
+                                   "192.168.1.100/33", 16),
+            "IPv4 netmask should be too large");
+    fail_if(ipset_ip_parse_network(&ip2, &netmask,
+                                   "192.168.1.100/", 14),
+            "IPv4 netmask shouldn't be empty");
+    fail_if(ipset_ip_parse_network(&ip2, &netmask,
+                                   "192.168.1.100/x", 15),
+            "IPv4 netmask should be a number");
+    fail_if(ipset_ip_parse_network(&ip2, &netmask,
+                                   "192.168.1.100/024", 17),
+            "IPv4 netmask shouldn't allow leading zeros");
+
+    fail_unless(ipset_ip_equal(&ip1, &ip2),
+                "Failed parse shouldn't change the address");
+    fail_unless(netmask == 7,
+                "Failed parse shouldn't change the netmask");
+
+    fail_unless(ipset_ip_parse_network(&ip2, &netmask,
+                                       "192.168.1.100/0", 15),
+                "Could not parse a zero netmask");
+    fail_unless(netmask == 0,
+                "IPv4 netmask should be 0");
+}
+END_TEST
+
+
+START_TEST(test_ipv6_format_01)
+{
+    ipset_ip_t  ip;
+    gchar  buf[IPSET_NETWORK_STRING_LENGTH];
+
+    ipset_ip_from_ipv6(&ip, IPV6_ADDR_1);
+    ipset_ip_format(&ip, buf);
+    fail_unless(strcmp(buf, "fe80::1") == 0,
+                "IPv6 address formatted incorrectly");
+
+    ipset_ip_from_ipv6(&ip, IPV6_ADDR_2);
+    ipset_ip_format_network(&ip, 128, buf);
+    fail_unless(strcmp(buf, "::ffff:192.168.1.100/128") == 0,
+                "IPv6 network formatted incorrectly");
+}
+END_TEST
+
 
 /*-----------------------------------------------------------------------
  * Testing harness
@@ -92,11 +274,18 @@ ipset_suite()
 
     TCase  *tc_ipv4 = tcase_create("ipv4");
     tcase_add_test(tc_ipv4, test_ipv4_parse_01);
+    tcase_add_test(tc_ipv4, test_ipv4_format_01);
+    tcase_add_test(tc_ipv4, test_ipv4_parse_network_01);
     suite_add_tcase(s, tc_ipv4);
 
     TCase  *tc_ipv6 = tcase_create("ipv6");
     tcase_add_test(tc_ipv6, test_ipv6_parse_01);
     tcase_add_test(tc_ipv6, test_ipv6_parse_02);
+    tcase_add_test(tc_ipv6, test_ipv6_parse_03);
+    tcase_add_test(tc_ipv6, test_ipv6_parse_invalid_01);
+    tcase_add_test(tc_ipv6, test_parse_invalid_unchanged_01);
+    tcase_add_test(tc_ipv6, test_parse_network_invalid_unchanged_01);
+    tcase_add_test(tc_ipv6, test_ipv6_format_01);
     suite_add_tcase(s, tc_ipv6);
 
     return s;
@@ -162,6 +162,456 @@ START_TEST(test_store_empty_02)
 END_TEST
 
 
+START_TEST(test_build_from_sorted_01)
+{
+    ip_map_t  map;
+    ip_map_t  *built;
+    ipmap_entry_t  entries[6];
+    const gchar  *networks[] = {
+        "10.0.0.0", "10.1.0.0", "10.1.2.0", "10.2.0.0",
+        "192.168.1.100", "fe80::"
+    };
+    guint  netmasks[] = { 8, 16, 24, 16, 32, 64 };
+    gint  values[] = { 1, 2, 3, 1, 4, 5 };
+    guint  i;
+
+    /*
+     * Building from a sorted list should give the same map as setting
+     * each network in turn.  The third entry overrides part of the
+     * second, which overrides part of the first; the fourth has the
+     * same value as the first.
+     */
+
+    ipmap_init(&map, 0);
+
+    for (i = 0; i < 6; i++)
+    {
+        ipset_ip_from_string(&entries[i].addr, networks[i]);
+        entries[i].netmask = netmasks[i];
+        entries[i].value = values[i];
+
+        ipmap_ip_set_network(&map, &entries[i].addr,
+                             netmasks[i], values[i]);
+    }
+
+    built = ipmap_build_from_sorted(entries, 6, 0);
+    fail_if(built == NULL,
+            "Could not build map");
+
+    fail_unless(ipmap_is_equal(&map, built),
+                "Built map should equal the incrementally built map");
+
+    ipmap_free(built);
+    ipmap_done(&map);
+}
+END_TEST
+
+START_TEST(test_build_from_sorted_02)
+{
+    ip_map_t  *built;
+    ipmap_entry_t  entries[2];
+
+    /*
+     * The nested network comes before the network it's in, so the
+     * entries aren't sorted.
+     */
+
+    ipset_ip_from_string(&entries[0].addr, "10.1.0.0");
+    entries[0].netmask = 16;
+    entries[0].value = 1;
+
+    ipset_ip_from_string(&entries[1].addr, "10.0.0.0");
+    entries[1].netmask = 8;
+    entries[1].value = 2;
+
+    built = ipmap_build_from_sorted(entries, 2, 0);
+    fail_unless(built == NULL,
+                "Shouldn't build a map from unsorted entries");
+
+    /*
+     * An empty list gives an empty map.
+     */
+
+    built = ipmap_build_from_sorted(entries, 0, 7);
+    fail_if(built == NULL,
+            "Could not build empty map");
+    fail_unless(ipmap_ipv4_get(built, &IPV4_ADDR_1) == 7,
+                "Empty map should return the default");
+    ipmap_free(built);
+}
+END_TEST
+
+
+static ipset_range_t
+times_op(ipset_range_t lhs_value, ipset_range_t rhs_value)
+{
+    return lhs_value * rhs_value;
+}
+
+START_TEST(test_combine_01)
+{
+    ip_map_t  map1, map2, result;
+
+    /*
+     * map1 has 192.168.1.0/24 → 1 and 192.168.1.100 → 2; map2 has
+     * 192.168.1.100/31 → 10 and 192.168.2.100 → 20.
+     */
+
+    ipmap_init(&map1, 0);
+    ipmap_ipv4_set_network(&map1, &IPV4_ADDR_1, 24, 1);
+    ipmap_ipv4_set(&map1, &IPV4_ADDR_1, 2);
+
+    ipmap_init(&map2, 0);
+    ipmap_ipv4_set_network(&map2, &IPV4_ADDR_1, 31, 10);
+    ipmap_ipv4_set(&map2, &IPV4_ADDR_3, 20);
+
+    fail_unless(ipmap_combine(&result, &map1, &map2, IPMAP_OPERATOR_SUM),
+                "Could not combine maps");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_1) == 12,
+                "Wrong sum for 192.168.1.100");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_2) == 11,
+                "Wrong sum for 192.168.1.101");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_3) == 20,
+                "Wrong sum for 192.168.2.100");
+    fail_unless(ipmap_ipv6_get(&result, &IPV6_ADDR_1) == 0,
+                "Wrong sum for IPv6 address");
+
+    fail_unless(ipmap_combine(&result, &map1, &map2, IPMAP_OPERATOR_MIN),
+                "Could not combine maps");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_2) == 1,
+                "Wrong minimum for 192.168.1.101");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_3) == 0,
+                "Wrong minimum for 192.168.2.100");
+
+    fail_unless(ipmap_combine(&result, &map2, &map1,
+                              IPMAP_OPERATOR_OVERLAY),
+                "Could not combine maps");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_1) == 10,
+                "Wrong overlay for 192.168.1.100");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_3) == 20,
+                "Wrong overlay for 192.168.2.100");
+
+    /*
+     * Combining a map with itself, in place.
+     */
+
+    fail_unless(ipmap_combine(&map1, &map1, &map1, IPMAP_OPERATOR_BIT_OR),
+                "Could not combine maps");
+    fail_unless(ipmap_ipv4_get(&map1, &IPV4_ADDR_1) == 2,
+                "Wrong bitwise OR for 192.168.1.100");
+
+    ipmap_done(&map1);
+    ipmap_done(&map2);
+    ipmap_done(&result);
+}
+END_TEST
+
+START_TEST(test_combine_02)
+{
+    ip_map_t  map1, map2, result;
+    guint  times;
+
+    ipmap_init(&map1, 1);
+    ipmap_ipv4_set(&map1, &IPV4_ADDR_1, 3);
+
+    ipmap_init(&map2, 2);
+    ipmap_ipv4_set(&map2, &IPV4_ADDR_1, 5);
+
+    times = ipmap_register_operator("TIMES", times_op, TRUE);
+
+    fail_unless(ipmap_combine(&result, &map1, &map2, times),
+                "Could not combine maps");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_1) == 15,
+                "Wrong product for 192.168.1.100");
+    fail_unless(ipmap_ipv4_get(&result, &IPV4_ADDR_2) == 2,
+                "Wrong product for default value");
+
+    fail_if(ipmap_combine(&result, &map1, &map2, times + 1),
+            "Shouldn't combine with an unknown operator");
+
+    ipmap_done(&map1);
+    ipmap_done(&map2);
+    ipmap_done(&result);
+}
+END_TEST
+
+
+START_TEST(test_add_value_01)
+{
+    ip_map_t  map;
+    ipset_ip_t  ip;
+
+    ipmap_init(&map, 0);
+
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_1, 32, 5);
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_1, 32, 2);
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_1, 24, 10);
+
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_1) == 17,
+                "Wrong count for 192.168.1.100");
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_2) == 10,
+                "Wrong count for 192.168.1.101");
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_3) == 0,
+                "Wrong count for 192.168.2.100");
+
+    ipset_ip_from_string(&ip, "fe80::");
+    ipmap_ip_add_value(&map, &ip, 16, 3);
+    fail_unless(ipmap_ipv6_get(&map, &IPV6_ADDR_1) == 3,
+                "Wrong count for IPv6 address");
+
+    ipmap_done(&map);
+}
+END_TEST
+
+START_TEST(test_add_value_02)
+{
+    ip_map_t  map;
+    ipset_ip_t  addrs[2];
+    gint  deltas[] = { -1, -1 };
+
+    /*
+     * Negative deltas decrement, and values wrap around modulo 2^31
+     * when they drop below 0.
+     */
+
+    ipmap_init(&map, 0);
+
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_1, 32, 5);
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_1, 32, -2);
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_1) == 3,
+                "Wrong count for 192.168.1.100");
+
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_1, 32, -3);
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_1) == 0,
+                "Wrong count for 192.168.1.100");
+
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_2, 32, -1);
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_2) == 0x7fffffff,
+                "Decrementing 0 should wrap around to 2^31-1");
+
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_2, 32, 1);
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_2) == 0,
+                "Incrementing 2^31-1 should wrap around to 0");
+
+    /*
+     * The bulk update merges the two deltas for the same address.
+     */
+
+    ipmap_ipv4_add_value(&map, &IPV4_ADDR_3, 32, 10);
+    ipset_ip_from_ipv4(&addrs[0], &IPV4_ADDR_3);
+    ipset_ip_from_ipv4(&addrs[1], &IPV4_ADDR_3);
+    ipmap_ip_add_values(&map, addrs, deltas, 2);
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_3) == 8,
+                "Wrong count for 192.168.2.100");
+
+    ipmap_done(&map);
+}
+END_TEST
+
+START_TEST(test_add_values_01)
+{
+    ip_map_t  map1, map2;
+    ipset_ip_t  addrs[5];
+    gint  deltas[] = { 1, 2, 3, 4, 5 };
+    const gchar  *strings[] = {
+        "192.168.1.100", "10.0.0.1", "fe80::1", "192.168.1.100",
+        "10.0.0.2"
+    };
+    guint  i;
+
+    /*
+     * The bulk update should give the same map as adding each delta
+     * separately.
+     */
+
+    ipmap_init(&map1, 7);
+    ipmap_init(&map2, 7);
+
+    ipmap_ipv4_set_network(&map1, &IPV4_ADDR_1, 24, 100);
+    ipmap_ipv4_set_network(&map2, &IPV4_ADDR_1, 24, 100);
+
+    for (i = 0; i < 5; i++)
+    {
+        ipset_ip_from_string(&addrs[i], strings[i]);
+        ipmap_ip_add_value(&map1, &addrs[i],
+                           addrs[i].is_ipv4? 32: 128, deltas[i]);
+    }
+
+    ipmap_ip_add_values(&map2, addrs, deltas, 5);
+
+    fail_unless(ipmap_ipv4_get(&map2, &IPV4_ADDR_1) == 105,
+                "Wrong count for 192.168.1.100");
+    fail_unless(ipmap_is_equal(&map1, &map2),
+                "Bulk update should match individual updates");
+
+    ipmap_done(&map1);
+    ipmap_done(&map2);
+}
+END_TEST
+
+
+START_TEST(test_classifier_01)
+{
+    ip_set_t  set1, set2, set3;
+    ip_set_t  *sets[] = { &set1, &set2, &set3 };
+    ip_map_t  map;
+
+    ipset_init(&set1);
+    ipset_ipv4_add_network(&set1, &IPV4_ADDR_1, 24);
+
+    ipset_init(&set2);
+    ipset_ipv4_add(&set2, &IPV4_ADDR_1);
+    ipset_ipv4_add(&set2, &IPV4_ADDR_3);
+
+    ipset_init(&set3);
+    ipset_ipv6_add(&set3, &IPV6_ADDR_1);
+
+    fail_unless(ipmap_init_classifier(&map, sets, 3),
+                "Could not create classifier");
+
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_1) == 0x3,
+                "192.168.1.100 should be in sets 0 and 1");
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_2) == 0x1,
+                "192.168.1.101 should be in set 0");
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_3) == 0x2,
+                "192.168.2.100 should be in set 1");
+    fail_unless(ipmap_ipv6_get(&map, &IPV6_ADDR_1) == 0x4,
+                "fe80::21e:c2ff:fe9f:e8e1 should be in set 2");
+    fail_unless(ipmap_ipv6_get(&map, &IPV6_ADDR_2) == 0,
+                "fe80::21e:c2ff:fe9f:e8e2 shouldn't be in any set");
+
+    /*
+     * Change one of the sets, and update the classifier.
+     */
+
+    ipset_done(&set2);
+    ipset_init(&set2);
+    ipset_ipv4_add(&set2, &IPV4_ADDR_2);
+    ipset_ipv6_add(&set2, &IPV6_ADDR_1);
+
+    fail_unless(ipmap_classifier_update(&map, 1, &set2),
+                "Could not update classifier");
+
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_1) == 0x1,
+                "192.168.1.100 should be in set 0");
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_2) == 0x3,
+                "192.168.1.101 should be in sets 0 and 1");
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_3) == 0,
+                "192.168.2.100 shouldn't be in any set");
+    fail_unless(ipmap_ipv6_get(&map, &IPV6_ADDR_1) == 0x6,
+                "fe80::21e:c2ff:fe9f:e8e1 should be in sets 1 and 2");
+
+    /*
+     * The result should be the same as building the classifier from
+     * scratch.
+     */
+
+    {
+        ip_map_t  fresh;
+
+        ipmap_init_classifier(&fresh, sets, 3);
+        fail_unless(ipmap_is_equal(&map, &fresh),
+                    "Updated classifier should match a new one");
+        ipmap_done(&fresh);
+    }
+
+    ipmap_done(&map);
+    ipset_done(&set1);
+    ipset_done(&set2);
+    ipset_done(&set3);
+}
+END_TEST
+
+
+static gboolean
+is_odd(gint value, gpointer user_data)
+{
+    return (value % 2) == 1;
+}
+
+START_TEST(test_to_set_01)
+{
+    ip_map_t  map;
+    ip_set_t  set, expected;
+
+    ipmap_init(&map, 0);
+    ipmap_ipv4_set_network(&map, &IPV4_ADDR_1, 24, 5);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_1, 10);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_3, 3);
+    ipmap_ipv6_set_network(&map, &IPV6_ADDR_1, 64, 7);
+
+    /*
+     * Scores of at least 5.
+     */
+
+    ipset_init(&expected);
+    ipset_ipv4_add_network(&expected, &IPV4_ADDR_1, 24);
+    ipset_ipv6_add_network(&expected, &IPV6_ADDR_1, 64);
+
+    ipmap_value_in_range(&set, &map, 5, G_MAXINT);
+    fail_unless(ipset_is_equal(&set, &expected),
+                "Wrong set for values of at least 5");
+    ipset_done(&set);
+    ipset_done(&expected);
+
+    /*
+     * Odd scores.
+     */
+
+    ipset_init(&expected);
+    ipset_ipv4_add_network(&expected, &IPV4_ADDR_1, 24);
+    ipset_ipv6_add_network(&expected, &IPV6_ADDR_1, 64);
+    ipset_ipv4_add(&expected, &IPV4_ADDR_3);
+
+    ipmap_to_set(&set, &map, is_odd, NULL);
+    fail_if(ipset_ipv4_add(&set, &IPV4_ADDR_1),
+            "192.168.1.100 shouldn't be in the set");
+    ipset_ipv4_add(&expected, &IPV4_ADDR_1);
+    fail_unless(ipset_is_equal(&set, &expected),
+                "Wrong set for odd values");
+    ipset_done(&set);
+    ipset_done(&expected);
+
+    ipmap_done(&map);
+}
+END_TEST
+
+static gboolean
+count_calls(gint value, gpointer user_data)
+{
+    guint  *calls = user_data;
+    (*calls)++;
+    return TRUE;
+}
+
+START_TEST(test_to_set_02)
+{
+    ip_map_t  map;
+    ip_set_t  set;
+    guint  calls = 0;
+
+    /*
+     * The map has 5 distinct values (including the default), so the
+     * predicate should be called 5 times, even though some values
+     * appear on many terminal edges.
+     */
+
+    ipmap_init(&map, 0);
+    ipmap_ipv4_set_network(&map, &IPV4_ADDR_1, 24, 5);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_1, 10);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_3, 3);
+    ipmap_ipv6_set_network(&map, &IPV6_ADDR_1, 64, 7);
+
+    ipmap_to_set(&set, &map, count_calls, &calls);
+    fail_unless(calls == 5,
+                "Expected 5 predicate calls, got %u", calls);
+
+    ipset_done(&set);
+    ipmap_done(&map);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * IPv4 tests
  */
@@ -292,6 +742,77 @@ START_TEST(test_ipv4_insert_network_04)
 }
 END_TEST
 
+
+START_TEST(test_ipv4_lookup_prefix_01)
+{
+    ip_map_t  map;
+    ipset_ip_t  ip;
+    guint  netmask;
+    gint  value;
+
+    ipmap_init(&map, 0);
+
+    ipmap_ipv4_set_network(&map, &IPV4_ADDR_1, 24, 1);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_1, 2);
+
+    value = ipmap_ipv4_lookup_prefix(&map, &IPV4_ADDR_1, &netmask);
+    fail_unless((value == 2) && (netmask == 32),
+                "Expected 2 for /32, got %d for /%u", value, netmask);
+
+    /*
+     * 192.168.1.200 was added as part of the /24, but the largest
+     * block around it that doesn't include 192.168.1.100 is
+     * 192.168.1.128/25.
+     */
+
+    ipset_ip_from_string(&ip, "192.168.1.200");
+    value = ipmap_ip_lookup_prefix(&map, &ip, &netmask);
+    fail_unless((value == 1) && (netmask == 25),
+                "Expected 1 for /25, got %d for /%u", value, netmask);
+
+    value = ipmap_ipv4_lookup_prefix(&map, &IPV4_ADDR_3, &netmask);
+    fail_unless((value == 0) && (netmask == 23),
+                "Expected 0 for /23, got %d for /%u", value, netmask);
+
+    value = ipmap_ipv6_lookup_prefix(&map, &IPV6_ADDR_1, &netmask);
+    fail_unless((value == 0) && (netmask == 0),
+                "Expected 0 for /0, got %d for /%u", value, netmask);
+
+    ipmap_done(&map);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_insert_range_01)
+{
+    ip_map_t  map;
+    ipset_ip_t  first, last, ip;
+
+    ipmap_init(&map, 0);
+
+    ipset_ip_from_string(&first, "192.168.1.7");
+    ipset_ip_from_string(&last, "192.168.9.200");
+    ipmap_ip_set_range(&map, &first, &last, 1);
+
+    fail_unless(ipmap_ip_get(&map, &first) == 1,
+                "First address should be in the range");
+    fail_unless(ipmap_ip_get(&map, &last) == 1,
+                "Last address should be in the range");
+    fail_unless(ipmap_ipv4_get(&map, &IPV4_ADDR_3) == 1,
+                "Middle address should be in the range");
+
+    ipset_ip_from_string(&ip, "192.168.1.6");
+    fail_unless(ipmap_ip_get(&map, &ip) == 0,
+                "Address before the range shouldn't be in it");
+
+    ipset_ip_from_string(&ip, "192.168.9.201");
+    fail_unless(ipmap_ip_get(&map, &ip) == 0,
+                "Address after the range shouldn't be in it");
+
+    ipmap_done(&map);
+}
+END_TEST
+
 START_TEST(test_ipv4_bad_netmask_01)
 {
     ip_map_t  map;
@@ -458,6 +979,45 @@ START_TEST(test_ipv4_store_01)
 }
 END_TEST
 
+START_TEST(test_ipv4_store_compressed_01)
+{
+    ip_map_t  map;
+    ip_map_t  *read_map;
+
+    ipmap_init(&map, 0);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_1, 1);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_2, 2);
+    ipmap_ipv4_set_network(&map, &IPV4_ADDR_3, 24, 2);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipmap_save_compressed(ostream, &map,
+                                      IPSET_COMPRESSION_ZLIB, NULL),
+                "Could not save map");
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data
+        (g_memory_output_stream_get_data(mostream),
+         g_memory_output_stream_get_data_size(mostream),
+         NULL);
+
+    read_map = ipmap_load(istream, NULL);
+    fail_if(read_map == NULL,
+            "Could not read map");
+
+    fail_unless(ipmap_is_equal(&map, read_map),
+                "Map not same after saving/loading");
+
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipmap_done(&map);
+    ipmap_free(read_map);
+}
+END_TEST
+
 
 /*-----------------------------------------------------------------------
  * IPv6 tests
@@ -772,6 +1332,16 @@ ipmap_suite()
     tcase_add_test(tc_general, test_different_defaults_unequal);
     tcase_add_test(tc_general, test_store_empty_01);
     tcase_add_test(tc_general, test_store_empty_02);
+    tcase_add_test(tc_general, test_build_from_sorted_01);
+    tcase_add_test(tc_general, test_build_from_sorted_02);
+    tcase_add_test(tc_general, test_combine_01);
+    tcase_add_test(tc_general, test_combine_02);
+    tcase_add_test(tc_general, test_add_value_01);
+    tcase_add_test(tc_general, test_add_value_02);
+    tcase_add_test(tc_general, test_add_values_01);
+    tcase_add_test(tc_general, test_classifier_01);
+    tcase_add_test(tc_general, test_to_set_01);
+    tcase_add_test(tc_general, test_to_set_02);
     suite_add_tcase(s, tc_general);
 
     TCase  *tc_ipv4 = tcase_create("ipv4");
@@ -783,6 +1353,8 @@ ipmap_suite()
     tcase_add_test(tc_ipv4, test_ipv4_insert_network_02);
     tcase_add_test(tc_ipv4, test_ipv4_insert_network_03);
     tcase_add_test(tc_ipv4, test_ipv4_insert_network_04);
+    tcase_add_test(tc_ipv4, test_ipv4_lookup_prefix_01);
+    tcase_add_test(tc_ipv4, test_ipv4_insert_range_01);
     tcase_add_test(tc_ipv4, test_ipv4_bad_netmask_01);
     tcase_add_test(tc_ipv4, test_ipv4_bad_netmask_02);
     tcase_add_test(tc_ipv4, test_ipv4_equality_1);
@@ -791,6 +1363,7 @@ ipmap_suite()
     tcase_add_test(tc_ipv4, test_ipv4_memory_size_1);
     tcase_add_test(tc_ipv4, test_ipv4_memory_size_2);
     tcase_add_test(tc_ipv4, test_ipv4_store_01);
+    tcase_add_test(tc_ipv4, test_ipv4_store_compressed_01);
     suite_add_tcase(s, tc_ipv4);
 
     TCase  *tc_ipv6 = tcase_create("ipv6");
@@ -9,6 +9,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <check.h>
 #include <glib.h>
@@ -113,6 +114,431 @@ START_TEST(test_store_empty)
 END_TEST
 
 
+START_TEST(test_sample_empty)
+{
+    ip_set_t  set;
+    GRand  *rng = g_rand_new_with_seed(0);
+    ipset_ip_t  addr;
+
+    ipset_init(&set);
+    fail_if(ipset_sample(&set, rng, 1, &addr),
+            "Shouldn't be able to sample from an empty set");
+    ipset_done(&set);
+    g_rand_free(rng);
+}
+END_TEST
+
+START_TEST(test_sample_01)
+{
+    ip_set_t  set;
+    GRand  *rng = g_rand_new_with_seed(0);
+    ipset_ip_t  samples[600];
+    guint  ipv4_count = 0;
+    guint  i;
+
+    /*
+     * Five IPv4 addresses and five IPv6 addresses, so each kind should
+     * get about half of the samples.
+     */
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 30);
+    ipset_ipv4_add(&set, &IPV4_ADDR_3);
+    ipset_ipv6_add_network(&set, &IPV6_ADDR_1, 126);
+    ipset_ipv6_add(&set, &IPV6_ADDR_3);
+
+    fail_unless(ipset_sample(&set, rng, 600, samples),
+                "Could not sample from set");
+
+    for (i = 0; i < 600; i++)
+    {
+        fail_unless(ipset_ip_add(&set, &samples[i]),
+                    "Sample %u isn't in the set", i);
+
+        if (samples[i].is_ipv4)
+            ipv4_count++;
+    }
+
+    fail_unless((ipv4_count > 200) && (ipv4_count < 400),
+                "Expected about 300 IPv4 samples, got %u", ipv4_count);
+
+    ipset_done(&set);
+    g_rand_free(rng);
+}
+END_TEST
+
+
+START_TEST(test_select_rank_01)
+{
+    ip_set_t  set;
+    ipset_iterator_t  *it;
+    ipset_count_t  k = { 0, 0 };
+    ipset_count_t  one = { 0, 1 };
+
+    /*
+     * The k-th address we get from the iterator should be the same as
+     * the one we get from ipset_select, and its rank should be k.
+     */
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 30);
+    ipset_ipv4_add(&set, &IPV4_ADDR_3);
+    ipset_ipv6_add_network(&set, &IPV6_ADDR_1, 126);
+    ipset_ipv6_add(&set, &IPV6_ADDR_3);
+
+    for (it = ipset_iterate(&set, TRUE);
+         !it->finished;
+         ipset_iterator_advance(it))
+    {
+        ipset_ip_t  addr;
+        ipset_count_t  rank;
+
+        fail_unless(ipset_select(&set, &k, &addr),
+                    "Could not select address %" G_GUINT64_FORMAT,
+                    k.low);
+
+        fail_unless(ipset_ip_equal(&addr, &it->addr),
+                    "Wrong address for index %" G_GUINT64_FORMAT,
+                    k.low);
+
+        ipset_rank(&set, &it->addr, &rank);
+        fail_unless(ipset_count_compare(&rank, &k) == 0,
+                    "Expected rank %" G_GUINT64_FORMAT
+                    ", got %" G_GUINT64_FORMAT,
+                    k.low, rank.low);
+
+        ipset_count_add(&k, &k, &one);
+    }
+
+    ipset_iterator_free(it);
+
+    fail_unless(k.low == 10,
+                "Expected 10 addresses, got %" G_GUINT64_FORMAT, k.low);
+
+    {
+        ipset_ip_t  addr;
+
+        fail_if(ipset_select(&set, &k, &addr),
+                "Shouldn't be able to select past the end of the set");
+    }
+
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_select_rank_02)
+{
+    ip_set_t  set;
+    ipset_ip_t  addr;
+    ipset_ip_t  expected;
+    ipset_count_t  k;
+    ipset_count_t  rank;
+    ipv4_addr_t  first = "\x00\x00\x00\x00";
+    ipv4_addr_t  last = "\xff\xff\xff\xff";
+
+    /*
+     * Every IPv4 address, plus one IPv6 address.  There are exactly
+     * 2^32 IPv4 addresses, so the IPv6 address has rank 2^32.
+     */
+
+    ipset_init(&set);
+    ipset_ipv4_add_range(&set, &first, &last);
+    ipset_ipv6_add(&set, &IPV6_ADDR_1);
+
+    k.high = 0;
+    k.low = G_GUINT64_CONSTANT(0xffffffff);
+    fail_unless(ipset_select(&set, &k, &addr),
+                "Could not select the last IPv4 address");
+    ipset_ip_from_string(&expected, "255.255.255.255");
+    fail_unless(ipset_ip_equal(&addr, &expected),
+                "Expected 255.255.255.255");
+
+    ipset_rank(&set, &addr, &rank);
+    fail_unless(ipset_count_compare(&rank, &k) == 0,
+                "Expected rank 2^32-1, got %" G_GUINT64_FORMAT,
+                rank.low);
+
+    k.low = G_GUINT64_CONSTANT(1) << 32;
+    fail_unless(ipset_select(&set, &k, &addr),
+                "Could not select the IPv6 address");
+    ipset_ip_from_ipv6(&expected, &IPV6_ADDR_1);
+    fail_unless(ipset_ip_equal(&addr, &expected),
+                "Expected the IPv6 address");
+
+    ipset_rank(&set, &expected, &rank);
+    fail_unless(ipset_count_compare(&rank, &k) == 0,
+                "Expected rank 2^32, got %" G_GUINT64_FORMAT,
+                rank.low);
+
+    k.low++;
+    fail_if(ipset_select(&set, &k, &addr),
+            "Shouldn't be able to select past the end of the set");
+
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_rank_non_member_01)
+{
+    ip_set_t  set;
+    ipset_ip_t  addr;
+    ipset_count_t  rank;
+
+    /*
+     * 192.168.1.102 isn't in the set, but .100 and .101 are smaller
+     * than it.
+     */
+
+    ipset_init(&set);
+    ipset_ipv4_add(&set, &IPV4_ADDR_1);
+    ipset_ipv4_add(&set, &IPV4_ADDR_2);
+    ipset_ipv4_add(&set, &IPV4_ADDR_3);
+
+    ipset_ip_from_string(&addr, "192.168.1.102");
+    ipset_rank(&set, &addr, &rank);
+
+    fail_unless((rank.high == 0) && (rank.low == 2),
+                "Expected rank 2, got %" G_GUINT64_FORMAT, rank.low);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_subset_01)
+{
+    ip_set_t  set1, set2;
+
+    ipset_init(&set1);
+    ipset_init(&set2);
+
+    ipset_ipv4_add(&set1, &IPV4_ADDR_1);
+    ipset_ipv6_add(&set1, &IPV6_ADDR_1);
+
+    ipset_ipv4_add_network(&set2, &IPV4_ADDR_1, 24);
+    ipset_ipv6_add_network(&set2, &IPV6_ADDR_1, 64);
+
+    fail_unless(ipset_is_subset(&set1, &set2),
+                "First set should be a subset of the second");
+    fail_if(ipset_is_subset(&set2, &set1),
+            "Second set should not be a subset of the first");
+    fail_unless(ipset_is_subset(&set1, &set1),
+                "Set should be a subset of itself");
+
+    ipset_ipv4_add(&set1, &IPV4_ADDR_3);
+
+    fail_if(ipset_is_subset(&set1, &set2),
+            "First set should no longer be a subset of the second");
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
+START_TEST(test_disjoint_01)
+{
+    ip_set_t  set1, set2;
+    guint  and_size, node_size;
+
+    ipset_init(&set1);
+    ipset_init(&set2);
+
+    ipset_ipv4_add_network(&set1, &IPV4_ADDR_1, 24);
+    ipset_ipv6_add(&set1, &IPV6_ADDR_1);
+
+    ipset_ipv4_add(&set2, &IPV4_ADDR_3);
+    ipset_ipv6_add(&set2, &IPV6_ADDR_2);
+
+    fail_unless(ipset_is_disjoint(&set1, &set2),
+                "Sets should be disjoint");
+
+    ipset_ipv6_add(&set2, &IPV6_ADDR_1);
+
+    /*
+     * Comparing the sets shouldn't have added anything to the node
+     * cache.
+     */
+
+    and_size = g_hash_table_size(ipset_cache->and_cache);
+    node_size = g_hash_table_size(ipset_cache->node_cache);
+
+    fail_if(ipset_is_disjoint(&set1, &set2),
+            "Sets should overlap");
+
+    fail_unless(g_hash_table_size(ipset_cache->and_cache) == and_size,
+                "Disjointness test shouldn't use the AND cache");
+    fail_unless(g_hash_table_size(ipset_cache->node_cache) == node_size,
+                "Disjointness test shouldn't create nodes");
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
+START_TEST(test_intersection_count_01)
+{
+    ip_set_t  set1, set2;
+    ipset_count_t  count;
+
+    ipset_init(&set1);
+    ipset_init(&set2);
+
+    /*
+     * 192.168.1.0/24 and 192.168.1.100/30 share 4 addresses, and the
+     * IPv6 networks share 2^62.
+     */
+
+    ipset_ipv4_add_network(&set1, &IPV4_ADDR_1, 24);
+    ipset_ipv4_add_network(&set2, &IPV4_ADDR_1, 30);
+    ipset_ipv4_add(&set2, &IPV4_ADDR_3);
+
+    ipset_ipv6_add_network(&set1, &IPV6_ADDR_1, 64);
+    ipset_ipv6_add_network(&set2, &IPV6_ADDR_1, 66);
+
+    ipset_intersection_count(&set1, &set2, &count);
+
+    fail_unless((count.high == 0) &&
+                (count.low == G_GUINT64_CONSTANT(4) +
+                 (G_GUINT64_CONSTANT(1) << 62)),
+                "Unexpected intersection size %016" G_GINT64_MODIFIER "x"
+                "%016" G_GINT64_MODIFIER "x",
+                count.high, count.low);
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
+START_TEST(test_intersection_count_02)
+{
+    ip_set_t  set1, set2;
+    ipset_count_t  count;
+    ipv4_addr_t  first = "\x00\x00\x00\x00";
+    ipv4_addr_t  last = "\xff\xff\xff\xff";
+
+    /*
+     * Two sets that both contain every IPv4 address share exactly
+     * 2^32 of them.
+     */
+
+    ipset_init(&set1);
+    ipset_init(&set2);
+
+    ipset_ipv4_add_range(&set1, &first, &last);
+    ipset_ipv4_add_range(&set2, &first, &last);
+
+    ipset_intersection_count(&set1, &set2, &count);
+
+    fail_unless((count.high == 0) &&
+                (count.low == (G_GUINT64_CONSTANT(1) << 32)),
+                "Unexpected intersection size %016" G_GINT64_MODIFIER "x"
+                "%016" G_GINT64_MODIFIER "x",
+                count.high, count.low);
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
+
+START_TEST(test_network_relation_01)
+{
+    ip_set_t  set;
+    ipset_ip_t  addr;
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24);
+    ipset_ipv4_add(&set, &IPV4_ADDR_3);
+
+    ipset_ip_from_string(&addr, "192.168.1.0");
+    fail_unless(ipset_network_relation(&set, &addr, 24) ==
+                IPSET_NETWORK_ALL,
+                "192.168.1.0/24 should be entirely in the set");
+    fail_unless(ipset_network_relation(&set, &addr, 28) ==
+                IPSET_NETWORK_ALL,
+                "192.168.1.0/28 should be entirely in the set");
+    fail_unless(ipset_network_relation(&set, &addr, 16) ==
+                IPSET_NETWORK_SOME,
+                "192.168.0.0/16 should be partly in the set");
+    fail_unless(ipset_network_relation(&set, &addr, 0) ==
+                IPSET_NETWORK_SOME,
+                "IPv4 space should be partly in the set");
+
+    ipset_ip_from_string(&addr, "192.168.2.0");
+    fail_unless(ipset_network_relation(&set, &addr, 24) ==
+                IPSET_NETWORK_SOME,
+                "192.168.2.0/24 should be partly in the set");
+    fail_unless(ipset_network_relation(&set, &addr, 30) ==
+                IPSET_NETWORK_NONE,
+                "192.168.2.0/30 shouldn't be in the set");
+
+    ipset_ip_from_string(&addr, "192.168.2.100");
+    fail_unless(ipset_network_relation(&set, &addr, 32) ==
+                IPSET_NETWORK_ALL,
+                "192.168.2.100 should be in the set");
+
+    ipset_ip_from_string(&addr, "fe80::");
+    fail_unless(ipset_network_relation(&set, &addr, 0) ==
+                IPSET_NETWORK_NONE,
+                "No IPv6 addresses should be in the set");
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_coarsen_01)
+{
+    ip_set_t  set, coarse, expected;
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24);
+    ipset_ipv4_add(&set, &IPV4_ADDR_3);
+    ipset_ipv6_add(&set, &IPV6_ADDR_1);
+
+    /*
+     * Every /24 that contains a member: 192.168.1.0/24 and
+     * 192.168.2.0/24, plus the /64 around the IPv6 address.
+     */
+
+    ipset_init(&expected);
+    ipset_ipv4_add_network(&expected, &IPV4_ADDR_1, 24);
+    ipset_ipv4_add_network(&expected, &IPV4_ADDR_3, 24);
+    ipset_ipv6_add_network(&expected, &IPV6_ADDR_1, 64);
+
+    ipset_coarsen_any(&coarse, &set, 24, 64);
+    fail_unless(ipset_is_equal(&coarse, &expected),
+                "Wrong networks that contain a member");
+    ipset_done(&coarse);
+    ipset_done(&expected);
+
+    /*
+     * Only 192.168.1.0/24 is fully covered.
+     */
+
+    ipset_init(&expected);
+    ipset_ipv4_add_network(&expected, &IPV4_ADDR_1, 24);
+
+    ipset_coarsen_all(&coarse, &set, 24, 64);
+    fail_unless(ipset_is_equal(&coarse, &expected),
+                "Wrong networks that are fully covered");
+    ipset_done(&coarse);
+    ipset_done(&expected);
+
+    /*
+     * Coarsening to the full address length doesn't change the set.
+     */
+
+    ipset_coarsen_all(&coarse, &set, 32, 128);
+    fail_unless(ipset_is_equal(&coarse, &set),
+                "Coarsening to full addresses should be a no-op");
+    ipset_done(&coarse);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
 /*-----------------------------------------------------------------------
  * IPv4 tests
  */
@@ -164,160 +590,655 @@ START_TEST(test_ipv4_insert_network_01)
     fail_unless(ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24),
                 "Element should be present");
 
-    ipset_done(&set);
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_ipv4_insert_network_02)
+{
+    ip_set_t  set;
+
+    ipset_init(&set);
+
+    ipset_ip_t  ip;
+    ipset_ip_from_string(&ip, "192.168.1.100");
+
+    fail_if(ipset_ip_add_network(&set, &ip, 24),
+            "Element should not be present");
+
+    fail_unless(ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24),
+                "Element should be present");
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_insert_range_01)
+{
+    ip_set_t  set1, set2;
+    guint32  first = 0x01020307;  /* 1.2.3.7 */
+    guint32  last = 0x010209c8;   /* 1.2.9.200 */
+    guint32  i;
+
+    /*
+     * Adding the range should give the same set as adding each of its
+     * addresses separately.
+     */
+
+    ipset_init(&set1);
+    ipset_init(&set2);
+
+    {
+        guint32  first_be = g_htonl(first);
+        guint32  last_be = g_htonl(last);
+
+        fail_if(ipset_ipv4_add_range(&set1, &first_be, &last_be),
+                "Range should not be present");
+        fail_unless(ipset_ipv4_add_range(&set1, &first_be, &last_be),
+                    "Range should be present");
+    }
+
+    for (i = first; i <= last; i++)
+    {
+        guint32  addr = g_htonl(i);
+        ipset_ipv4_add(&set2, &addr);
+    }
+
+    fail_unless(ipset_is_equal(&set1, &set2),
+                "Range should equal its individual addresses");
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
+START_TEST(test_ipv4_insert_range_02)
+{
+    ip_set_t  set;
+
+    /*
+     * A backwards range is empty; a range with one address is just
+     * that address.
+     */
+
+    ipset_init(&set);
+
+    ipset_ipv4_add_range(&set, &IPV4_ADDR_2, &IPV4_ADDR_1);
+    fail_unless(ipset_is_empty(&set),
+                "Backwards range should be empty");
+
+    ipset_ipv4_add_range(&set, &IPV4_ADDR_1, &IPV4_ADDR_1);
+    fail_unless(ipset_ipv4_add(&set, &IPV4_ADDR_1),
+                "Element should be present");
+    fail_if(ipset_ipv4_add(&set, &IPV4_ADDR_2),
+            "Element should not be present");
+
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_ipv4_bad_netmask_01)
+{
+    ip_set_t  set;
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 0);
+    fail_unless(ipset_is_empty(&set),
+                "Bad netmask shouldn't change set");
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_ipv4_bad_netmask_02)
+{
+    ip_set_t  set;
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 33);
+    fail_unless(ipset_is_empty(&set),
+                "Bad netmask shouldn't change set");
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_ipv4_equality_1)
+{
+    ip_set_t  set1, set2;
+
+    ipset_init(&set1);
+    ipset_ipv4_add(&set1, &IPV4_ADDR_1);
+
+    ipset_init(&set2);
+    ipset_ipv4_add(&set2, &IPV4_ADDR_1);
+
+    fail_unless(ipset_is_equal(&set1, &set2),
+                "Expected {x} == {x}");
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
+START_TEST(test_ipv4_inequality_1)
+{
+    ip_set_t  set1, set2;
+
+    ipset_init(&set1);
+    ipset_ipv4_add(&set1, &IPV4_ADDR_1);
+
+    ipset_init(&set2);
+    ipset_ipv4_add_network(&set2, &IPV4_ADDR_1, 24);
+
+    fail_unless(ipset_is_not_equal(&set1, &set2),
+                "Expected {x} != {x}");
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
+START_TEST(test_ipv4_memory_size_1)
+{
+    ip_set_t  set;
+    size_t  expected, actual;
+
+    ipset_init(&set);
+    ipset_ipv4_add(&set, &IPV4_ADDR_1);
+
+#if GLIB_SIZEOF_VOID_P == 4
+    expected = 396;
+#elif GLIB_SIZEOF_VOID_P == 8
+    expected = 792;
+#else
+#   error "Unknown architecture: not 32-bit or 64-bit"
+#endif
+    actual = ipset_memory_size(&set);
+
+    fail_unless(expected == actual,
+                "Expected set to be %zu bytes, got %zu bytes",
+                expected, actual);
+
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_ipv4_memory_size_2)
+{
+    ip_set_t  set;
+    size_t  expected, actual;
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24);
+
+#if GLIB_SIZEOF_VOID_P == 4
+    expected = 300;
+#elif GLIB_SIZEOF_VOID_P == 8
+    expected = 600;
+#else
+#   error "Unknown architecture: not 32-bit or 64-bit"
+#endif
+    actual = ipset_memory_size(&set);
+
+    fail_unless(expected == actual,
+                "Expected set to be %zu bytes, got %zu bytes",
+                expected, actual);
+
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_ipv4_store_01)
+{
+    ip_set_t  set;
+    ip_set_t  *read_set;
+
+    ipset_init(&set);
+    ipset_ipv4_add(&set, &IPV4_ADDR_1);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_save(ostream, &set, NULL),
+                "Could not save set");
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data
+        (g_memory_output_stream_get_data(mostream),
+         g_memory_output_stream_get_data_size(mostream),
+         NULL);
+
+    read_set = ipset_load(istream, NULL);
+    fail_if(read_set == NULL,
+            "Could not read set");
+
+    fail_unless(ipset_is_equal(&set, read_set),
+                "Set not same after saving/loading");
+
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&set);
+    ipset_free(read_set);
+}
+END_TEST
+
+START_TEST(test_ipv4_store_02)
+{
+    ip_set_t  set;
+    ip_set_t  *read_set;
+
+    ipset_init(&set);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_save(ostream, &set, NULL),
+                "Could not save set");
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data
+        (g_memory_output_stream_get_data(mostream),
+         g_memory_output_stream_get_data_size(mostream),
+         NULL);
+
+    read_set = ipset_load(istream, NULL);
+    fail_if(read_set == NULL,
+            "Could not read set");
+
+    fail_unless(ipset_is_equal(&set, read_set),
+                "Set not same after saving/loading");
+
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&set);
+    ipset_free(read_set);
+}
+END_TEST
+
+START_TEST(test_ipv4_store_03)
+{
+    ip_set_t  set;
+    ip_set_t  *read_set;
+
+    ipset_init(&set);
+    ipset_ipv4_add(&set, &IPV4_ADDR_1);
+    ipset_ipv4_add(&set, &IPV4_ADDR_2);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_3, 24);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_save(ostream, &set, NULL),
+                "Could not save set");
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data
+        (g_memory_output_stream_get_data(mostream),
+         g_memory_output_stream_get_data_size(mostream),
+         NULL);
+
+    read_set = ipset_load(istream, NULL);
+    fail_if(read_set == NULL,
+            "Could not read set");
+
+    fail_unless(ipset_is_equal(&set, read_set),
+                "Set not same after saving/loading");
+
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&set);
+    ipset_free(read_set);
+}
+END_TEST
+
+START_TEST(test_ipv4_store_compressed_01)
+{
+    ip_set_t  set;
+    ip_set_t  *read_set;
+
+    ipset_init(&set);
+    ipset_ipv4_add(&set, &IPV4_ADDR_1);
+    ipset_ipv4_add(&set, &IPV4_ADDR_2);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_3, 24);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_save_compressed(ostream, &set,
+                                      IPSET_COMPRESSION_ZLIB, NULL),
+                "Could not save set");
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data
+        (g_memory_output_stream_get_data(mostream),
+         g_memory_output_stream_get_data_size(mostream),
+         NULL);
+
+    read_set = ipset_load(istream, NULL);
+    fail_if(read_set == NULL,
+            "Could not read set");
+
+    fail_unless(ipset_is_equal(&set, read_set),
+                "Set not same after saving/loading");
+
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&set);
+    ipset_free(read_set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_store_archive_01)
+{
+    ip_set_t  set1;
+    ip_set_t  set2;
+    ip_map_t  map;
+
+    ipset_init(&set1);
+    ipset_ipv4_add(&set1, &IPV4_ADDR_1);
+    ipset_ipv4_add_network(&set1, &IPV4_ADDR_3, 24);
+
+    ipset_init(&set2);
+    ipset_ipv4_add(&set2, &IPV4_ADDR_2);
+    ipset_ipv4_add_network(&set2, &IPV4_ADDR_3, 24);
+
+    ipmap_init(&map, 0);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_1, 1);
+    ipmap_ipv4_set(&map, &IPV4_ADDR_2, 2);
+
+    ipset_archive_t  *archive = ipset_archive_new();
+    ipset_archive_add_set(archive, "set1", &set1);
+    ipset_archive_add_set(archive, "set2", &set2);
+    ipset_archive_add_map(archive, "map", &map);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_archive_save(ostream, archive, NULL),
+                "Could not save archive");
+    ipset_archive_free(archive);
+
+    gpointer  buf = g_memory_output_stream_get_data(mostream);
+    gsize  len = g_memory_output_stream_get_data_size(mostream);
+
+    /*
+     * Load everything in the archive at once.
+     */
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    archive = ipset_archive_load(istream, NULL);
+    fail_if(archive == NULL,
+            "Could not read archive");
+
+    ip_set_t  *read_set = ipset_archive_get_set(archive, "set2");
+    fail_if(read_set == NULL,
+            "Could not find set in archive");
+    fail_unless(ipset_is_equal(&set2, read_set),
+                "Set not same after saving/loading");
+    ipset_free(read_set);
+
+    ip_map_t  *read_map = ipset_archive_get_map(archive, "map");
+    fail_if(read_map == NULL,
+            "Could not find map in archive");
+    fail_unless(ipmap_is_equal(&map, read_map),
+                "Map not same after saving/loading");
+    ipmap_free(read_map);
+
+    fail_unless(ipset_archive_get_set(archive, "set3") == NULL,
+                "Shouldn't find missing set in archive");
+
+    ipset_archive_free(archive);
+    g_object_unref(istream);
+
+    /*
+     * Then load a single set.
+     */
+
+    istream = g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    read_set = ipset_load_from_archive(istream, "set1", NULL);
+    fail_if(read_set == NULL,
+            "Could not read set from archive");
+    fail_unless(ipset_is_equal(&set1, read_set),
+                "Set not same after saving/loading");
+
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&set1);
+    ipset_done(&set2);
+    ipmap_done(&map);
+    ipset_free(read_set);
 }
 END_TEST
 
-START_TEST(test_ipv4_insert_network_02)
+
+START_TEST(test_ipv4_store_patch_01)
 {
-    ip_set_t  set;
+    ip_set_t  old_set;
+    ip_set_t  new_set;
+    ip_set_t  other_set;
+    ip_set_t  *read_set;
 
-    ipset_init(&set);
+    ipset_init(&old_set);
+    ipset_ipv4_add(&old_set, &IPV4_ADDR_1);
+    ipset_ipv4_add_network(&old_set, &IPV4_ADDR_3, 24);
 
-    ipset_ip_t  ip;
-    ipset_ip_from_string(&ip, "192.168.1.100");
+    ipset_init(&new_set);
+    ipset_ipv4_add(&new_set, &IPV4_ADDR_1);
+    ipset_ipv4_add(&new_set, &IPV4_ADDR_2);
+    ipset_ipv4_add_network(&new_set, &IPV4_ADDR_3, 24);
 
-    fail_if(ipset_ip_add_network(&set, &ip, 24),
-            "Element should not be present");
+    ipset_init(&other_set);
+    ipset_ipv4_add(&other_set, &IPV4_ADDR_2);
 
-    fail_unless(ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24),
-                "Element should be present");
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
 
-    ipset_done(&set);
-}
-END_TEST
+    fail_unless(ipset_diff_save(ostream, &old_set, &new_set, NULL),
+                "Could not save patch");
 
-START_TEST(test_ipv4_bad_netmask_01)
-{
-    ip_set_t  set;
+    gpointer  buf = g_memory_output_stream_get_data(mostream);
+    gsize  len = g_memory_output_stream_get_data_size(mostream);
 
-    ipset_init(&set);
-    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 0);
-    fail_unless(ipset_is_empty(&set),
-                "Bad netmask shouldn't change set");
-    ipset_done(&set);
-}
-END_TEST
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data(buf, len, NULL);
 
-START_TEST(test_ipv4_bad_netmask_02)
-{
-    ip_set_t  set;
+    read_set = ipset_patch_load(istream, &old_set, NULL);
+    fail_if(read_set == NULL,
+            "Could not apply patch");
 
-    ipset_init(&set);
-    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 33);
-    fail_unless(ipset_is_empty(&set),
-                "Bad netmask shouldn't change set");
-    ipset_done(&set);
-}
-END_TEST
+    fail_unless(ipset_is_equal(&new_set, read_set),
+                "Set not same after patching");
 
-START_TEST(test_ipv4_equality_1)
-{
-    ip_set_t  set1, set2;
+    ipset_free(read_set);
+    g_object_unref(istream);
 
-    ipset_init(&set1);
-    ipset_ipv4_add(&set1, &IPV4_ADDR_1);
+    /*
+     * The patch shouldn't apply to a different base set.
+     */
 
-    ipset_init(&set2);
-    ipset_ipv4_add(&set2, &IPV4_ADDR_1);
+    istream = g_memory_input_stream_new_from_data(buf, len, NULL);
 
-    fail_unless(ipset_is_equal(&set1, &set2),
-                "Expected {x} == {x}");
+    GError  *error = NULL;
+    read_set = ipset_patch_load(istream, &other_set, &error);
+    fail_unless(read_set == NULL,
+                "Shouldn't apply patch to the wrong set");
+    fail_if(error == NULL,
+            "Applying patch to wrong set should raise an error");
 
-    ipset_done(&set1);
-    ipset_done(&set2);
+    g_clear_error(&error);
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&old_set);
+    ipset_done(&new_set);
+    ipset_done(&other_set);
 }
 END_TEST
 
-START_TEST(test_ipv4_inequality_1)
+
+START_TEST(test_ipv4_store_patch_02)
 {
-    ip_set_t  set1, set2;
+    ip_set_t  old_set;
+    ip_set_t  new_set;
+    ip_set_t  other_set;
+    ip_set_t  *read_set;
 
-    ipset_init(&set1);
-    ipset_ipv4_add(&set1, &IPV4_ADDR_1);
+    /*
+     * The wrong base has the same number of nodes as the real one, so
+     * only the fingerprint can tell them apart.
+     */
 
-    ipset_init(&set2);
-    ipset_ipv4_add_network(&set2, &IPV4_ADDR_1, 24);
+    ipset_init(&old_set);
+    ipset_ipv4_add(&old_set, &IPV4_ADDR_1);
 
-    fail_unless(ipset_is_not_equal(&set1, &set2),
-                "Expected {x} != {x}");
+    ipset_init(&new_set);
+    ipset_ipv4_add(&new_set, &IPV4_ADDR_1);
+    ipset_ipv4_add(&new_set, &IPV4_ADDR_3);
 
-    ipset_done(&set1);
-    ipset_done(&set2);
-}
-END_TEST
+    ipset_init(&other_set);
+    ipset_ipv4_add(&other_set, &IPV4_ADDR_2);
 
-START_TEST(test_ipv4_memory_size_1)
-{
-    ip_set_t  set;
-    size_t  expected, actual;
+    fail_unless(ipset_memory_size(&old_set) ==
+                ipset_memory_size(&other_set),
+                "Base sets should have the same number of nodes");
 
-    ipset_init(&set);
-    ipset_ipv4_add(&set, &IPV4_ADDR_1);
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
 
-#if GLIB_SIZEOF_VOID_P == 4
-    expected = 396;
-#elif GLIB_SIZEOF_VOID_P == 8
-    expected = 792;
-#else
-#   error "Unknown architecture: not 32-bit or 64-bit"
-#endif
-    actual = ipset_memory_size(&set);
+    fail_unless(ipset_diff_save(ostream, &old_set, &new_set, NULL),
+                "Could not save patch");
 
-    fail_unless(expected == actual,
-                "Expected set to be %zu bytes, got %zu bytes",
-                expected, actual);
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data
+        (g_memory_output_stream_get_data(mostream),
+         g_memory_output_stream_get_data_size(mostream),
+         NULL);
 
-    ipset_done(&set);
+    GError  *error = NULL;
+    read_set = ipset_patch_load(istream, &other_set, &error);
+    fail_unless(read_set == NULL,
+                "Shouldn't apply patch to the wrong set");
+    fail_unless(g_error_matches(error, IPSET_ERROR,
+                                IPSET_ERROR_PARSE_ERROR),
+                "Applying patch to wrong set should raise a parse error");
+
+    g_clear_error(&error);
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&old_set);
+    ipset_done(&new_set);
+    ipset_done(&other_set);
 }
 END_TEST
 
-START_TEST(test_ipv4_memory_size_2)
+
+START_TEST(test_ipv4_store_patch_corrupt_root)
 {
     ip_set_t  set;
-    size_t  expected, actual;
+    ip_set_t  *read_set;
+    guint8  buf[36];
+    guint64  fingerprint;
+    guint  i;
+
+    /*
+     * A patch for the empty set whose root is G_MININT32, which can't
+     * be negated as a gint.
+     */
 
     ipset_init(&set);
-    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24);
+    fingerprint = ipset_fingerprint(&set);
+
+    memcpy(buf, "IP set", 6);
+    buf[6] = 0x00; buf[7] = 0x04;             /* version */
+    memset(buf + 8, 0, 8);
+    buf[15] = sizeof(buf);                    /* length */
+    memset(buf + 16, 0, 4);                   /* base nonterminals */
+    for (i = 0; i < 8; i++)                   /* base fingerprint */
+        buf[20 + i] = (fingerprint >> (56 - 8*i)) & 0xff;
+    memset(buf + 28, 0, 4);                   /* new nonterminals */
+    buf[32] = 0x80; buf[33] = 0x00;           /* root */
+    buf[34] = 0x00; buf[35] = 0x00;
 
-#if GLIB_SIZEOF_VOID_P == 4
-    expected = 300;
-#elif GLIB_SIZEOF_VOID_P == 8
-    expected = 600;
-#else
-#   error "Unknown architecture: not 32-bit or 64-bit"
-#endif
-    actual = ipset_memory_size(&set);
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data(buf, sizeof(buf), NULL);
 
-    fail_unless(expected == actual,
-                "Expected set to be %zu bytes, got %zu bytes",
-                expected, actual);
+    GError  *error = NULL;
+    read_set = ipset_patch_load(istream, &set, &error);
+    fail_unless(read_set == NULL,
+                "Shouldn't load a patch with a corrupt root");
+    fail_unless(g_error_matches(error, IPSET_ERROR,
+                                IPSET_ERROR_PARSE_ERROR),
+                "Corrupt root should raise a parse error");
 
+    g_clear_error(&error);
+    g_object_unref(istream);
     ipset_done(&set);
 }
 END_TEST
 
-START_TEST(test_ipv4_store_01)
+
+START_TEST(test_ipv4_store_fingerprinted_01)
 {
     ip_set_t  set;
     ip_set_t  *read_set;
 
     ipset_init(&set);
     ipset_ipv4_add(&set, &IPV4_ADDR_1);
+    ipset_ipv4_add(&set, &IPV4_ADDR_2);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_3, 24);
 
     GOutputStream  *ostream =
         g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
     GMemoryOutputStream  *mostream =
         G_MEMORY_OUTPUT_STREAM(ostream);
 
-    fail_unless(ipset_save(ostream, &set, NULL),
+    fail_unless(ipset_save_fingerprinted(ostream, &set,
+                                         IPSET_COMPRESSION_NONE, NULL),
                 "Could not save set");
 
+    gpointer  buf = g_memory_output_stream_get_data(mostream);
+    gsize  len = g_memory_output_stream_get_data_size(mostream);
+
+    /*
+     * We should be able to read the fingerprint without loading the
+     * set.
+     */
+
     GInputStream  *istream =
-        g_memory_input_stream_new_from_data
-        (g_memory_output_stream_get_data(mostream),
-         g_memory_output_stream_get_data_size(mostream),
-         NULL);
+        g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    guint64  fingerprint = 0;
+    fail_unless(ipset_read_fingerprint(istream, &fingerprint, NULL),
+                "Could not read fingerprint");
+
+    fail_unless(fingerprint == ipset_fingerprint(&set),
+                "Fingerprint not same after saving");
+
+    g_object_unref(istream);
+
+    /*
+     * Loading the set should verify the fingerprint.
+     */
+
+    istream = g_memory_input_stream_new_from_data(buf, len, NULL);
 
     read_set = ipset_load(istream, NULL);
     fail_if(read_set == NULL,
@@ -326,20 +1247,48 @@ START_TEST(test_ipv4_store_01)
     fail_unless(ipset_is_equal(&set, read_set),
                 "Set not same after saving/loading");
 
+    g_object_unref(istream);
+    ipset_free(read_set);
+
+    /*
+     * A corrupted fingerprint should be caught.
+     */
+
+    ((guint8 *) buf)[8] ^= 0x01;
+    istream = g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    GError  *error = NULL;
+    read_set = ipset_load(istream, &error);
+    fail_unless(read_set == NULL,
+                "Shouldn't load set with wrong fingerprint");
+
+    g_clear_error(&error);
     g_object_unref(ostream);
     g_object_unref(istream);
     ipset_done(&set);
-    ipset_free(read_set);
 }
 END_TEST
 
-START_TEST(test_ipv4_store_02)
+
+static void
+store_async_loaded(GObject *source, GAsyncResult *result,
+                   gpointer user_data)
+{
+    GError  *error = NULL;
+    ip_set_t  **read_set = user_data;
+    *read_set = ipset_load_finish(result, &error);
+    g_clear_error(&error);
+}
+
+START_TEST(test_ipv4_store_async_01)
 {
     ip_set_t  set;
     ip_set_t  *read_set;
 
     ipset_init(&set);
-    ipset_ipv4_add_network(&set, &IPV4_ADDR_1, 24);
+    ipset_ipv4_add(&set, &IPV4_ADDR_1);
+    ipset_ipv4_add(&set, &IPV4_ADDR_2);
+    ipset_ipv4_add_network(&set, &IPV4_ADDR_3, 24);
 
     GOutputStream  *ostream =
         g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
@@ -349,61 +1298,127 @@ START_TEST(test_ipv4_store_02)
     fail_unless(ipset_save(ostream, &set, NULL),
                 "Could not save set");
 
+    gpointer  buf = g_memory_output_stream_get_data(mostream);
+    gsize  len = g_memory_output_stream_get_data_size(mostream);
+
     GInputStream  *istream =
-        g_memory_input_stream_new_from_data
-        (g_memory_output_stream_get_data(mostream),
-         g_memory_output_stream_get_data_size(mostream),
-         NULL);
+        g_memory_input_stream_new_from_data(buf, len, NULL);
 
-    read_set = ipset_load(istream, NULL);
-    fail_if(read_set == NULL,
-            "Could not read set");
+    /*
+     * Load the set on a worker thread, and wait for the callback.
+     */
+
+    read_set = NULL;
+    ipset_load_async(istream, NULL, store_async_loaded, &read_set);
+
+    while (read_set == NULL)
+        g_main_context_iteration(NULL, TRUE);
 
     fail_unless(ipset_is_equal(&set, read_set),
                 "Set not same after saving/loading");
 
+    ipset_free(read_set);
+    g_object_unref(istream);
+
+    /*
+     * A cancelled load shouldn't produce a set.
+     */
+
+    istream = g_memory_input_stream_new_from_data(buf, len, NULL);
+
+    GCancellable  *cancellable = g_cancellable_new();
+    g_cancellable_cancel(cancellable);
+
+    read_set = &set;
+    ipset_load_async(istream, cancellable,
+                     store_async_loaded, &read_set);
+
+    while (read_set == &set)
+        g_main_context_iteration(NULL, TRUE);
+
+    fail_unless(read_set == NULL,
+                "Cancelled load shouldn't return a set");
+
+    g_object_unref(cancellable);
     g_object_unref(ostream);
     g_object_unref(istream);
     ipset_done(&set);
-    ipset_free(read_set);
 }
 END_TEST
 
-START_TEST(test_ipv4_store_03)
+static void
+store_async_saved(GObject *source, GAsyncResult *result,
+                  gpointer user_data)
+{
+    GError  *error = NULL;
+    gint  *saved = user_data;
+    *saved = ipset_save_finish(result, &error)? 1: -1;
+    g_clear_error(&error);
+}
+
+START_TEST(test_ipv4_store_async_02)
 {
     ip_set_t  set;
     ip_set_t  *read_set;
+    gint  saved;
 
     ipset_init(&set);
     ipset_ipv4_add(&set, &IPV4_ADDR_1);
     ipset_ipv4_add(&set, &IPV4_ADDR_2);
     ipset_ipv4_add_network(&set, &IPV4_ADDR_3, 24);
 
+    /*
+     * Save the set on a worker thread with compression, and wait for
+     * the callback.  The result should be the same as a synchronous
+     * compressed save.
+     */
+
     GOutputStream  *ostream =
         g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
     GMemoryOutputStream  *mostream =
         G_MEMORY_OUTPUT_STREAM(ostream);
 
-    fail_unless(ipset_save(ostream, &set, NULL),
+    saved = 0;
+    ipset_save_async(ostream, &set, IPSET_COMPRESSION_ZLIB,
+                     NULL, store_async_saved, &saved);
+
+    while (saved == 0)
+        g_main_context_iteration(NULL, TRUE);
+
+    fail_unless(saved == 1, "Could not save set");
+
+    GOutputStream  *sync_ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *sync_mostream =
+        G_MEMORY_OUTPUT_STREAM(sync_ostream);
+
+    fail_unless(ipset_save_compressed(sync_ostream, &set,
+                                      IPSET_COMPRESSION_ZLIB, NULL),
                 "Could not save set");
 
-    GInputStream  *istream =
-        g_memory_input_stream_new_from_data
-        (g_memory_output_stream_get_data(mostream),
-         g_memory_output_stream_get_data_size(mostream),
-         NULL);
+    gpointer  buf = g_memory_output_stream_get_data(mostream);
+    gsize  len = g_memory_output_stream_get_data_size(mostream);
 
-    read_set = ipset_load(istream, NULL);
-    fail_if(read_set == NULL,
-            "Could not read set");
+    fail_unless
+        ((len == g_memory_output_stream_get_data_size(sync_mostream)) &&
+         (memcmp(buf, g_memory_output_stream_get_data(sync_mostream),
+                 len) == 0),
+         "Asynchronous save doesn't match synchronous save");
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data(buf, len, NULL);
 
+    GError  *error = NULL;
+    read_set = ipset_load(istream, &error);
+    fail_unless(read_set != NULL, "Could not load set");
     fail_unless(ipset_is_equal(&set, read_set),
                 "Set not same after saving/loading");
 
+    ipset_free(read_set);
+    g_object_unref(sync_ostream);
     g_object_unref(ostream);
     g_object_unref(istream);
     ipset_done(&set);
-    ipset_free(read_set);
 }
 END_TEST
 
@@ -482,6 +1497,36 @@ START_TEST(test_ipv6_insert_network_02)
 }
 END_TEST
 
+
+START_TEST(test_ipv6_insert_range_01)
+{
+    ip_set_t  set1, set2;
+    ipset_ip_t  first, last;
+
+    /*
+     * fe80::ffff:ffff:ffff:fffe through fe80:0:0:1::1 crosses a /64
+     * boundary, and covers exactly four addresses.
+     */
+
+    ipset_init(&set1);
+    ipset_init(&set2);
+
+    ipset_ip_from_string(&first, "fe80::ffff:ffff:ffff:fffe");
+    ipset_ip_from_string(&last, "fe80:0:0:1::1");
+    ipset_ip_add_range(&set1, &first, &last);
+
+    ipset_ip_add_network(&set2, &first, 127);
+    ipset_ip_from_string(&first, "fe80:0:0:1::");
+    ipset_ip_add_network(&set2, &first, 127);
+
+    fail_unless(ipset_is_equal(&set1, &set2),
+                "Range should equal its networks");
+
+    ipset_done(&set1);
+    ipset_done(&set2);
+}
+END_TEST
+
 START_TEST(test_ipv6_bad_netmask_01)
 {
     ip_set_t  set;
@@ -702,6 +1747,45 @@ START_TEST(test_ipv6_store_03)
 }
 END_TEST
 
+START_TEST(test_ipv6_store_compressed_01)
+{
+    ip_set_t  set;
+    ip_set_t  *read_set;
+
+    ipset_init(&set);
+    ipset_ipv6_add(&set, &IPV6_ADDR_1);
+    ipset_ipv6_add(&set, &IPV6_ADDR_2);
+    ipset_ipv6_add_network(&set, &IPV6_ADDR_3, 24);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_save_compressed(ostream, &set,
+                                      IPSET_COMPRESSION_ZLIB_FAST, NULL),
+                "Could not save set");
+
+    GInputStream  *istream =
+        g_memory_input_stream_new_from_data
+        (g_memory_output_stream_get_data(mostream),
+         g_memory_output_stream_get_data_size(mostream),
+         NULL);
+
+    read_set = ipset_load(istream, NULL);
+    fail_if(read_set == NULL,
+            "Could not read set");
+
+    fail_unless(ipset_is_equal(&set, read_set),
+                "Set not same after saving/loading");
+
+    g_object_unref(ostream);
+    g_object_unref(istream);
+    ipset_done(&set);
+    ipset_free(read_set);
+}
+END_TEST
+
 
 /*-----------------------------------------------------------------------
  * Testing harness
@@ -717,6 +1801,17 @@ ipset_suite()
     tcase_add_test(tc_general, test_empty_sets_equal);
     tcase_add_test(tc_general, test_empty_sets_not_unequal);
     tcase_add_test(tc_general, test_store_empty);
+    tcase_add_test(tc_general, test_sample_empty);
+    tcase_add_test(tc_general, test_sample_01);
+    tcase_add_test(tc_general, test_select_rank_01);
+    tcase_add_test(tc_general, test_select_rank_02);
+    tcase_add_test(tc_general, test_rank_non_member_01);
+    tcase_add_test(tc_general, test_subset_01);
+    tcase_add_test(tc_general, test_disjoint_01);
+    tcase_add_test(tc_general, test_intersection_count_01);
+    tcase_add_test(tc_general, test_intersection_count_02);
+    tcase_add_test(tc_general, test_network_relation_01);
+    tcase_add_test(tc_general, test_coarsen_01);
     suite_add_tcase(s, tc_general);
 
     TCase  *tc_ipv4 = tcase_create("ipv4");
@@ -724,6 +1819,8 @@ ipset_suite()
     tcase_add_test(tc_ipv4, test_ipv4_insert_02);
     tcase_add_test(tc_ipv4, test_ipv4_insert_network_01);
     tcase_add_test(tc_ipv4, test_ipv4_insert_network_02);
+    tcase_add_test(tc_ipv4, test_ipv4_insert_range_01);
+    tcase_add_test(tc_ipv4, test_ipv4_insert_range_02);
     tcase_add_test(tc_ipv4, test_ipv4_bad_netmask_01);
     tcase_add_test(tc_ipv4, test_ipv4_bad_netmask_02);
     tcase_add_test(tc_ipv4, test_ipv4_equality_1);
@@ -733,6 +1830,14 @@ ipset_suite()
     tcase_add_test(tc_ipv4, test_ipv4_store_01);
     tcase_add_test(tc_ipv4, test_ipv4_store_02);
     tcase_add_test(tc_ipv4, test_ipv4_store_03);
+    tcase_add_test(tc_ipv4, test_ipv4_store_compressed_01);
+    tcase_add_test(tc_ipv4, test_ipv4_store_archive_01);
+    tcase_add_test(tc_ipv4, test_ipv4_store_patch_01);
+    tcase_add_test(tc_ipv4, test_ipv4_store_patch_02);
+    tcase_add_test(tc_ipv4, test_ipv4_store_patch_corrupt_root);
+    tcase_add_test(tc_ipv4, test_ipv4_store_fingerprinted_01);
+    tcase_add_test(tc_ipv4, test_ipv4_store_async_01);
+    tcase_add_test(tc_ipv4, test_ipv4_store_async_02);
     suite_add_tcase(s, tc_ipv4);
 
     TCase  *tc_ipv6 = tcase_create("ipv6");
@@ -740,6 +1845,7 @@ ipset_suite()
     tcase_add_test(tc_ipv6, test_ipv6_insert_02);
     tcase_add_test(tc_ipv6, test_ipv6_insert_network_01);
     tcase_add_test(tc_ipv6, test_ipv6_insert_network_02);
+    tcase_add_test(tc_ipv6, test_ipv6_insert_range_01);
     tcase_add_test(tc_ipv6, test_ipv6_bad_netmask_01);
     tcase_add_test(tc_ipv6, test_ipv6_bad_netmask_02);
     tcase_add_test(tc_ipv6, test_ipv6_equality_1);
@@ -749,6 +1855,7 @@ ipset_suite()
     tcase_add_test(tc_ipv6, test_ipv6_store_01);
     tcase_add_test(tc_ipv6, test_ipv6_store_02);
     tcase_add_test(tc_ipv6, test_ipv6_store_03);
+    tcase_add_test(tc_ipv6, test_ipv6_store_compressed_01);
     suite_add_tcase(s, tc_ipv6);
 
     return s;
@@ -9,6 +9,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <check.h>
 #include <glib.h>
@@ -183,6 +184,540 @@ START_TEST(test_ipv4_iterate_network_03)
 END_TEST
 
 
+START_TEST(test_ipv4_iterate_network_04)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * These networks share a BDD path that skips over the 23rd bit, so
+     * the iterator has to try both values for that bit.  The results
+     * should come out in ascending address order.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "192.168.2.0");
+
+    ipset_ip_t  ip2;
+    ipset_ip_from_string(&ip2, "192.168.0.0");
+
+    ipset_ip_t  ip3;
+    ipset_ip_from_string(&ip3, "192.168.6.0");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 24),
+            "Element should not be present");
+
+    fail_if(ipset_ip_add_network(&set, &ip2, 24),
+            "Element should not be present");
+
+    fail_if(ipset_ip_add_network(&set, &ip3, 24),
+            "Element should not be present");
+
+    ipset_iterator_t  *it = ipset_iterate_networks(&set, TRUE);
+    fail_if(it == NULL,
+            "IP set iterator is NULL");
+
+    fail_if(it->finished,
+            "IP set shouldn't be empty");
+    fail_unless(ipset_ip_equal(&ip2, &it->addr),
+                "IP address 0 doesn't match");
+    fail_unless(it->netmask == 24,
+                "IP netmask 0 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_if(it->finished,
+            "IP set should contain 3 elements");
+    fail_unless(ipset_ip_equal(&ip1, &it->addr),
+                "IP address 1 doesn't match");
+    fail_unless(it->netmask == 24,
+                "IP netmask 1 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_if(it->finished,
+            "IP set should contain 3 elements");
+    fail_unless(ipset_ip_equal(&ip3, &it->addr),
+                "IP address 2 doesn't match");
+    fail_unless(it->netmask == 24,
+                "IP netmask 2 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_unless(it->finished,
+                "IP set should contain 3 elements");
+
+    ipset_iterator_free(it);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_iterate_network_05)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * Add the two halves of a /24 separately.  The iterator should
+     * merge them back into a single network.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "192.168.0.0");
+
+    ipset_ip_t  ip2;
+    ipset_ip_from_string(&ip2, "192.168.0.128");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 25),
+            "Element should not be present");
+    fail_if(ipset_ip_add_network(&set, &ip2, 25),
+            "Element should not be present");
+
+    ipset_iterator_t  *it = ipset_iterate_networks(&set, TRUE);
+    fail_if(it == NULL,
+            "IP set iterator is NULL");
+
+    fail_if(it->finished,
+            "IP set should not be empty");
+    fail_unless(ipset_ip_equal(&ip1, &it->addr),
+                "IP address 0 doesn't match");
+    fail_unless(it->netmask == 24,
+                "IP netmask 0 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_unless(it->finished,
+                "IP set should contain 1 network");
+
+    ipset_iterator_free(it);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_iterate_range_01)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * Add two adjacent networks that can't be merged into a single
+     * CIDR block, and a third network after a gap.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "192.168.0.128");
+
+    ipset_ip_t  ip2;
+    ipset_ip_from_string(&ip2, "192.168.1.0");
+
+    ipset_ip_t  ip3;
+    ipset_ip_from_string(&ip3, "192.168.1.255");
+
+    ipset_ip_t  ip4;
+    ipset_ip_from_string(&ip4, "192.168.3.0");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 25),
+            "Element should not be present");
+    fail_if(ipset_ip_add_network(&set, &ip2, 24),
+            "Element should not be present");
+    fail_if(ipset_ip_add(&set, &ip4),
+            "Element should not be present");
+
+    ipset_iterator_t  *it = ipset_iterate_networks(&set, TRUE);
+    fail_if(it == NULL,
+            "IP set iterator is NULL");
+
+    ipset_ip_t  first;
+    ipset_ip_t  last;
+
+    fail_unless(ipset_iterator_next_range(it, &first, &last),
+                "IP set should contain 2 ranges");
+    fail_unless(ipset_ip_equal(&ip1, &first),
+                "Range 0 start doesn't match");
+    fail_unless(ipset_ip_equal(&ip3, &last),
+                "Range 0 end doesn't match");
+
+    fail_unless(ipset_iterator_next_range(it, &first, &last),
+                "IP set should contain 2 ranges");
+    fail_unless(ipset_ip_equal(&ip4, &first),
+                "Range 1 start doesn't match");
+    fail_unless(ipset_ip_equal(&ip4, &last),
+                "Range 1 end doesn't match");
+
+    fail_if(ipset_iterator_next_range(it, &first, &last),
+            "IP set should contain 2 ranges");
+
+    ipset_iterator_free(it);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_export_01)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * Add networks on either side of the partition depth, and an IPv6
+     * address, and make sure that a multithreaded export writes them
+     * out in order.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "10.0.0.0");
+
+    ipset_ip_t  ip2;
+    ipset_ip_from_string(&ip2, "192.168.1.0");
+
+    ipset_ip_t  ip3;
+    ipset_ip_from_string(&ip3, "192.168.3.4");
+
+    ipset_ip_t  ip4;
+    ipset_ip_from_string(&ip4, "fe80::1");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 8),
+            "Element should not be present");
+    fail_if(ipset_ip_add_network(&set, &ip2, 24),
+            "Element should not be present");
+    fail_if(ipset_ip_add_network(&set, &ip3, 31),
+            "Element should not be present");
+    fail_if(ipset_ip_add(&set, &ip4),
+            "Element should not be present");
+
+    const gchar  *expected =
+        "10.0.0.0/8\n"
+        "192.168.1.0/24\n"
+        "192.168.3.4/31\n"
+        "fe80::1/128\n";
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_export(ostream, &set, TRUE, 2, NULL),
+                "Could not export set");
+
+    fail_unless(g_memory_output_stream_get_data_size(mostream) ==
+                strlen(expected),
+                "Exported set has the wrong size");
+    fail_unless(memcmp(g_memory_output_stream_get_data(mostream),
+                       expected, strlen(expected)) == 0,
+                "Exported set doesn't match");
+
+    g_object_unref(ostream);
+    ipset_done(&set);
+}
+END_TEST
+
+START_TEST(test_ipv4_export_02)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * Add a network that spans two partitions, and make sure that a
+     * multithreaded export without summarizing writes out the same
+     * addresses, in the same order, as the iterator.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "10.0.0.0");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 15),
+            "Element should not be present");
+
+    GString  *expected = g_string_new(NULL);
+    ipset_iterator_t  *it;
+    gchar  buf[IPSET_NETWORK_STRING_LENGTH];
+
+    for (it = ipset_iterate(&set, TRUE);
+         !it->finished;
+         ipset_iterator_advance(it))
+    {
+        g_string_append_len(expected, buf, ipset_ip_format(&it->addr, buf));
+        g_string_append_c(expected, '\n');
+    }
+
+    ipset_iterator_free(it);
+
+    GOutputStream  *ostream =
+        g_memory_output_stream_new(NULL, 0, g_realloc, g_free);
+    GMemoryOutputStream  *mostream =
+        G_MEMORY_OUTPUT_STREAM(ostream);
+
+    fail_unless(ipset_export(ostream, &set, FALSE, 2, NULL),
+                "Could not export set");
+
+    fail_unless(g_memory_output_stream_get_data_size(mostream) ==
+                expected->len,
+                "Exported set has the wrong size");
+    fail_unless(memcmp(g_memory_output_stream_get_data(mostream),
+                       expected->str, expected->len) == 0,
+                "Exported set doesn't match");
+
+    g_string_free(expected, TRUE);
+    g_object_unref(ostream);
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_iterate_batch_01)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * Add a network of 4 addresses, and read them out in batches of
+     * 3.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "192.168.0.0");
+
+    ipset_ip_t  ip4;
+    ipset_ip_from_string(&ip4, "192.168.0.3");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 30),
+            "Element should not be present");
+
+    ipset_iterator_t  *it = ipset_iterate(&set, TRUE);
+    fail_if(it == NULL,
+            "IP set iterator is NULL");
+
+    ipset_ip_t  addrs[3];
+    guint  netmasks[3];
+    gsize  count;
+
+    count = ipset_iterator_next_batch(it, addrs, netmasks, 3);
+    fail_unless(count == 3,
+                "First batch should contain 3 elements");
+    fail_unless(ipset_ip_equal(&ip1, &addrs[0]),
+                "IP address 0 doesn't match");
+    fail_unless(netmasks[0] == IPV4_BIT_SIZE,
+                "IP netmask 0 doesn't match");
+
+    count = ipset_iterator_next_batch(it, addrs, NULL, 3);
+    fail_unless(count == 1,
+                "Second batch should contain 1 element");
+    fail_unless(ipset_ip_equal(&ip4, &addrs[0]),
+                "IP address 3 doesn't match");
+
+    fail_unless(it->finished,
+                "IP set should contain 4 elements");
+
+    count = ipset_iterator_next_batch(it, addrs, netmasks, 3);
+    fail_unless(count == 0,
+                "Finished iterator shouldn't return a batch");
+
+    ipset_iterator_free(it);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_iterate_from_01)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * Add two networks, and start iterating in the middle of the
+     * first one.  The first network should be trimmed to the
+     * addresses at or after the starting point.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "192.168.0.0");
+
+    ipset_ip_t  ip2;
+    ipset_ip_from_string(&ip2, "192.168.0.2");
+
+    ipset_ip_t  ip3;
+    ipset_ip_from_string(&ip3, "192.168.1.0");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 30),
+            "Element should not be present");
+    fail_if(ipset_ip_add_network(&set, &ip3, 24),
+            "Element should not be present");
+
+    ipset_iterator_t  *it =
+        ipset_iterate_from(&set, &ip2, TRUE, TRUE);
+    fail_if(it == NULL,
+            "IP set iterator is NULL");
+
+    fail_if(it->finished,
+            "IP set should not be empty");
+    fail_unless(ipset_ip_equal(&ip2, &it->addr),
+                "IP address 0 doesn't match");
+    fail_unless(it->netmask == 31,
+                "IP netmask 0 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_if(it->finished,
+            "IP set should contain 2 elements");
+    fail_unless(ipset_ip_equal(&ip3, &it->addr),
+                "IP address 1 doesn't match");
+    fail_unless(it->netmask == 24,
+                "IP netmask 1 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_unless(it->finished,
+                "IP set should contain 2 elements");
+
+    ipset_iterator_free(it);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_iterate_within_01)
+{
+    ip_set_t  set;
+    ipset_init(&set);
+
+    /*
+     * Add two networks, and only iterate through the addresses in
+     * the second one.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "192.168.0.0");
+
+    ipset_ip_t  ip2;
+    ipset_ip_from_string(&ip2, "192.168.1.0");
+
+    ipset_ip_t  ip3;
+    ipset_ip_from_string(&ip3, "192.168.1.1");
+
+    fail_if(ipset_ip_add_network(&set, &ip1, 30),
+            "Element should not be present");
+    fail_if(ipset_ip_add_network(&set, &ip2, 31),
+            "Element should not be present");
+
+    ipset_iterator_t  *it =
+        ipset_iterate_within(&set, &ip3, 24, TRUE, FALSE);
+    fail_if(it == NULL,
+            "IP set iterator is NULL");
+
+    fail_if(it->finished,
+            "IP set should not be empty");
+    fail_unless(ipset_ip_equal(&ip2, &it->addr),
+                "IP address 0 doesn't match");
+    fail_unless(it->netmask == IPV4_BIT_SIZE,
+                "IP netmask 0 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_if(it->finished,
+            "IP set should contain 2 elements");
+    fail_unless(ipset_ip_equal(&ip3, &it->addr),
+                "IP address 1 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_unless(it->finished,
+                "IP set should contain 2 elements");
+
+    ipset_iterator_free(it);
+
+    ipset_done(&set);
+}
+END_TEST
+
+
+START_TEST(test_ipv4_map_iterate_networks_01)
+{
+    ip_map_t  map;
+    ipmap_init(&map, 0);
+
+    /*
+     * Map two networks to different values, and make sure that the
+     * non-default iterator returns each of them with its value.
+     */
+
+    ipset_ip_t  ip1;
+    ipset_ip_from_string(&ip1, "192.168.0.0");
+
+    ipset_ip_t  ip2;
+    ipset_ip_from_string(&ip2, "192.168.1.0");
+
+    ipmap_ip_set_network(&map, &ip1, 24, 1);
+    ipmap_ip_set_network(&map, &ip2, 30, 2);
+
+    ipset_iterator_t  *it = ipmap_iterate_non_default_networks(&map);
+    fail_if(it == NULL,
+            "IP map iterator is NULL");
+
+    fail_if(it->finished,
+            "IP map should not be empty");
+    fail_unless(ipset_ip_equal(&ip1, &it->addr),
+                "IP address 0 doesn't match");
+    fail_unless(it->netmask == 24,
+                "IP netmask 0 doesn't match");
+    fail_unless(it->value == 1,
+                "IP value 0 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_if(it->finished,
+            "IP map should contain 2 elements");
+    fail_unless(ipset_ip_equal(&ip2, &it->addr),
+                "IP address 1 doesn't match");
+    fail_unless(it->netmask == 30,
+                "IP netmask 1 doesn't match");
+    fail_unless(it->value == 2,
+                "IP value 1 doesn't match");
+
+    ipset_iterator_advance(it);
+    fail_unless(it->finished,
+                "IP map should contain 2 elements");
+
+    ipset_iterator_free(it);
+
+    /*
+     * The unfiltered iterator should cover the whole address space,
+     * starting with the default-valued network 0.0.0.0/1.
+     */
+
+    ipset_ip_t  ip0;
+    ipset_ip_from_string(&ip0, "0.0.0.0");
+
+    it = ipmap_iterate_networks(&map);
+    fail_if(it == NULL,
+            "IP map iterator is NULL");
+
+    fail_unless(ipset_ip_equal(&ip0, &it->addr),
+                "IP address 0 doesn't match");
+    fail_unless(it->netmask == 1,
+                "IP netmask 0 doesn't match");
+    fail_unless(it->value == 0,
+                "IP value 0 doesn't match");
+
+    guint  count = 0;
+    guint  mapped = 0;
+
+    for (; !it->finished; ipset_iterator_advance(it))
+    {
+        count++;
+        if (it->value != 0)
+            mapped++;
+    }
+
+    fail_unless(mapped == 2,
+                "IP map should contain 2 non-default networks");
+    fail_unless(count > mapped,
+                "IP map iterator should return default networks");
+
+    ipset_iterator_free(it);
+
+    ipmap_done(&map);
+}
+END_TEST
+
+
 START_TEST(test_ipv6_iterate_01)
 {
     ip_set_t  set;
@@ -436,6 +971,15 @@ ipset_suite()
     tcase_add_test(tc_iterator, test_ipv4_iterate_network_01);
     tcase_add_test(tc_iterator, test_ipv4_iterate_network_02);
     tcase_add_test(tc_iterator, test_ipv4_iterate_network_03);
+    tcase_add_test(tc_iterator, test_ipv4_iterate_network_04);
+    tcase_add_test(tc_iterator, test_ipv4_iterate_network_05);
+    tcase_add_test(tc_iterator, test_ipv4_iterate_range_01);
+    tcase_add_test(tc_iterator, test_ipv4_export_01);
+    tcase_add_test(tc_iterator, test_ipv4_export_02);
+    tcase_add_test(tc_iterator, test_ipv4_iterate_batch_01);
+    tcase_add_test(tc_iterator, test_ipv4_iterate_from_01);
+    tcase_add_test(tc_iterator, test_ipv4_iterate_within_01);
+    tcase_add_test(tc_iterator, test_ipv4_map_iterate_networks_01);
     tcase_add_test(tc_iterator, test_ipv6_iterate_01);
     tcase_add_test(tc_iterator, test_ipv6_iterate_network_01);
     tcase_add_test(tc_iterator, test_ipv6_iterate_network_02);